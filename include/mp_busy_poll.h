@@ -0,0 +1,60 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MP_BUSY_POLL_H_
+#define _MP_BUSY_POLL_H_
+
+#include <stdint.h>
+#include <vector>
+
+// Low latency receive (-P).  Before each blocking recv the receive socket
+// is polled with non-blocking peeks for up to |budget_us|, so a reply that
+// arrives within the budget is taken without the sleep/wakeup of a
+// blocking recv.  SO_BUSY_POLL (and SO_PREFER_BUSY_POLL where the kernel
+// has it) makes each of those peeks poll the NIC queue as well.
+//
+// RTT samples are split by whether their reply was taken while spinning
+// or by the blocking recv, and the interval output compares the two along
+// with the time and CPU spent spinning.
+class MpingBusyPoll {
+  public:
+    explicit MpingBusyPoll(unsigned int budget_us);
+
+    // Sets the busy poll socket options on |fd|.  Failures only warn; the
+    // spin works without them.
+    void Setup(int fd);
+
+    // Spins until |fd| has a packet queued (returns 0), the budget runs
+    // out (EAGAIN) or a signal arrives (EINTR).
+    int Spin(int fd);
+
+    // RTT of the reply taken by the last receive, in ms.
+    void OnRtt(double rtt);
+
+    void PrintTempStats();
+
+  private:
+    uint64_t budget_ns_;
+    bool last_spun_;
+
+    unsigned int recv_temp_;
+    unsigned int spun_temp_;
+    uint64_t spin_ns_temp_;
+    std::vector<double> spun_rtt_temp_;
+    std::vector<double> blocked_rtt_temp_;
+    uint64_t start_ns_temp_;
+    uint64_t cpu_us_temp_;  // process user + system time at start
+};
+
+#endif  // _MP_BUSY_POLL_H_
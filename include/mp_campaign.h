@@ -0,0 +1,140 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef _MP_CAMPAIGN_H_
+#define _MP_CAMPAIGN_H_
+
+#include <stdint.h>
+#include <istream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mp_config.h"
+#include "mp_resolver.h"
+
+class MpingSession;
+class MpingSessionListener;
+class MpingSocket;
+
+// One probe of a campaign file (-C).  Each line reads
+//   <start> <duration> <mping switches> <host>
+// with |start| in seconds after the campaign starts and |duration| in
+// seconds, 0 to run the probe through.  The switches are those of mping
+// that MpingSession runs, from the defaults, e.g.
+//   # a fixed window of 8 for a minute, then a size sweep
+//   0   60  -f -n 8 -b 100 192.0.2.1
+//   60  0   -n 4 -b -3 -t 64 -p 33434 192.0.2.1
+// Blank lines and those starting with '#' are skipped.
+struct MpingProbeSpec {
+  MpingProbeSpec() : start(0), duration(0), line(0) { }
+
+  double start;
+  double duration;
+  MpingConfig config;  // dst_host becomes the address once resolved
+  std::string target;  // the host as in the file
+  int line;  // in the campaign file, 0 if none
+};
+
+// Reads the campaign in |in| to |specs|, ordered by start.  Returns -1
+// with "line <n>: <reason>" in |error| on the first bad line.
+int MpingReadCampaign(std::istream& in, std::vector<MpingProbeSpec> *specs,
+                      std::string *error);
+
+// When the probes of a campaign may start: each at its start time, at most
+// |max_sessions| at once, at most |max_per_host| at once to one host, and
+// |host_gap| seconds apart to one host.  A probe held back by a limit
+// does not hold back later probes to other hosts.
+class MpingCampaignQueue {
+  public:
+    MpingCampaignQueue(int max_sessions, int max_per_host, double host_gap);
+
+    void Add(const MpingProbeSpec& spec);
+
+    // Takes the next probe that may start at |now| (seconds into the
+    // campaign) to |spec| and counts it running.  If none, returns false
+    // with how long until one may to |wait|, or -1 if only a probe ending
+    // (OnEnd) can let one start.
+    bool Next(double now, MpingProbeSpec *spec, double *wait);
+    // A probe to |host| taken from Next is over.
+    void OnEnd(const std::string& host);
+
+    bool empty() const { return pending_.empty(); }
+    int running() const { return running_; }
+
+  private:
+    int max_sessions_;
+    int max_per_host_;
+    double host_gap_;
+    std::vector<MpingProbeSpec> pending_;  // by start
+    std::map<std::string, int> running_per_host_;
+    std::map<std::string, double> last_start_;
+    int running_;
+};
+
+// Runs a campaign in one process: a MpingSession per probe, all polled
+// from one loop, each printing its intervals prefixed by its host and
+// line.  Host names are resolved all at once by a MpingResolver, and a
+// probe is queued as soon as its host resolves, to its first address in
+// the order of MpingSortAddresses, so IPv6 when there is one.
+// Sockets of finished probes are kept and handed to the next probe of the
+// same transport, see MpingSocket::Initialize, so a probe does not pay
+// for opening and sizing them.
+class MpingCampaign {
+  public:
+    // |lookup| resolves the host names, not owned, NULL for the system's.
+    MpingCampaign(int max_sessions, int max_per_host, double host_gap,
+                  MpingLookup *lookup);
+    ~MpingCampaign();
+
+    // Starts the resolver, before Add.  Returns -1 with the reason in
+    // |error| if it cannot.
+    int Init(std::string *error);
+
+    void Add(const MpingProbeSpec& spec);
+
+    // Returns the number of probes that failed.
+    int Run();
+
+  private:
+    struct Running {
+      MpingProbeSpec spec;
+      MpingSession *session;
+      MpingSessionListener *printer;
+      MpingSocket *socket;
+      uint64_t end;  // ns, 0 runs through
+    };
+
+    MpingCampaign(const MpingCampaign&);
+    MpingCampaign& operator = (const MpingCampaign&);
+
+    // What a socket is set up for beyond its destination, "" if it is
+    // not to be reused.
+    static std::string PoolKey(const MpingConfig& config);
+    // Queues the probes whose hosts resolved, returns how many of them
+    // did not.
+    int TakeResolved();
+    int StartProbe(const MpingProbeSpec& spec, uint64_t now);
+    void EndProbe(size_t ix, bool failed);
+
+    MpingResolver resolver_;
+    // by host name, waiting for it to resolve
+    std::map<std::string, std::vector<MpingProbeSpec> > unresolved_;
+    MpingCampaignQueue queue_;
+    std::vector<Running> running_;
+    std::map<std::string, std::vector<MpingSocket*> > pool_;  // owned
+};
+
+#endif  // _MP_CAMPAIGN_H_
@@ -0,0 +1,32 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MP_CHECKSUM_H_
+#define _MP_CHECKSUM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// RFC 1071 Internet checksum of |len| bytes at |data|, bit for bit the same
+// as mlab::InternetCheckSum.  The kernel (AVX2, SSE2, NEON or portable
+// 64-bit) is picked once from what the CPU supports.
+uint16_t MpingCheckSum(const void *data, size_t len);
+
+typedef uint16_t (*MpingCheckSumFunc)(const void *data, size_t len);
+
+// Kernel by name: "generic", "sse2", "avx2" or "neon".  NULL if it is not
+// built for this architecture or the CPU lacks it.  For tests.
+MpingCheckSumFunc MpingCheckSumKernel(const char *name);
+
+#endif  // _MP_CHECKSUM_H_
@@ -0,0 +1,39 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MP_CLOCK_H_
+#define _MP_CLOCK_H_
+
+#include <stdint.h>
+
+const uint64_t kNsPerSec = 1000000000ULL;
+const uint64_t kNsPerMs = 1000000ULL;
+
+// Monotonic clock in nanoseconds for all probe timing.  It never steps
+// under NTP, unlike gettimeofday.  On CPUs with an invariant TSC it reads
+// the TSC, scaled by a short calibration against CLOCK_MONOTONIC_RAW done
+// on first use: three 10 ms rounds, each end a TSC read bracketed by raw
+// reads.  If the rounds disagree, or the CPU has no invariant TSC, it is
+// clock_gettime(CLOCK_MONOTONIC_RAW), which is a vDSO call and still
+// avoids a syscall.
+class MpingClock {
+  public:
+    static uint64_t NowNs();
+    static const char* Source();  // "tsc" or "clock_gettime"
+
+    // Sleeps, then spins the last few microseconds, until NowNs() >= |ns|.
+    static void WaitUntil(uint64_t ns);
+};
+
+#endif  // _MP_CLOCK_H_
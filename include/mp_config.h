@@ -0,0 +1,80 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef _MP_CONFIG_H_
+#define _MP_CONFIG_H_
+
+#include <stddef.h>
+#include <string>
+#include "mlab/socket_family.h"
+
+// What to probe and how: the command line switches of mping (see MPing),
+// or filled in directly by a program embedding MpingSession.  The defaults
+// are those of mping without switches.
+struct MpingConfig {
+  MpingConfig();
+
+  // Reads mping's switches and destination from |argv|, |argv[0]| being
+  // the program.  Returns -1 with the reason in |error| on an unknown
+  // switch, a switch missing its value, or a second destination.
+  int ParseArgs(int argc, const char **argv, std::string *error);
+
+  // Checks the options against each other and fills in those implied by
+  // others, e.g. -Q forces -f.  Returns -1 with the reason in |error|.
+  // Server mode, the version and the destination host are left to the
+  // caller.
+  int Validate(std::string *error);
+
+  int        win_size;  // -n
+  bool       loop;  // -f
+  int        rate;  // -R
+  bool       slow_start;  // -S
+  int        ttl;  // -t, 0 probes with ICMP
+  int        inc_ttl;  // -a, auto increase TTL to this value
+  size_t     pkt_size;  // -b, packet size in bytes
+  int        loop_size;  // -b -1 to -4
+  bool       version;  // -V
+  bool       help;  // -h
+  bool       debug;  // -d
+  int        burst;  // -B, burst size
+  int        interval;  // undefined now
+  int        dport;  // -p
+  unsigned short  server_port;  // -s
+  SocketFamily server_family;  // -4, -6
+  bool       client_mode;  // -c
+  double     target_queue;  // -Q, 0 is off
+  bool       target_queue_ms;  // target_queue is in ms, not packets
+  bool       knee_search;  // -K
+  bool       all_hops;  // -H, all TTLs of -a at once
+  bool       interleave_sizes;  // -I, all sizes of -b -<sel> at once
+  int        busy_poll;  // -P spin budget in us, 0 is off
+  bool       io_uring;  // -U, send and receive through io_uring
+  bool       legacy_seq;  // -L, 32 bit sequence without session nonce
+  double     loss_timeout;  // -T in ms, 0 follows the RTT
+  std::string src_addr;  // -F
+  std::string shm_name;  // -M, empty is off
+  bool       dual_stack;  // -D, best IPv4 and IPv6 address side by side
+  int        flows;  // -E, probes spread over this many flows
+  bool       profile;  // -X, time the phases of the probe loop
+  std::string dst_host;
+
+  // campaign mode, see mp_campaign.h
+  std::string campaign;  // -C, file of probes, empty is off
+  int        max_sessions;  // -j, probes running at once
+  int        max_per_host;  // -J, probes running at once to one host
+  double     host_gap;  // -G, seconds between probe starts to one host
+};
+
+#endif  // _MP_CONFIG_H_
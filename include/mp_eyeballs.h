@@ -0,0 +1,48 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef _MP_EYEBALLS_H_
+#define _MP_EYEBALLS_H_
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "mp_config.h"
+
+class MpingTransport;
+
+// Orders |ips| the way RFC 8305 section 4 orders connection attempts:
+// families interleaved, IPv6 first, one address of each in turn.
+void MpingSortAddresses(const std::set<std::string>& ips,
+                        std::vector<std::string> *ordered);
+
+// Races the first probes to |ordered|, through |transports|, one per
+// address, not initialized yet and not owned.  As RFC 8305 section 5,
+// attempts start 250 ms apart in order, or at once when all those started
+// have failed, and each keeps sending a probe every second until it is
+// answered, it fails, or 2 s after the last attempt started.
+//
+// Without |each_family| the race ends at the first reply; with it, when
+// each family has answered, and addresses of a family that has are not
+// tried any more.  The addresses that answered go to |responsive|, the
+// first to answer first.  Returns how many did.  All transports share
+// one clock and are left without a receive deadline.
+int MpingRaceAddresses(const std::vector<std::string>& ordered,
+                       const std::vector<MpingTransport*>& transports,
+                       const MpingConfig& config, bool each_family,
+                       std::vector<std::string> *responsive);
+
+#endif  // _MP_EYEBALLS_H_
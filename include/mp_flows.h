@@ -0,0 +1,48 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef _MP_FLOWS_H_
+#define _MP_FLOWS_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "mp_stat_split.h"
+
+// Probes spread over several flows (-E), so that ECMP and LAG hashing
+// puts them on different member links.  Each flow is a class of
+// MpingStatSplit: probe |seq| goes on flow (seq - 1) % flows, see
+// MpingSocket::SetFlows, with its own MpingStat and its share of the
+// window.  A member link that drops or delays its traffic shows up as a
+// flow out of line with the others.
+class MpingFlowSpread : public MpingStatSplit {
+  public:
+    MpingFlowSpread(int flows, int win_size, bool keep_send_times,
+                    double loss_timeout);
+
+    int FlowFor(uint64_t seq) const { return ClassFor(seq); }
+
+    // One line per flow, each as MpingStat's after the flow's RTT.
+    void PrintTempStats();
+    // The totals of each flow, then the flows that look unhealthy.
+    void PrintStats();
+
+    // Flows whose loss or smoothed RTT stands out from the median of all
+    // flows: loss over twice the median and 1% above it, or an RTT over
+    // 1.5 times the median.  Meant for after PrintStats.
+    void Suspects(std::vector<int> *flows) const;
+};
+
+#endif  // _MP_FLOWS_H_
@@ -0,0 +1,62 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MP_HOPS_H_
+#define _MP_HOPS_H_
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// Per hop statistics for probing all TTLs at once (-a with -H).  Probes go
+// out with TTL 1..max_ttl in turn, so the TTL of a probe follows from its
+// sequence and the reply, a time exceeded from the router at that hop or
+// an error from the destination, needs no other state to be attributed.
+//
+// At the end a table gives each hop's responders, loss, RTT percentiles
+// and queueing, the median RTT above the smallest one seen.
+class MpingHopStats {
+  public:
+    explicit MpingHopStats(int max_ttl);
+
+    int TtlFor(uint64_t seq) const {
+      return 1 + static_cast<int>((seq - 1) % max_ttl_);
+    }
+
+    void OnSend(uint64_t seq);
+    // Reply to |seq| from |from|, |rtt| in ms.
+    void OnRecv(uint64_t seq, const std::string& from, double rtt);
+
+    // Prints the table, hops past the first one |dst_addr| answered are
+    // left out.
+    void Print(const std::string& dst_addr);
+
+  private:
+    struct Hop {
+      Hop() : sent(0), received(0), seen(0) { }
+
+      uint64_t sent;
+      uint64_t received;
+      uint64_t seen;  // RTT samples offered to |rtts|
+      std::map<std::string, uint64_t> from;  // replies per responder
+      std::vector<double> rtts;  // reservoir sample
+    };
+
+    int max_ttl_;
+    uint64_t rng_;
+    std::vector<Hop> hops_;  // hops_[ttl - 1]
+};
+
+#endif  // _MP_HOPS_H_
@@ -0,0 +1,58 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef _MP_LOCAL_DROPS_H_
+#define _MP_LOCAL_DROPS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include <istream>
+
+// Replies the kernel drops because our own receive queue is full are
+// never received, and would pass for loss on the path.  The kernel counts
+// them per socket (sk_drops); these read that counter so MpingSocket can
+// report them apart.  The counter is 32 bits and wraps, take differences
+// in uint32_t.
+
+// Asks for a receive buffer of |bytes| on |fd|: SO_RCVBUFFORCE, past
+// net.core.rmem_max, where we have CAP_NET_ADMIN, SO_RCVBUF otherwise.
+// Returns what the kernel granted, in the same bytes as |bytes| (it
+// reports twice that, for its bookkeeping).
+size_t MpingSizeRecvBuffer(int fd, size_t bytes);
+
+// Turns on SO_RXQ_OVFL: each message received on |fd| then carries the
+// drop counter as it was at the time, see MpingRxqOverflow.
+bool MpingEnableRxqOverflow(int fd);
+
+// The drop counter in the control data of a message received with
+// recvmsg, as it was when the message was queued.  False if it has none,
+// which is also how the kernel says the counter was 0.
+bool MpingRxqOverflow(const struct msghdr *msg, uint32_t *drops);
+
+// Room to leave in msg_control for MpingRxqOverflow.
+const size_t kMpingRxqControlSize = 64;
+
+// The drop counter of |fd| now: SO_MEMINFO (Linux 3.9), or the drops
+// column of /proc/net/{raw,raw6,udp,udp6}.  False if neither has it.
+bool MpingSocketDrops(int fd, uint32_t *drops);
+
+// The drops column of the socket with |inode| in |table|, in the format
+// of /proc/net/udp.
+bool MpingProcNetDrops(std::istream& table, unsigned long inode,
+                       uint32_t *drops);
+
+#endif  // _MP_LOCAL_DROPS_H_
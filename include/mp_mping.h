@@ -18,39 +18,35 @@
 #include <stdint.h>
 #include <set>
 #include <string>
-#include "mlab/socket_family.h"
+#include <vector>
+#include "mp_config.h"
 
 //#define MP_PRINT_TIMELINE
 
+class MpingTransport;
+
 class MPing{
   public:
     MPing(const int& argc, const char **argv); 
     void Run();
     void RunServer();
     bool IsServerMode() const;
+
+    // Probe through |t| (e.g. a MpingSimTransport) instead of opening
+    // sockets.  Not owned; NULL goes back to the network.
+    void SetTransport(MpingTransport *t) { transport = t; }
  
   private:
-    int        win_size;  
-    bool       loop;
-    int        rate;
-    bool       slow_start;
-    int ttl;
-    int inc_ttl;  // auto increase TTL to this value
-    size_t     pkt_size;  // packet size in bytes
-    int        loop_size;  // -1 to -4
-    bool       version;
-    bool       debug;
-    int        burst;  // burst size
-    int        interval;  // undefined now
-    int        dport;
-    unsigned short  server_port;
-    SocketFamily server_family;
-    bool       client_mode;
-    std::string src_addr;
-    std::string dst_host;
+    MpingConfig config;
     std::set<std::string> dest_ips;
+    MpingTransport *transport;
 
     int GoProbing(const std::string& dst_addr);
+    // Races the first probes to |ordered|, see MpingRaceAddresses.
+    void RaceAddresses(const std::vector<std::string>& ordered,
+                       std::vector<std::string> *responsive);
+    void RunDualStack(const std::vector<std::string>& targets);
+    void RunCampaign();
     void ValidatePara();
 };
 
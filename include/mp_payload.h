@@ -0,0 +1,54 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MP_PAYLOAD_H_
+#define _MP_PAYLOAD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Probe payload, right after the ICMP or UDP header, in network order:
+//   session: "mlab-ssn#" nonce(4) seq(8) send time(8) check(4)
+//   legacy:  "mlab-seq#" seq(4)            (-L, for old servers)
+// The nonce is random per run, so replies to an earlier run against the
+// same host are not mistaken for ours, and the 64 bit sequence does not
+// wrap.  The send time (ns, sender's clock) comes back with the reply, so
+// its RTT needs no per packet state however late it is; the check covers
+// nonce, sequence and send time.  The legacy 32 bit sequence is widened
+// on receive against the last sequence sent.
+const int kPayloadHeaderLength = 9;
+const size_t kLegacyPayloadLength = kPayloadHeaderLength + 4;
+const size_t kSessionPayloadLength = kPayloadHeaderLength + 4 + 8 + 8 + 4;
+
+// Writes the payload for |seq| sent at |send_time| to |buf|, returns its
+// length.  The legacy format has no room for |send_time|.
+size_t MpingWritePayload(char *buf, bool legacy, uint32_t nonce,
+                         uint64_t seq, uint64_t send_time);
+
+// Parses the payload of |len| bytes at |buf|.  Returns false if it is not
+// an mping payload or fails its check.  For the legacy format |*nonce| and
+// |*send_time| are 0 and |*seq| is the 32 bit wire value.
+bool MpingReadPayload(const char *buf, size_t len, bool *legacy,
+                      uint32_t *nonce, uint64_t *seq, uint64_t *send_time);
+
+// Random nonce for a new session, never 0.
+uint32_t MpingNewNonce();
+
+// Widens a 32 bit wire sequence to the 64 bit sequence nearest below
+// |last_sent|.
+inline uint64_t MpingWidenSeq(uint32_t wire, uint64_t last_sent) {
+  return last_sent - static_cast<uint32_t>(last_sent - wire);
+}
+
+#endif  // _MP_PAYLOAD_H_
@@ -0,0 +1,129 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef _MP_PROBE_LAYOUT_H_
+#define _MP_PROBE_LAYOUT_H_
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mlab/protocol_header.h"
+#include "mlab/socket_family.h"
+
+// How MpingSocket probes: ICMP echo, UDP answered by ICMP errors (-t,
+// -a), or UDP echoed by an mping server (-c).
+enum MpingProbeMode { kProbeEcho, kProbeUdpErrors, kProbeUdpClient };
+
+// The headers of a family.  A raw ICMPv4 socket hands over the IP header
+// with the ICMP message, a raw ICMPv6 socket only the message.
+template <SocketFamily F> struct MpingFamilyLayout;
+
+template <> struct MpingFamilyLayout<SOCKETFAMILY_IPV4> {
+  typedef mlab::IP4Header IpHeader;
+  typedef mlab::ICMP4Header IcmpHeader;
+  static const size_t kRawIpHeader = sizeof(mlab::IP4Header);
+  static const uint8_t kEchoReply = 0;
+  static const uint8_t kUnreachable = 3;
+  static const uint8_t kTimeExceeded = 11;
+  static uint8_t Protocol(const IpHeader *ip) { return ip->protocol; }
+};
+
+template <> struct MpingFamilyLayout<SOCKETFAMILY_IPV6> {
+  typedef mlab::IP6Header IpHeader;
+  typedef mlab::ICMP6Header IcmpHeader;
+  static const size_t kRawIpHeader = 0;
+  static const uint8_t kEchoReply = 129;
+  static const uint8_t kUnreachable = 1;
+  static const uint8_t kTimeExceeded = 3;
+  static uint8_t Protocol(const IpHeader *ip) { return ip->next_header; }
+};
+
+// Where things are in the probes of one family and mode, all known at
+// compile time but the payload length (-L or not).
+//   kProbeHeader    what goes before the payload of a probe we build
+//   kSendOverhead   what the kernel adds to it, up to the -b size
+//   kIcmpOffset     of the ICMP header in what the receive socket gets
+//   kRecvHeaders    what goes before the payload in a reply
+template <SocketFamily F, MpingProbeMode M>
+struct MpingProbeLayout {
+  typedef MpingFamilyLayout<F> Family;
+  typedef typename Family::IcmpHeader IcmpHeader;
+  typedef typename Family::IpHeader IpHeader;
+
+  static const size_t kProbeHeader =
+      M == kProbeEcho ? sizeof(IcmpHeader) : 0;
+  static const size_t kSendOverhead = sizeof(IpHeader) +
+      (M == kProbeEcho ? 0 : sizeof(mlab::UDPHeader));
+  static const size_t kIcmpOffset =
+      M == kProbeUdpClient ? 0 : Family::kRawIpHeader;
+  static const size_t kRecvHeaders =
+      M == kProbeUdpClient ? 0 :
+      M == kProbeEcho ? kIcmpOffset + sizeof(IcmpHeader) :
+      kIcmpOffset + sizeof(IcmpHeader) + sizeof(IpHeader) +
+          sizeof(mlab::UDPHeader);
+};
+
+// What a packet on the receive socket turned out to be.
+enum MpingReplyKind {
+  kReplyOk,         // one of our probes back, payload not checked yet
+  kReplyShort,      // too short to tell
+  kReplyTruncated,  // an ICMP message, too short to carry our payload
+  kReplyWrongType,  // ICMP, but not the kind the mode expects
+  kReplyNotUdp      // an ICMP error for something other than UDP
+};
+
+// Sorts out the |len| bytes of |packet| for probes with |payload_len|
+// bytes of payload.  For kReplyOk |*payload| points at the payload.
+template <SocketFamily F, MpingProbeMode M>
+inline MpingReplyKind MpingClassifyReply(const char *packet, size_t len,
+                                         size_t payload_len,
+                                         const char **payload) {
+  typedef MpingProbeLayout<F, M> Layout;
+  typedef typename Layout::Family Family;
+
+  if (M != kProbeUdpClient) {
+    if (len < Layout::kIcmpOffset + sizeof(typename Layout::IcmpHeader))
+      return kReplyShort;
+    if (len < Layout::kRecvHeaders + payload_len)
+      return kReplyTruncated;
+
+    const typename Layout::IcmpHeader *icmp =
+        reinterpret_cast<const typename Layout::IcmpHeader *>(
+            packet + Layout::kIcmpOffset);
+    if (M == kProbeEcho) {
+      if (icmp->icmp_type != Family::kEchoReply)
+        return kReplyWrongType;
+    } else {
+      if (icmp->icmp_type != Family::kUnreachable &&
+          icmp->icmp_type != Family::kTimeExceeded) {
+        return kReplyWrongType;
+      }
+
+      // the probe that drew the error, as quoted
+      const typename Layout::IpHeader *ip =
+          reinterpret_cast<const typename Layout::IpHeader *>(
+              packet + Layout::kIcmpOffset +
+              sizeof(typename Layout::IcmpHeader));
+      if (Family::Protocol(ip) != IPPROTO_UDP)
+        return kReplyNotUdp;
+    }
+  }
+
+  *payload = packet + Layout::kRecvHeaders;
+  return kReplyOk;
+}
+
+#endif  // _MP_PROBE_LAYOUT_H_
@@ -0,0 +1,99 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef _MP_PROBE_LOOP_H_
+#define _MP_PROBE_LOOP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mp_config.h"
+#include "mp_profile.h"
+
+class MpingStat;
+class MpingTransport;
+
+// Per probe bookkeeping of a MpingProbeLoop user beyond its MpingStat.
+class MpingProbeHooks {
+  public:
+    virtual ~MpingProbeHooks() {}
+
+    // Before probe |seq| goes out: may set its TTL or change its |size|.
+    virtual void BeforeSend(uint64_t seq, size_t *size) {}
+    // |seq| went out at |now|.
+    virtual void OnSend(uint64_t seq, uint64_t now) {}
+    // A reply for |seq| came at |now|, see MpingProbeLoop::Receive.
+    virtual void OnReply(uint64_t seq, uint64_t now, uint64_t send_time,
+                         double rtt) {}
+};
+
+// The send and receive steps of a probe run, which the mping tool
+// (MPing::GoProbing) and MpingSession build their loops on: tops the
+// probes in flight up to the window through a MpingTransport and charges
+// what goes out and comes back to a MpingStat.  The loops around it, over
+// TTLs, sizes, windows and intervals, and what to print, stay with the
+// callers.
+class MpingProbeLoop {
+  public:
+    // None owned.  Slow start (-S) and bursts (-B) are from |config|.
+    MpingProbeLoop(const MpingConfig& config, MpingTransport *transport,
+                   MpingStat *stat);
+
+    // Not owned, NULL for none.
+    void SetHooks(MpingProbeHooks *hooks) { hooks_ = hooks; }
+    // Times the send, receive and stats steps into |profile|, see
+    // MpingProfile.  NULL, the default, does not.
+    void SetProfile(MpingProfile *profile) { profile_ = profile; }
+
+    // Sends probes of |size| while fewer than |window| are in flight, at
+    // most 10 at once (2 with -S), or, once the window has filled, -B at
+    // once when there is room for them.  |force| sends one even if there
+    // is no room.  Returns 0, stopping early on ENOBUFS or EINTR (in
+    // |error|, 0 otherwise), or -1 with the errno in |error| if a send
+    // fails for good.
+    int Send(int window, bool force, size_t size, int *error);
+
+    // Takes one reply, blocking as the transport's receive deadline and
+    // timeout allow, and charges it.  Returns 1 with its sequence in |seq|
+    // and its RTT in ms in |rtt|, negative for duplicates, late and
+    // unknown ones (see MpingStat::EnqueueRecv); 0 if none came, with
+    // EAGAIN, ETIMEDOUT or EINTR in |error|; -1 with the errno in |error|
+    // if the receive fails.
+    int Receive(uint64_t *seq, double *rtt, int *error);
+
+    uint64_t sent() const { return sseq_; }  // the highest sequence sent
+    bool bursting() const { return start_burst_; }
+
+  private:
+    MpingProbeLoop(const MpingProbeLoop&);
+    MpingProbeLoop& operator = (const MpingProbeLoop&);
+
+    uint64_t StartPhase() const { return profile_ ? profile_->Start() : 0; }
+    void StopPhase(MpingProfile::Phase phase, uint64_t start) {
+      if (profile_)
+        profile_->Stop(phase, start);
+    }
+
+    MpingTransport *transport_;
+    MpingStat *stat_;
+    MpingProbeHooks *hooks_;
+    MpingProfile *profile_;
+    int max_open_;  // probes sent at once to fill the window
+    int burst_;
+    bool start_burst_;  // the window has filled, -B from now on
+    uint64_t sseq_;
+};
+
+#endif  // _MP_PROBE_LOOP_H_
@@ -0,0 +1,82 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef _MP_PROFILE_H_
+#define _MP_PROFILE_H_
+
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define MP_PROFILE_TSC
+#endif
+
+#include "mp_clock.h"
+
+// Where the probe loop spends its time (-X).  Each phase of the loops of
+// MPing::GoProbing and MPing::RunServer is timed in CPU cycles (ns where
+// there is no TSC) into a log2 histogram; Print reports them at the end
+// of the run.  Always built in: while disabled, Start and Stop are a
+// test of a flag.
+//
+//   send     the send syscall (queueing it, with -U)
+//   receive  waiting for a reply and the recv syscall, parse included
+//   parse    telling our replies from the rest and reading the payload
+//   stats    MpingStat and the other per packet bookkeeping
+//   print    the per second output, at the end of each interval
+class MpingProfile {
+  public:
+    enum Phase { kSend, kReceive, kParse, kStats, kPrint, kPhases };
+    static const int kBuckets = 48;  // 2^47 cycles is over 10 hours
+
+    MpingProfile();
+
+    void Enable(bool on) { enabled_ = on; }
+    bool enabled() const { return enabled_; }
+
+    // A phase starts with the value of Start and ends with Stop.
+    uint64_t Start() const { return enabled_ ? Now() : 0; }
+    void Stop(Phase phase, uint64_t start) {
+      if (enabled_)
+        Add(phase, Now() - start);
+    }
+
+    void Add(Phase phase, uint64_t cycles);
+
+    uint64_t count(Phase phase) const { return count_[phase]; }
+
+    // Upper bound of the bucket holding the |q| quantile, 0 < q <= 1.
+    uint64_t Percentile(Phase phase, double q) const;
+
+    void Print() const;
+
+    static uint64_t Now() {
+#if defined(MP_PROFILE_TSC)
+      return __rdtsc();
+#else
+      return MpingClock::NowNs();
+#endif
+    }
+    static const char* Unit();
+
+  private:
+    bool enabled_;
+    uint64_t count_[kPhases];
+    uint64_t total_[kPhases];
+    uint64_t max_[kPhases];
+    uint64_t buckets_[kPhases][kBuckets];  // [2^(i-1), 2^i), 0 in bucket 0
+};
+
+#endif  // _MP_PROFILE_H_
@@ -0,0 +1,70 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MP_QUEUE_H_
+#define _MP_QUEUE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+
+// Bottleneck queue estimate, once per interval.  The base RTT is the
+// smallest RTT of the last kBaseIntervals intervals, so a route change
+// ages out.  By Little's law the standing queue is the delivered rate
+// times the queueing delay:
+//   queue ms = mean rtt - base rtt,  queue pkts = rate * queue ms
+// A drop-tail buffer overflows when it is full, so the largest queue seen
+// in an interval that lost packets is taken as the buffer size; without
+// loss it is only known to be larger than any queue seen.  The capacity is
+// the plateau of the delivered rate, the best interval so far.
+class MpingQueueEst {
+  public:
+    MpingQueueEst();
+
+    // A first copy of a |size| byte probe came back after |rtt| ms.
+    void OnRecv(double rtt, size_t size);
+    // Closes an interval of |seconds| in which |lost| probes were charged
+    // as lost.
+    void OnTick(double seconds, unsigned int lost);
+
+    double base_rtt() const { return base_rtt_; }  // ms, < 0 before a reply
+    double queue_ms() const { return queue_ms_; }  // last interval
+    double queue_pkts() const { return queue_pkts_; }
+    double queue_bytes() const { return queue_pkts_ * mean_size_; }
+    double capacity() const { return capacity_; }  // pkt/s
+    double buffer_pkts() const { return buffer_pkts_; }  // < 0 if no loss
+    double max_queue_pkts() const { return max_queue_pkts_; }
+
+    void PrintTempStats() const;
+    void PrintStats() const;
+
+  private:
+    static const size_t kBaseIntervals = 60;
+
+    std::deque<double> min_rtts_;  // per closed interval, -1 if no reply
+    double base_rtt_;
+    double queue_ms_;
+    double queue_pkts_;
+    double mean_size_;  // bytes, over all replies
+    double capacity_;
+    double buffer_pkts_;
+    double max_queue_pkts_;
+    uint64_t replies_;
+
+    unsigned int recv_temp_;
+    double rtt_sum_temp_;
+    double min_rtt_temp_;
+};
+
+#endif  // _MP_QUEUE_H_
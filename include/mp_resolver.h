@@ -0,0 +1,107 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef _MP_RESOLVER_H_
+#define _MP_RESOLVER_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// Turns a host name into addresses, blocking.  Returns 0 or an EAI_* code.
+class MpingLookup {
+  public:
+    virtual ~MpingLookup() {}
+    virtual int Lookup(const std::string& host,
+                       std::set<std::string> *ips) = 0;
+};
+
+// getaddrinfo, so /etc/hosts and the system resolver.
+class MpingSystemLookup : public MpingLookup {
+  public:
+    virtual int Lookup(const std::string& host, std::set<std::string> *ips);
+};
+
+// Resolves many host names at once on a few threads, so a long target
+// list does not wait on one lookup after the other, and hands each back
+// as soon as it is done.  Results are cached for |ttl| seconds, failures
+// for |negative_ttl|; getaddrinfo does not tell the record's own TTL.
+// Numeric addresses and cache hits are done at once, without a thread.
+class MpingResolver {
+  public:
+    struct Result {
+      std::string host;
+      std::set<std::string> ips;  // empty on failure
+      int error;  // 0 or EAI_*
+    };
+
+    // |lookup| is not owned, NULL for MpingSystemLookup.
+    MpingResolver(int threads, double ttl, double negative_ttl,
+                  MpingLookup *lookup);
+    ~MpingResolver();  // waits for the lookups running
+
+    // Opens the result pipe and starts the threads, before anything else.
+    // Returns -1 with the reason in |error| if it cannot; fewer threads
+    // than asked for only warn.
+    int Init(std::string *error);
+
+    // Starts resolving |host|; one that is already being resolved gives
+    // one result for all.
+    void Resolve(const std::string& host);
+
+    // Moves the results done so far to |results|, never blocks.
+    void Take(std::vector<Result> *results);
+
+    // Readable while results are waiting for Take.
+    int fd() const { return pipe_[0]; }
+    // Hosts asked for and not taken yet.
+    size_t pending() const;
+
+  private:
+    MpingResolver(const MpingResolver&);
+    MpingResolver& operator = (const MpingResolver&);
+
+    struct Entry {
+      std::set<std::string> ips;
+      int error;
+      uint64_t expires;  // ns
+    };
+
+    static void* Worker(void *self);
+    void Work();
+    void Done(const Result& r);  // with mu_ held
+
+    MpingLookup *lookup_;
+    MpingSystemLookup system_;
+    uint64_t ttl_;  // ns
+    uint64_t negative_ttl_;
+    int num_threads_;
+    std::vector<pthread_t> threads_;
+    int pipe_[2];
+
+    mutable pthread_mutex_t mu_;
+    pthread_cond_t wake_;
+    bool quit_;
+    std::deque<std::string> todo_;
+    std::set<std::string> busy_;  // queued or being looked up
+    std::vector<Result> done_;
+    std::map<std::string, Entry> cache_;
+};
+
+#endif  // _MP_RESOLVER_H_
@@ -0,0 +1,103 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MP_SEARCH_H_
+#define _MP_SEARCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Knee search (-K) for one packet size.  Instead of one second per window
+// value, each window is measured for a few RTT rounds, until the 95%
+// confidence interval of the delivered rate is within a few percent.
+// The window is doubled until the rate stops growing, then bisected down
+// to the smallest window that gets the plateau rate: the knee, about the
+// bandwidth delay product.  The same is done above the knee for the
+// smallest window that loses packets; the difference is the buffer.
+class MpingKneeSearch {
+  public:
+    // |sseq| is the last sequence sent before the search takes over.
+    MpingKneeSearch(int max_window, size_t packet_size, uint64_t sseq);
+
+    // A first copy of |seq| came back after |rtt| ms at |now| ns; |sseq|
+    // is the last sequence sent.
+    void OnRecv(uint64_t seq, double rtt, uint64_t now, uint64_t sseq);
+    // Once per second, cuts measurements that never converge.
+    void OnTick(uint64_t sseq);
+
+    int window() const { return window_; }
+    bool done() const { return phase_ == kDone; }
+
+    int knee() const { return knee_; }  // 0 if the rate never levels off
+    double capacity() const { return capacity_; }  // pkt/s
+    int buffer() const { return buffer_; }  // pkts, -1 if no loss seen
+    double base_rtt() const { return base_rtt_; }
+
+    void PrintResult() const;
+
+  private:
+    enum Phase { kBracketKnee, kBisectKnee, kBracketLoss, kBisectLoss, kDone };
+
+    struct Measurement {
+      int window;
+      double rate;  // delivered pkt/s, mean over rounds
+      double half_width;  // of its 95% confidence interval
+      double rtt;  // mean, ms
+      double delivered;  // fraction of probes that came back
+      unsigned int probes;  // probes delivered is taken over
+    };
+
+    void Start(int window, uint64_t sseq);
+    void Finish(uint64_t sseq);
+    void Next(const Measurement& m);
+    void EndKnee();
+    void EndLoss();
+    bool Saturated(const Measurement& m) const;
+    bool Lossy(const Measurement& m) const;
+    bool Narrow() const;
+
+    int max_window_;
+    size_t packet_size_;
+    Phase phase_;
+    int window_;
+    int lo_, hi_;
+    std::vector<Measurement> done_;
+
+    // current measurement
+    uint64_t start_seq_;
+    uint64_t loss_start_;
+    uint64_t round_end_;
+    uint64_t round_start_;
+    bool in_round_;
+    int warmup_;
+    int ticks_;
+    unsigned int round_recv_;
+    unsigned int recv_;
+    uint64_t max_seq_;
+    int n_;
+    double mean_, m2_;  // Welford
+    double rtt_sum_;
+    unsigned int rtt_num_;
+
+    int knee_;
+    double capacity_;
+    int buffer_;
+    double base_rtt_;
+    double base_probes_;  // pooled over windows without loss onset
+    double base_lost_;
+    uint64_t first_, last_;
+};
+
+#endif  // _MP_SEARCH_H_
@@ -0,0 +1,125 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef _MP_SESSION_H_
+#define _MP_SESSION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "mp_config.h"
+#include "mp_shm.h"
+
+class MpingProbeLoop;
+class MpingSocket;
+class MpingStat;
+class MpingTransport;
+class MpingWindowCtl;
+
+// Gets the counters of a MpingSession as it runs.
+class MpingSessionListener {
+  public:
+    virtual ~MpingSessionListener() {}
+
+    // Every second: the interval that just ended is in the *_temp fields
+    // of |stats|, probed with |window| packets of |size| bytes in flight.
+    virtual void OnInterval(const MpingShmStats& stats, int window,
+                            size_t size) = 0;
+    // Once, when the run is over or stopped, with the totals.
+    virtual void OnDone(const MpingShmStats& stats) = 0;
+};
+
+// A probe run for programs embedding mping, e.g. to schedule many of them
+// in one event loop.  It prints nothing, never exits, and only blocks as
+// long as Poll is told to: the caller polls fd() for replies and calls
+// Poll when it is readable or next_wakeup() has come.
+//
+// It runs the window and size loops of mping against one address, on
+// the MpingProbeLoop the tool uses as well: with -f the window is held
+// (or, with -Q, steered) until Stop, without it the window steps from 1
+// to -n, one second each.  With -b -<sel> that goes for each size in
+// turn, -f holding each for one second.  Once through, one more second
+// collects the replies still in flight.  The TTL sweep and the searches
+// (-a, -H, -I, -K) and -M stay with the mping tool; Start turns them
+// down.
+class MpingSession {
+  public:
+    MpingSession();
+    ~MpingSession();
+
+    // Probe through |t| instead of opening sockets.  Not owned, call
+    // before Start.
+    void SetTransport(MpingTransport *t) { transport_ = t; }
+    // Not owned, NULL for none.
+    void SetListener(MpingSessionListener *l) { listener_ = l; }
+
+    // Returns -1 with the reason in |error| if |config| asks for what
+    // only the mping tool does, see above.
+    static int Check(const MpingConfig& config, std::string *error);
+
+    // Validates |config| and opens the probe to config.dst_host, which
+    // must be an IP address: a host name would block on DNS, resolve it
+    // beforehand, e.g. with MpingResolver as MpingCampaign does.  A
+    // session runs once.  Returns -1 with the reason in |error|.
+    int Start(const MpingConfig& config, std::string *error);
+
+    // Sends and receives what is due, waiting up to |wait_ns| for the
+    // first reply, then taking only what is already there.  Returns 1
+    // while the run goes on, 0 once it is over, -1 on a send or receive
+    // failure, see error().
+    int Poll(uint64_t wait_ns);
+
+    // Ends the run early, the listener still gets OnDone.
+    void Stop();
+
+    bool running() const { return state_ == kRunning; }
+    // When Poll has work to do even without a reply, on the transport's
+    // NowNs() clock.
+    uint64_t next_wakeup() const;
+    // Where replies arrive, -1 with a transport set.
+    int fd() const;
+    const std::string& error() const { return error_; }
+
+  private:
+    enum State { kIdle, kRunning, kDone, kFailed };
+
+    MpingSession(const MpingSession&);
+    MpingSession& operator = (const MpingSession&);
+
+    int Fail(const std::string& what, int err);
+    int Send();
+    void OnReply(uint64_t seq, double rtt);
+    void EndInterval(uint64_t now);
+    void Finish();
+    void Fill(MpingShmStats *stats, uint64_t now) const;
+
+    MpingConfig config_;
+    MpingTransport *transport_;
+    MpingSessionListener *listener_;
+    MpingSocket *socket_;  // owned, NULL with a transport set
+    MpingStat *stat_;  // owned
+    MpingProbeLoop *loop_;  // owned
+    MpingWindowCtl *winctl_;  // owned, -Q only
+    State state_;
+    std::string error_;
+    std::vector<size_t> sizes_;  // -b, or each of -b -<sel>
+    size_t size_ix_;
+    int window_;  // 0 collects the trailing replies
+    uint64_t tick_;  // end of the current interval, ns
+};
+
+#endif  // _MP_SESSION_H_
@@ -0,0 +1,99 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MP_SHM_H_
+#define _MP_SHM_H_
+
+#include <stdint.h>
+#include <string>
+
+// Live counters in a POSIX shared memory segment (-M <name>), for
+// monitors that would otherwise tail stdout.  The probe rewrites the
+// segment in place after every reply and interval; a seqlock lets any
+// number of readers take consistent snapshots at any rate without the
+// probe making a syscall or waiting for them.
+//
+// Layout is versioned: readers check |magic| and |version|, fields are
+// only ever appended, and every field is 8 bytes so the segment can be
+// copied a word at a time with atomic loads and stores.
+const uint32_t kMpingShmMagic = 0x474e504d;  // "MPNG" little endian
+const uint32_t kMpingShmVersion = 1;
+
+struct MpingShmStats {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t seq;  // seqlock, odd while the probe is writing
+  uint64_t pid;
+  uint64_t updated_ns;  // probe's clock, see MpingClock
+  uint64_t interval;  // intervals printed so far
+
+  // running totals, as in the "Total" line
+  uint64_t sent;
+  uint64_t received;  // first copies
+  uint64_t total_received;
+  uint64_t out_of_order;
+  uint64_t lost;
+  uint64_t dup;
+  uint64_t unexpected;
+  uint64_t late;
+
+  // the interval in progress, as in the "Sent ... " line
+  uint64_t sent_temp;
+  uint64_t received_temp;
+  uint64_t total_received_temp;
+  uint64_t out_of_order_temp;
+  uint64_t lost_temp;
+  uint64_t dup_temp;
+  uint64_t unexpected_temp;
+  uint64_t late_temp;
+  uint64_t lost_earlier_temp;
+
+  uint64_t in_flight;
+  double srtt;  // ms, < 0 before the first reply
+  double rttvar;
+  double min_rtt;
+  double last_rtt;
+  double loss_timeout;
+};
+
+// The probe's side.  Creates the segment, unlinks it when destroyed.
+class MpingShmWriter {
+  public:
+    MpingShmWriter();
+    ~MpingShmWriter();
+
+    // |name| as for shm_open, e.g. "/mping".  Returns -1 on failure.
+    int Open(const std::string& name);
+
+    // Copies |snapshot| into the segment; its magic, version and seq are
+    // ignored.
+    void Publish(const MpingShmStats& snapshot);
+
+  private:
+    MpingShmWriter(const MpingShmWriter&);
+    MpingShmWriter& operator = (const MpingShmWriter&);
+
+    std::string name_;
+    MpingShmStats *shared_;
+};
+
+// Maps segment |name| read only, NULL on failure.  It stays mapped.
+const MpingShmStats* MpingShmOpenReader(const std::string& name);
+
+// Copies a consistent snapshot of |shared| to |out|, retrying while the
+// probe is in the middle of an update.  Returns false if |shared| is not
+// an mping segment, or is older than this code.
+bool MpingShmRead(const MpingShmStats *shared, MpingShmStats *out);
+
+#endif  // _MP_SHM_H_
@@ -0,0 +1,125 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MP_SIM_TRANSPORT_H_
+#define _MP_SIM_TRANSPORT_H_
+
+#include <stdint.h>
+#include <functional>
+#include <queue>
+#include <vector>
+
+#include "mp_transport.h"
+
+// Path model for MpingSimTransport.  All probes go through one FIFO
+// bottleneck of |rate_bps| with a |buffer_bytes| drop-tail queue, then see
+// |delay_us| of propagation delay each way.  With |hops| set, the
+// destination is that many hops away and a probe whose TTL runs out
+// before is answered by router n at 10.255.0.n, after n / |hops| of the
+// delay and without going through the bottleneck, which is the last hop.
+struct MpingSimConfig {
+  MpingSimConfig()
+      : rate_bps(100000000),
+        buffer_bytes(64 * 1500),
+        delay_us(10000),
+        loss(0.0),
+        reorder(0.0),
+        reorder_delay_us(1000),
+        seed(1),
+        start_sec(1000000000),
+        hops(0) { }
+
+  uint64_t rate_bps;          // bottleneck rate, bits per second
+  size_t buffer_bytes;        // bottleneck queue limit
+  uint64_t delay_us;          // one-way propagation delay
+  double loss;                // random loss probability, [0, 1]
+  double reorder;             // probability a reply is held back
+  uint64_t reorder_delay_us;  // how long a reordered reply is held back
+  uint32_t seed;              // loss/reorder PRNG seed
+  uint64_t start_sec;         // virtual clock at creation, must be > 0
+  int hops;                   // path length, 0 ignores the TTL
+};
+
+// Deterministic in-memory transport.  Nothing is sent on the network and
+// the clock only moves when the prober waits for a reply or for a tick, so
+// a simulated second costs only the CPU time to process its packets.
+class MpingSimTransport : public MpingTransport {
+  public:
+    explicit MpingSimTransport(const MpingSimConfig& config);
+    virtual ~MpingSimTransport() { }
+
+    virtual int Initialize(const std::string& destip, const std::string& srcip,
+                           int ttl, size_t pktsize, int wndsize,
+                           uint16_t port, bool clientmode);
+
+    virtual bool SetSendTTL(const int& ttl) { ttl_ = ttl; return true; }
+    virtual bool SendPacket(const uint64_t& seq, size_t size, int *error);
+    virtual uint64_t ReceiveAndGetSeq(int* error, MpingStat *mpstat,
+                                      uint64_t *send_time);
+    virtual const std::string GetFromAddress() const { return from_; }
+
+    virtual uint64_t NowNs() { return now_ns_; }
+    virtual void WaitUntil(uint64_t deadline);
+    virtual void ArmRecvTimeout(unsigned int seconds);
+    virtual void SetRecvDeadline(uint64_t deadline) {
+      wake_ns_ = deadline;
+    }
+
+    uint64_t now_ns() const { return now_ns_; }
+    uint64_t sent() const { return sent_; }
+    uint64_t delivered() const { return delivered_; }
+    uint64_t queue_drops() const { return queue_drops_; }
+    uint64_t random_drops() const { return random_drops_; }
+    uint64_t reordered() const { return reordered_; }
+    size_t max_queue_bytes() const { return max_queue_bytes_; }
+
+  private:
+    MpingSimTransport(const MpingSimTransport&);
+    MpingSimTransport& operator = (const MpingSimTransport&);
+
+    double Uniform();
+
+    struct Reply {
+      uint64_t arrival;  // back at the sender, ns
+      uint64_t seq;
+      uint64_t send_time;
+      int hop;  // router that answered, 0 for the destination
+
+      bool operator > (const Reply& other) const {
+        return arrival != other.arrival ? arrival > other.arrival :
+                                          seq > other.seq;
+      }
+    };
+
+    MpingSimConfig config_;
+    std::string destip_;
+    std::string from_;  // of the last reply
+    int ttl_;
+    uint64_t now_ns_;
+    uint64_t link_free_ns_;  // when the bottleneck finishes its backlog
+    uint64_t recv_deadline_ns_;
+    uint64_t wake_ns_;  // SetRecvDeadline, 0 if none
+    uint64_t rng_;
+    std::priority_queue<Reply, std::vector<Reply>,
+                        std::greater<Reply> > in_flight_;
+
+    uint64_t sent_;
+    uint64_t delivered_;
+    uint64_t queue_drops_;
+    uint64_t random_drops_;
+    uint64_t reordered_;
+    size_t max_queue_bytes_;
+};
+
+#endif  // _MP_SIM_TRANSPORT_H_
@@ -15,13 +15,20 @@
 #ifndef _MP_SOCKET_H_
 #define _MP_SOCKET_H_
 
+#include <vector>
+
 #include "mlab/client_socket.h"
 #include "mlab/socket_family.h"
 #include "mlab/raw_socket.h"
+#include "mp_busy_poll.h"
+#include "mp_probe_layout.h"
+#include "mp_profile.h"
 #include "mp_stats.h"
+#include "mp_transport.h"
+#include "mp_uring.h"
 #include "log.h"
 
-class MpingSocket {
+class MpingSocket : public MpingTransport {
   public:
     MpingSocket() :
       icmp_sock(NULL),
@@ -29,20 +36,78 @@ class MpingSocket {
       family_(SOCKETFAMILY_UNSPEC),
       buffer_length_(0),
       use_udp_(false),
-      client_mode_(false) {
+      client_mode_(false),
+      legacy_seq_(false),
+      flows_(1),
+      flow_addr_len_(0),
+      nonce_(0),
+      last_sent_(0),
+      payload_length_(0),
+      busy_poll_(NULL),
+      use_uring_(false),
+      uring_(NULL),
+      recv_deadline_(0),
+      profile_(NULL),
+      track_drops_(false),
+      drops_base_(0),
+      rxq_drops_(0),
+      send_(NULL),
+      receive_(NULL) {
         memset(&srcaddr_, 0, sizeof(srcaddr_));
         memset(buffer_, 0, sizeof(buffer_));
       }
 
-    int Initialize(const std::string& destip, const std::string& srcip,
-                   int ttl, size_t pktsize, int wndsize,
-                   uint16_t port, bool clientmode);
-    ~MpingSocket();
+    // Returns -1 if |destip| is not an IP address, |pktsize| cannot hold
+    // the headers and payload, or the sockets cannot be set up.  Called
+    // again, keeps the sockets if the family, ICMP or UDP, client mode and
+    // source are the same, and only points them at |destip|.
+    virtual int Initialize(const std::string& destip, const std::string& srcip,
+                           int ttl, size_t pktsize, int wndsize,
+                           uint16_t port, bool clientmode);
+    virtual ~MpingSocket();
+
+    virtual bool SetSendTTL(const int& ttl);
+    // EINVAL in |error| for a |size| that cannot hold the probe.
+    virtual bool SendPacket(const uint64_t& seq, size_t size, int *error);
+    virtual uint64_t ReceiveAndGetSeq(int* error, MpingStat *mpstat,
+                                      uint64_t *send_time);
+    virtual const std::string GetFromAddress() const;
+
+    virtual uint64_t NowNs();
+    virtual void WaitUntil(uint64_t deadline);
+    virtual void ArmRecvTimeout(unsigned int seconds);
+    virtual void SetRecvDeadline(uint64_t deadline) {
+      recv_deadline_ = deadline;
+    }
+    virtual bool TakeLocalDrops(uint64_t *drops);
+
+    // Spin up to |budget_us| for each reply before blocking, see
+    // MpingBusyPoll.  Call before Initialize.  0 turns it off.
+    void SetBusyPoll(unsigned int budget_us);
+    MpingBusyPoll* busy_poll() { return busy_poll_; }
+
+    // Send and receive through io_uring, see MpingUring, where the kernel
+    // has it.  Call before Initialize.
+    void SetUring(bool on) { use_uring_ = on; }
+    bool uring() const { return uring_ != NULL; }
+
+    // The descriptor to poll for replies, -1 before Initialize: the
+    // socket they arrive on, or with io_uring the ring.
+    int recv_fd() const;
 
-    bool SetSendTTL(const int& ttl);
-    bool SendPacket(const unsigned int& seq, size_t size, int *error) const;
-    unsigned int ReceiveAndGetSeq(int* error, MpingStat *mpstat);
-    const std::string GetFromAddress() const;
+    // Use the old "mlab-seq#" payload with a 32 bit sequence and no
+    // session nonce (see mp_payload.h).  Call before Initialize.
+    void SetLegacySeq(bool legacy) { legacy_seq_ = legacy; }
+
+    // Spread probes over |flows| flows, probe |seq| on flow
+    // (seq - 1) % flows, see MpingFlowSpread: ICMP echoes carry the flow
+    // as identifier, which also changes their checksum, UDP probes go to
+    // the destination port plus the flow.  Call before Initialize.
+    void SetFlows(int flows) { flows_ = flows; }
+
+    // Times the parse phase of each receive into |profile|, see
+    // MpingProfile.  NULL, the default, does not.
+    void SetProfile(MpingProfile *profile) { profile_ = profile; }
 
   protected:
     mlab::RawSocket *icmp_sock;
@@ -52,13 +117,51 @@ class MpingSocket {
     MpingSocket(const MpingSocket& other);
     MpingSocket& operator = (const MpingSocket&);
 
+    int Retarget(const std::string& destip, size_t pktsize, int wndsize,
+                 uint16_t port);
+    // Where the UDP probes of each flow go, for -E.
+    void SetFlowAddresses(const std::string& destip, uint16_t port);
+
+    // SendPacket and ReceiveAndGetSeq for one family and mode, with the
+    // header offsets as constants, see mp_probe_layout.h.  SelectPaths
+    // picks them once the sockets are set up, so a packet does not
+    // branch on the family or the mode.
+    template <SocketFamily F, MpingProbeMode M>
+    bool SendAs(const uint64_t& seq, size_t size, int *error);
+    template <SocketFamily F, MpingProbeMode M>
+    uint64_t ReceiveAs(int* error, MpingStat *mpstat, uint64_t *send_time);
+    void SelectPaths();
+
+    // Sizes the receive buffer to |bytes| and starts counting its drops
+    // from here, see mp_local_drops.h.
+    void SetupRecvQueue(size_t bytes);
+
     SocketFamily family_;
     sockaddr_storage srcaddr_;
     char buffer_[64];
     int buffer_length_;
     bool use_udp_;
     bool client_mode_;
+    bool legacy_seq_;
+    int flows_;
+    std::vector<sockaddr_storage> flow_addrs_;  // UDP with flows_ > 1
+    socklen_t flow_addr_len_;
+    uint32_t nonce_;
+    uint64_t last_sent_;
+    size_t payload_length_;
     std::string fromaddr_;
+    std::string src_ip_;  // as given to Initialize
+    MpingBusyPoll *busy_poll_;
+    bool use_uring_;
+    MpingUring *uring_;
+    uint64_t recv_deadline_;
+    MpingProfile *profile_;
+    bool track_drops_;  // the kernel tells us about local drops
+    uint32_t drops_base_;  // drop counter at the last TakeLocalDrops
+    uint32_t rxq_drops_;  // drop counter as of the last reply
+    bool (MpingSocket::*send_)(const uint64_t& seq, size_t size, int *error);
+    uint64_t (MpingSocket::*receive_)(int* error, MpingStat *mpstat,
+                                      uint64_t *send_time);
 };
 
 #endif
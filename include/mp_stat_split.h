@@ -0,0 +1,61 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef _MP_STAT_SPLIT_H_
+#define _MP_STAT_SPLIT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class MpingStat;
+
+// Probes split into |classes| by sequence: probe |seq| is in class
+// (seq - 1) % classes, and each class keeps its own MpingStat over its own
+// sequence, (seq - 1) / classes + 1, holding its share of the window.
+// Loss, reordering and timeouts are then tracked per class as if it ran
+// alone.  MpingSizeSweep (a size per class) and MpingFlowSpread (a flow
+// per class) build on it.
+class MpingStatSplit {
+  public:
+    MpingStatSplit(int classes, int win_size, bool keep_send_times,
+                   double loss_timeout);
+    ~MpingStatSplit();
+
+    int ClassFor(uint64_t seq) const { return (seq - 1) % stats_.size(); }
+    size_t classes() const { return stats_.size(); }
+
+    void EnqueueSend(uint64_t seq, uint64_t time);
+    void EnqueueRecv(uint64_t seq, uint64_t time, uint64_t send_time);
+    void Expire(uint64_t now);
+
+  protected:
+    const MpingStat& stat(size_t i) const { return *stats_[i]; }
+
+    // One line per class, "<labels[i]>: " then MpingStat's.
+    void PrintTemp(const std::vector<std::string>& labels);
+    void Print(const std::vector<std::string>& labels);
+
+  private:
+    MpingStatSplit(const MpingStatSplit&);
+    MpingStatSplit& operator = (const MpingStatSplit&);
+
+    MpingStat* StatFor(uint64_t seq, uint64_t *sub) const;
+
+    std::vector<MpingStat*> stats_;  // owned, one per class
+};
+
+#endif  // _MP_STAT_SPLIT_H_
@@ -15,67 +15,143 @@
 #ifndef _MPING_STATS_H_
 #define _MPING_STATS_H_
 
+#include <stdint.h>
 #include <vector>
-#include <time.h>
 
-struct SendQueueNode {
-  unsigned int seq;
-  struct timeval send_time;
-  struct timeval recv_time;
-//  unsigned int num_pkt_in_net;  // number of packet in flight when sent
-};
+#include "mp_timer_wheel.h"
+
+struct MpingShmStats;
 
+// Per run counters, printed every interval and at the end.
+//
+// A probe is declared lost once it has been out longer than the loss
+// timeout: fixed (-T), or srtt + max(4 * rttvar, srtt / 2) of the replies
+// so far.  The timeouts run on a timing wheel and the loss is charged to
+// the interval the probe was sent in; losses of intervals already printed
+// show up as "lost-earlier" on the next line.
+//
+// Which sequences came back or were declared lost is kept in sliding
+// bitmaps, one bit per packet over the last 4 * window sequences sent
+// (rounded up to 64).  What slides out unresolved is charged as lost, to
+// the interval it was sent in as well.  A reply for a lost probe is
+// counted late, one whose bit is set is a duplicate.  Send times are only
+// kept, in a ring of the same length, when replies do not carry their own
+// (-L).
+//
+// For the send window, a probe stops being in flight once it is answered,
+// times out, or trails the highest sequence answered by more than the
+// reorder threshold (3 by default).  The last one only gives its window
+// credit back, it is charged as lost on timeout like any other.
+//
+// Packets dropped from our own receive queue (OnLocalDrops) are counted
+// apart as "local-drops".  Their replies are still charged as lost, as
+// the socket may drop other traffic as well; PrintStats warns when there
+// are both.
 class MpingStat {
   public:
-    MpingStat(const int& win_size) : 
-      unexpect_num_(0),
-      unexpect_num_temp_(0),
-      max_recv_seq_(1),
-      out_of_order_(0),
-      out_of_order_temp_(0),
-      recv_num_(0),
-      recv_num_temp_(0),
-      recv_unique_num_(0),
-      recv_unique_num_temp_(0),
-      send_num_(0),
-      send_num_temp_(0),
-      duplicate_num_(0),
-      duplicate_num_temp_(0),
-      lost_num_(0),
-      lost_num_temp_(0),
-      window_size_(win_size),
-      send_queue_size_(4 * win_size) { 
-      send_queue.reserve(sizeof(SendQueueNode) * 4 * window_size_);
-    }
+    MpingStat(const int& win_size, bool keep_send_times = false);
+
+    // Loss timeout in ms, 0 (the default) follows the RTT.
+    void SetLossTimeout(double ms) { timeout_ms_ = ms; }
+    double loss_timeout() const;  // ms, currently in use
+
+    // Declares the probes timed out by |now| lost.  Sends and receives do
+    // it as well.
+    void Expire(uint64_t now);
 
-    void EnqueueSend(unsigned int seq, struct timeval time);
-    void EnqueueRecv(unsigned int seq, struct timeval time); 
+    void EnqueueSend(uint64_t seq, uint64_t time);
+    // Returns the RTT in ms for the first copy of a sent packet, or a
+    // negative value for duplicates and unknown sequences.  |send_time| is
+    // the send time carried in the reply, 0 if none; with it late replies
+    // below the bitmap still get an RTT.
+    double EnqueueRecv(uint64_t seq, uint64_t time, uint64_t send_time);
     void LogUnexpected();
+    // |n| packets dropped in the local receive queue, see
+    // MpingTransport::TakeLocalDrops.  Until called the output has no
+    // local drop counts.
+    void OnLocalDrops(uint64_t n);
+    uint64_t local_drops() const { return local_drops_; }
+
+    // 0 leaves lost probes holding credit until they time out, for probes
+    // that are reordered by design (all TTLs at once).
+    void SetReorderThreshold(uint64_t n) { reorder_threshold_ = n; }
+
+    // Probes sent that hold window credit, see above.
+    uint64_t in_flight() const { return in_flight_; }
+    // Losses charged since the last PrintTempStats, to any interval.
+    unsigned int lost_temp() const {
+      return lost_num_temp_ + lost_earlier_temp_;
+    }
+
+    // When the next probe times out, in ns, 0 if none is pending.
+    uint64_t next_timeout() const { return wheel_.NextExpiry(); }
+
+    // Fills the counters and RTT fields of |out| (see mp_shm.h).
+    void Snapshot(MpingShmStats *out) const;
+
+    // Charges what is still unresolved at the end of the run as lost.
+    // Once, before the totals are read; PrintStats does it.
+    void Finish();
+    // Starts the next interval, PrintTempStats does it after printing.
+    void EndInterval();
 
     void PrintStats();
     void PrintTempStats();
     void PrintTimeLine() const;
 
   protected:
-    unsigned int unexpect_num_;
+    // Slides the bitmap so that |seq| is in it, charging what slides out.
+    void Advance(uint64_t seq);
+    // Marks the unresolved probes of |run| lost.
+    void ChargeLost(const MpingTimerWheel::Run& run);
+    // Gives back the credit of the probes first..last not released yet,
+    // returns how many were.
+    unsigned int Release(uint64_t first, uint64_t last);
+    void SampleRtt(double rtt);
+
+    uint64_t unexpect_num_;
     unsigned int unexpect_num_temp_;
-    unsigned int max_recv_seq_;
-    unsigned int out_of_order_;
+    uint64_t max_recv_seq_;
+    uint64_t out_of_order_;
     unsigned int out_of_order_temp_;
-    unsigned int recv_num_;
+    uint64_t recv_num_;
     unsigned int recv_num_temp_;
-    unsigned int recv_unique_num_;
+    uint64_t recv_unique_num_;
     unsigned int recv_unique_num_temp_;
-    unsigned int send_num_;
+    uint64_t send_num_;
     unsigned int send_num_temp_;
-    unsigned int duplicate_num_;
+    uint64_t duplicate_num_;
     unsigned int duplicate_num_temp_;
-    unsigned int lost_num_;
+    uint64_t lost_num_;
     unsigned int lost_num_temp_;
+    uint64_t late_num_;
+    unsigned int late_num_temp_;
+    unsigned int lost_earlier_temp_;
+    bool track_local_drops_;
+    uint64_t local_drops_;
+    uint64_t local_drops_temp_;
     int window_size_;
-    unsigned int send_queue_size_;
-    std::vector<struct SendQueueNode> send_queue;
-    std::vector<int> timeline;
+
+    double timeout_ms_;
+    double srtt_;  // ms, < 0 before the first reply
+    double rttvar_;
+    double min_rtt_;  // ms, < 0 before the first reply
+    double last_rtt_;
+    unsigned int interval_;  // EndInterval calls so far
+    uint64_t interval_first_seq_;  // first sequence sent in interval_
+    MpingTimerWheel wheel_;
+    std::vector<MpingTimerWheel::Run> expired_;
+
+    uint64_t in_flight_;
+    uint64_t reorder_threshold_;
+    uint64_t reorder_seq_;  // credit released by the gap rule up to here
+    uint64_t max_sent_seq_;
+    uint64_t base_word_;  // (seq - 1) / 64 of the oldest word in the bitmap
+    std::vector<uint64_t> recv_bitmap_;  // word w at recv_bitmap_[w % size]
+    std::vector<uint64_t> lost_bitmap_;  // declared lost, same layout
+    std::vector<uint64_t> released_bitmap_;  // no longer in flight
+    std::vector<uint64_t> send_times_;  // empty unless keep_send_times
+    std::vector<int64_t> timeline;  // +seq sent, -seq received
 };
 
 #endif
@@ -0,0 +1,54 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MP_SWEEP_H_
+#define _MP_SWEEP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "mp_stat_split.h"
+
+// Size |ix| of the -b -<sel> sweep, 0 past the last one: -1 the selected
+// sizes, -2, -3, -4 steps of 64, 128 and 256 bytes.
+size_t MpingSweepSize(int sel, int ix);
+
+// Interleaved message size sweep (-b -<sel> with -I).  Instead of one
+// size after the other, probes cycle through all sizes within the window,
+// so every size sees the same path conditions at the same time.
+//
+// Each size is a class of MpingStatSplit: the size of a probe follows
+// from its sequence, and loss, reordering and timeouts are tracked per
+// size as if it ran alone.
+class MpingSizeSweep : public MpingStatSplit {
+  public:
+    MpingSizeSweep(const std::vector<size_t>& sizes, int win_size,
+                   bool keep_send_times, double loss_timeout);
+
+    size_t SizeFor(uint64_t seq) const { return sizes_[ClassFor(seq)]; }
+    size_t max_size() const { return max_size_; }
+
+    // One line per size, each as MpingStat's.
+    void PrintTempStats() { PrintTemp(labels_); }
+    void PrintStats() { Print(labels_); }
+
+  private:
+    std::vector<size_t> sizes_;
+    size_t max_size_;
+    std::vector<std::string> labels_;  // "Size <n>"
+};
+
+#endif  // _MP_SWEEP_H_
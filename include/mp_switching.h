@@ -0,0 +1,85 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MP_SWITCHING_H_
+#define _MP_SWITCHING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+
+// Least squares fit of y = intercept + slope * x, updated one sample at a
+// time (Welford style, so no sums of squares of large numbers).
+class MpingLinearFit {
+  public:
+    MpingLinearFit();
+
+    void Add(double x, double y);
+
+    // At least 3 samples and 2 distinct x.
+    bool ok() const { return n_ >= 3 && sxx_ > 0; }
+    uint64_t n() const { return n_; }
+    double slope() const;
+    double intercept() const;
+    // Half widths of the 95% confidence intervals.
+    double slope_ci() const;
+    double intercept_ci() const;
+
+  private:
+    double ResidualVariance() const;
+
+    uint64_t n_;
+    double mean_x_;
+    double mean_y_;
+    double sxx_;
+    double sxy_;
+    double syy_;
+};
+
+// Switching time per packet and per byte, from how RTT and delivery rate
+// grow with the message size (-b -<sel>):
+//   rtt = per packet + per byte * size, over the smallest RTT of each size
+//         (as pathchar: the one that queued least); the per byte part is
+//         store and forward over every link, both ways for echo
+//   1 / rate = per packet + size / capacity, over the best interval of
+//         each size when the sizes are swept one after the other, which
+//         is the bottleneck's only if the window filled it
+// The estimates and their 95% confidence intervals are printed every
+// interval as they firm up.
+class MpingSwitchingFit {
+  public:
+    MpingSwitchingFit();
+
+    // A reply to a |size| byte probe after |rtt| ms.
+    void OnRtt(size_t size, double rtt);
+    // End of an interval of |seconds| probing |size| bytes only, 0 if the
+    // sizes were mixed.
+    void OnTick(size_t size, double seconds);
+    // No more intervals of |size|: its best one joins the rate fit.
+    void EndSize(size_t size);
+
+    MpingLinearFit RttFit() const;
+    const MpingLinearFit& rate_fit() const { return rate_fit_; }
+
+    void PrintTempStats() const;
+
+  private:
+    std::map<size_t, double> min_rtt_;  // ms per size
+    uint64_t replies_;
+    MpingLinearFit rate_fit_;
+    std::map<size_t, double> best_rate_;  // pkt/s per size being swept
+    unsigned int recv_temp_;
+};
+
+#endif  // _MP_SWITCHING_H_
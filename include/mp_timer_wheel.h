@@ -0,0 +1,67 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MP_TIMER_WHEEL_H_
+#define _MP_TIMER_WHEEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Hierarchical timing wheel of probe timeouts: 3 levels of 256 slots, the
+// first one |tick_ns| per slot, each next one 256 times coarser.  A timer
+// is filed at the level its deadline falls in and cascades down a level
+// as the wheel turns, so adding and expiring are O(1) per timer.
+//
+// Probes go out in sequence order, so consecutive sequences with the same
+// deadline tick are kept as one run.
+class MpingTimerWheel {
+  public:
+    struct Run {
+      uint64_t first;  // sequences first..last
+      uint64_t last;
+      uint64_t deadline;  // tick
+      unsigned int interval;  // what the probes are charged to
+    };
+
+    explicit MpingTimerWheel(uint64_t tick_ns);
+
+    // |seq| times out at |deadline| ns.
+    void Add(uint64_t seq, uint64_t deadline, unsigned int interval);
+
+    // Turns the wheel to |now| ns, appending the runs that timed out to
+    // |expired|.  The first call only sets the wheel's time.
+    void Advance(uint64_t now, std::vector<Run> *expired);
+
+    // When the earliest pending run times out, in ns, 0 if none.
+    uint64_t NextExpiry() const;
+
+    size_t runs() const { return runs_; }
+
+  private:
+    static const int kLevels = 3;
+    static const int kSlotBits = 8;
+    static const uint64_t kSlots = 1 << kSlotBits;
+
+    std::vector<Run>* SlotFor(uint64_t deadline);
+    void Cascade(int level);
+
+    uint64_t tick_ns_;
+    uint64_t now_tick_;
+    bool started_;
+    size_t runs_;
+    std::vector<Run> slots_[kLevels][kSlots];
+};
+
+#endif  // _MP_TIMER_WHEEL_H_
@@ -0,0 +1,44 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef _MP_TRACE_H_
+#define _MP_TRACE_H_
+
+// USDT tracepoints of provider "mping", for perf probe or bpftrace, e.g.
+//   bpftrace -e 'usdt:./mping:mping:loss { @lost = sum(arg2); }'
+// Each is a nop until a tracer attaches.  Without systemtap's sys/sdt.h
+// at build time they are left out.
+//
+//   send(seq, bytes)          a probe went out, or was queued with -U
+//   receive(bytes)            a packet came in on the receive socket
+//   classify(kind)            what it was, an MpingReplyKind
+//   loss(first, last, count)  of sequences first..last, count declared lost
+
+#if defined(HAVE_SYS_SDT_H)
+#include <sys/sdt.h>
+
+#define MPING_TRACE_SEND(seq, bytes) DTRACE_PROBE2(mping, send, seq, bytes)
+#define MPING_TRACE_RECEIVE(bytes) DTRACE_PROBE1(mping, receive, bytes)
+#define MPING_TRACE_CLASSIFY(kind) DTRACE_PROBE1(mping, classify, kind)
+#define MPING_TRACE_LOSS(first, last, count) \
+    DTRACE_PROBE3(mping, loss, first, last, count)
+#else
+#define MPING_TRACE_SEND(seq, bytes) do { } while (0)
+#define MPING_TRACE_RECEIVE(bytes) do { } while (0)
+#define MPING_TRACE_CLASSIFY(kind) do { } while (0)
+#define MPING_TRACE_LOSS(first, last, count) do { } while (0)
+#endif
+
+#endif  // _MP_TRACE_H_
@@ -0,0 +1,66 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MP_TRANSPORT_H_
+#define _MP_TRANSPORT_H_
+
+#include <stdint.h>
+#include <string>
+
+class MpingStat;
+
+// What MpingProbeLoop needs to move probes: send a sequence number, get
+// one back, and a clock to stamp both with.  MpingSocket implements it on
+// top of raw/UDP sockets, MpingSimTransport in virtual time.
+class MpingTransport {
+  public:
+    virtual ~MpingTransport() {}
+
+    virtual int Initialize(const std::string& destip, const std::string& srcip,
+                           int ttl, size_t pktsize, int wndsize,
+                           uint16_t port, bool clientmode) = 0;
+
+    virtual bool SetSendTTL(const int& ttl) = 0;
+    virtual bool SendPacket(const uint64_t& seq, size_t size,
+                            int *error) = 0;
+
+    // Blocks until a probe comes back and returns its sequence.  The send
+    // time it carries, on the NowNs() clock, goes to |send_time|, or 0 if
+    // it carries none.  On failure returns 0 and sets |error|: EINTR if
+    // interrupted, ETIMEDOUT if the timeout set by ArmRecvTimeout expired
+    // without a signal being raised.
+    virtual uint64_t ReceiveAndGetSeq(int* error, MpingStat *mpstat,
+                                      uint64_t *send_time) = 0;
+    // Where the last reply came from: the destination, or the router that
+    // sent back an ICMP error.
+    virtual const std::string GetFromAddress() const = 0;
+
+    // Clock used for send/recv stamps and the once per second tick, in ns.
+    virtual uint64_t NowNs() = 0;
+    virtual void WaitUntil(uint64_t deadline) = 0;
+
+    // (Re)arms the timeout that breaks a blocked ReceiveAndGetSeq.
+    virtual void ArmRecvTimeout(unsigned int seconds) = 0;
+
+    // Makes ReceiveAndGetSeq give up with EAGAIN once NowNs() reaches
+    // |deadline|, 0 to block again.  Stays set until changed.
+    virtual void SetRecvDeadline(uint64_t deadline) = 0;
+
+    // Packets the kernel dropped from our receive queue since the last
+    // call, or since Initialize: replies lost on this host rather than on
+    // the path.  False if the transport cannot tell.
+    virtual bool TakeLocalDrops(uint64_t *drops) { return false; }
+};
+
+#endif  // _MP_TRANSPORT_H_
@@ -0,0 +1,123 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef _MP_URING_H_
+#define _MP_URING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+// io_uring for MpingSocket (-U), on the raw system calls.
+//
+// Replies come in through one multishot recvmsg on the receive socket
+// into a ring of provided buffers, so the kernel keeps receiving without
+// a call per packet.  Sends are copied into registered fixed buffers and
+// only queued; they go to the kernel, linked so they leave in order, with
+// the next Receive, which submits them and waits for a reply in the same
+// system call, or only submits them if a reply is already in.  A send
+// that fails is reported by the next QueueSend.
+//
+// Needs Linux 6.0 or later (multishot recvmsg, provided buffer rings);
+// Create returns NULL on older kernels, or where io_uring is disabled, and
+// the caller keeps to plain sockets.
+class MpingUring {
+  public:
+    // |recv_fd| is the socket replies arrive on; |send_size| the largest
+    // probe.  Returns NULL with the reason in |why| if unsupported.
+    static MpingUring* Create(int recv_fd, size_t send_size,
+                              std::string *why);
+    ~MpingUring();
+
+    // Queues |len| bytes to |fd|, to |to| if not NULL (an unconnected
+    // send).  Returns false with |*error| set if an earlier send failed.
+    bool QueueSend(int fd, const char *buf, size_t len, const sockaddr *to,
+                   socklen_t to_len, int *error);
+
+    // Submits the queued sends and takes the next reply, up to |len| bytes
+    // of it to |buf| and its source to |from|, waiting up to |wait_ns|
+    // (~0 for good).  Returns its length, or -1 with |*error| EAGAIN when
+    // the wait is over, EINTR on a signal, or what the kernel said.
+    ssize_t Receive(char *buf, size_t len, sockaddr_storage *from,
+                    uint64_t wait_ns, int *error);
+
+    // Readable (POLLIN) while completions are waiting.
+    int fd() const { return ring_fd_; }
+
+  private:
+    MpingUring();
+    MpingUring(const MpingUring&);
+    MpingUring& operator = (const MpingUring&);
+
+    struct Ready {  // a reply in the buffer ring
+      int32_t res;
+      uint32_t flags;
+    };
+
+    int Setup(int recv_fd, size_t send_size, std::string *why);
+    void* NextSqe();
+    void ArmRecv();
+    int Enter(unsigned int min_complete, uint64_t wait_ns);
+    void Reap();
+    void RecycleBuffer(uint16_t bid);
+
+    int ring_fd_;
+    int recv_fd_;
+
+    // submission queue
+    void *sq_ring_;
+    size_t sq_ring_size_;
+    void *sqes_;
+    size_t sqes_size_;
+    unsigned int *sq_head_;
+    unsigned int *sq_tail_;
+    unsigned int *sq_array_;
+    unsigned int sq_mask_;
+    unsigned int sq_entries_;
+    unsigned int to_submit_;
+
+    // completion queue, in the same mapping as the submission queue
+    unsigned int *cq_head_;
+    unsigned int *cq_tail_;
+    unsigned int cq_mask_;
+    void *cqes_;
+
+    // replies: the provided buffer ring and what landed in it
+    void *buf_ring_;
+    size_t buf_ring_size_;
+    std::vector<char> recv_area_;
+    uint16_t buf_tail_;
+    bool recv_armed_;
+    struct msghdr recv_msg_;
+    std::deque<Ready> ready_;
+
+    // sends: fixed buffers, in use until their completion
+    std::vector<char> send_area_;
+    size_t send_slot_;
+    std::vector<bool> send_busy_;
+    std::vector<struct msghdr> send_msg_;  // for sends with an address
+    std::vector<struct iovec> send_iov_;
+    std::vector<sockaddr_storage> send_to_;
+    size_t next_send_;
+    void *last_send_sqe_;  // of those not submitted yet, to link the next
+    int send_error_;
+    int recv_error_;
+};
+
+#endif  // _MP_URING_H_
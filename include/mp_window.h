@@ -0,0 +1,63 @@
+// Copyright 2013 M-Lab. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _MP_WINDOW_H_
+#define _MP_WINDOW_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Delay based window control (-Q).  Once per RTT the queue we built is
+// estimated from RTT inflation over the base (minimum) RTT, Vegas style:
+//   queue delay = rtt - base_rtt,  queued packets = window * delay / rtt
+// and the window is moved toward holding |target| of it, in packets or in
+// milliseconds.  The window starts at 1 and doubles per RTT until half the
+// target is reached.
+class MpingWindowCtl {
+  public:
+    MpingWindowCtl(int max_window, double target, bool target_is_ms);
+
+    // A first copy of |seq| came back after |rtt| ms; |sseq| is the last
+    // sequence sent.  Closes the RTT round once |seq| passes its end.
+    void OnRecv(uint64_t seq, double rtt, uint64_t sseq);
+
+    int window() const { return static_cast<int>(window_ + 0.5); }
+    double base_rtt() const { return base_rtt_; }
+    double queue_delay() const { return queue_delay_; }  // ms, last round
+    double queue_pkts() const { return queue_pkts_; }  // last round
+
+    void PrintTempStats(size_t packet_size);
+
+  private:
+    void Adjust(uint64_t sseq);
+
+    int max_window_;
+    double target_;
+    bool target_is_ms_;
+    double window_;
+    bool slow_start_;
+    double base_rtt_;
+    double round_min_rtt_;
+    uint64_t round_end_;
+    double queue_delay_;
+    double queue_pkts_;
+
+    unsigned int recv_temp_;
+    unsigned int rounds_temp_;
+    double window_sum_temp_;
+    double delay_sum_temp_;
+    double pkts_sum_temp_;
+};
+
+#endif  // _MP_WINDOW_H_
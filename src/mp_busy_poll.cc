@@ -0,0 +1,147 @@
+#include <errno.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+#include "mp_busy_poll.h"
+#include "mp_clock.h"
+#include "log.h"
+
+#if defined(OS_LINUX)
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+#endif
+
+namespace {
+
+const uint64_t kNsPerUs = 1000ULL;
+
+uint64_t CpuUs() {
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) < 0)
+    return 0;
+
+  return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000ULL +
+         ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+// |p| quantile of |v|, reorders |v|.  -1 when empty.
+double Quantile(std::vector<double> *v, double p) {
+  if (v->empty())
+    return -1.0;
+
+  size_t k = std::min(v->size() - 1, static_cast<size_t>(p * v->size()));
+  std::nth_element(v->begin(), v->begin() + k, v->end());
+  return (*v)[k];
+}
+
+}  // namespace
+
+MpingBusyPoll::MpingBusyPoll(unsigned int budget_us)
+    : budget_ns_(budget_us * kNsPerUs),
+      last_spun_(false),
+      recv_temp_(0),
+      spun_temp_(0),
+      spin_ns_temp_(0),
+      start_ns_temp_(MpingClock::NowNs()),
+      cpu_us_temp_(CpuUs()) {
+}
+
+void MpingBusyPoll::Setup(int fd) {
+#if defined(OS_LINUX)
+  int usecs = static_cast<int>(budget_ns_ / kNsPerUs);
+  if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs)) < 0) {
+    LOG(mlab::WARNING, "SO_BUSY_POLL %d us fails, spinning without it. "
+                       "%s [%d]", usecs, strerror(errno), errno);
+  }
+
+  int one = 1;
+  if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one)) < 0) {
+    LOG(mlab::VERBOSE, "SO_PREFER_BUSY_POLL fails. %s [%d]",
+        strerror(errno), errno);
+  }
+#else
+  LOG(mlab::WARNING, "no SO_BUSY_POLL on this system, spinning without it.");
+#endif
+}
+
+int MpingBusyPoll::Spin(int fd) {
+  uint64_t start = MpingClock::NowNs();
+  uint64_t now = start;
+  int ret = EAGAIN;
+  char c;
+
+  do {
+    if (recv(fd, &c, sizeof(c), MSG_PEEK | MSG_DONTWAIT) >= 0) {
+      ret = 0;
+      break;
+    }
+    if (errno == EINTR) {
+      ret = EINTR;
+      break;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      ret = 0;  // let the real recv report it
+      break;
+    }
+    now = MpingClock::NowNs();
+  } while (now - start < budget_ns_);
+
+  last_spun_ = (ret == 0);
+  spin_ns_temp_ += MpingClock::NowNs() - start;
+  return ret;
+}
+
+void MpingBusyPoll::OnRtt(double rtt) {
+  recv_temp_++;
+  if (last_spun_) {
+    spun_temp_++;
+    spun_rtt_temp_.push_back(rtt);
+  } else {
+    blocked_rtt_temp_.push_back(rtt);
+  }
+}
+
+void MpingBusyPoll::PrintTempStats() {
+  uint64_t now = MpingClock::NowNs();
+  uint64_t cpu = CpuUs();
+  double wall_ms = (now - start_ns_temp_) / (double)kNsPerMs;
+  double spin_ms = spin_ns_temp_ / (double)kNsPerMs;
+  double cpu_ms = (cpu - cpu_us_temp_) / 1000.0;
+
+  double spun50 = Quantile(&spun_rtt_temp_, 0.5);
+  double spun99 = Quantile(&spun_rtt_temp_, 0.99);
+  double blocked50 = Quantile(&blocked_rtt_temp_, 0.5);
+  double blocked99 = Quantile(&blocked_rtt_temp_, 0.99);
+
+  // -1 marks a side with no samples this interval
+  std::cout << std::fixed << std::setprecision(3) <<
+               "Busy poll: " << spun_temp_ << "/" << recv_temp_ <<
+               " replies while spinning, rtt p50 " << spun50 << "/" <<
+               blocked50 << " ms p99 " << spun99 << "/" << blocked99 <<
+               " ms (spin/blocked)";
+  if (spun50 >= 0 && blocked50 >= 0)
+    std::cout << " p50 shift " << spun50 - blocked50 << " ms";
+  std::cout << std::setprecision(1) << ", spin " << spin_ms << " ms " <<
+               (wall_ms > 0 ? spin_ms * 100 / wall_ms : 0.0) << "% cpu " <<
+               (wall_ms > 0 ? cpu_ms * 100 / wall_ms : 0.0) << "%" <<
+               std::endl;
+  std::cout.unsetf(std::ios::floatfield);
+  std::cout << std::setprecision(6);
+
+  recv_temp_ = 0;
+  spun_temp_ = 0;
+  spin_ns_temp_ = 0;
+  spun_rtt_temp_.clear();
+  blocked_rtt_temp_.clear();
+  start_ns_temp_ = now;
+  cpu_us_temp_ = cpu;
+}
@@ -0,0 +1,364 @@
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+#include "mp_campaign.h"
+#include "mp_clock.h"
+#include "mp_eyeballs.h"
+#include "mp_session.h"
+#include "mp_socket.h"
+#include "log.h"
+
+namespace {
+
+const int kResolverThreads = 8;
+const double kDnsTtl = 300;  // seconds
+const double kDnsNegativeTtl = 30;
+
+bool EarlierStart(const MpingProbeSpec& a, const MpingProbeSpec& b) {
+  return a.start < b.start;
+}
+
+int LineError(int line, const std::string& reason, std::string *error) {
+  std::ostringstream msg;
+  msg << "line " << line << ": " << reason;
+  *error = msg.str();
+  return -1;
+}
+
+bool ReadSeconds(const std::string& token, double *value) {
+  char *end;
+  *value = strtod(token.c_str(), &end);
+  return !token.empty() && *end == '\0' && *value >= 0;
+}
+
+// Prints a probe's intervals as the "Sent ..." and "Total ..." lines of
+// mping, prefixed by where they come from.
+class Printer : public MpingSessionListener {
+  public:
+    explicit Printer(const MpingProbeSpec& spec) {
+      std::ostringstream prefix;
+      prefix << spec.target;
+      if (spec.line > 0)
+        prefix << "#" << spec.line;
+      prefix << " ";
+      prefix_ = prefix.str();
+    }
+
+    virtual void OnInterval(const MpingShmStats& stats, int window,
+                            size_t size) {
+      std::cout << prefix_ << "size " << size << " window " << window <<
+                   " Sent " << stats.sent_temp << " received " <<
+                   stats.received_temp << " total received " <<
+                   stats.total_received_temp << " out-of-order " <<
+                   stats.out_of_order_temp << " lost " << stats.lost_temp <<
+                   " dup " << stats.dup_temp << " unexpected " <<
+                   stats.unexpected_temp << " late " << stats.late_temp <<
+                   " lost-earlier " << stats.lost_earlier_temp << std::endl;
+    }
+
+    virtual void OnDone(const MpingShmStats& stats) {
+      std::cout << prefix_ << "Total sent=" << stats.sent << " received=" <<
+                   stats.received << " Total received=" <<
+                   stats.total_received << " total out-of-order=" <<
+                   stats.out_of_order << " total lost=" << stats.lost <<
+                   "(" << (stats.sent ? stats.lost * 100.0 / stats.sent : 0) <<
+                   ")" << " total dup=" << stats.dup <<
+                   " total unexpected=" << stats.unexpected <<
+                   " total late=" << stats.late << std::endl;
+    }
+
+  private:
+    std::string prefix_;
+};
+
+}  // namespace
+
+int MpingReadCampaign(std::istream& in, std::vector<MpingProbeSpec> *specs,
+                      std::string *error) {
+  std::string text;
+  for (int line = 1; std::getline(in, text); line++) {
+    std::istringstream tokens(text);
+    std::vector<std::string> words;
+    std::string word;
+    while (tokens >> word)
+      words.push_back(word);
+
+    if (words.empty() || words[0][0] == '#')
+      continue;
+
+    MpingProbeSpec spec;
+    spec.line = line;
+    if (words.size() < 3 || !ReadSeconds(words[0], &spec.start) ||
+        !ReadSeconds(words[1], &spec.duration)) {
+      return LineError(line, "want <start> <duration> <switches> <host>.",
+                       error);
+    }
+
+    std::vector<const char *> argv;
+    argv.push_back("mping");
+    for (size_t i = 2; i < words.size(); i++)
+      argv.push_back(words[i].c_str());
+
+    std::string reason;
+    if (spec.config.ParseArgs(argv.size(), &argv[0], &reason) < 0 ||
+        spec.config.Validate(&reason) < 0 ||
+        MpingSession::Check(spec.config, &reason) < 0) {
+      return LineError(line, reason, error);
+    }
+    if (spec.config.dst_host.empty())
+      return LineError(line, "Must have destination host.", error);
+    spec.target = spec.config.dst_host;
+
+    specs->push_back(spec);
+  }
+
+  std::stable_sort(specs->begin(), specs->end(), EarlierStart);
+  return 0;
+}
+
+MpingCampaignQueue::MpingCampaignQueue(int max_sessions, int max_per_host,
+                                       double host_gap)
+    : max_sessions_(max_sessions),
+      max_per_host_(max_per_host),
+      host_gap_(host_gap),
+      running_(0) {
+  ASSERT(max_sessions_ > 0 && max_per_host_ > 0);
+}
+
+void MpingCampaignQueue::Add(const MpingProbeSpec& spec) {
+  std::vector<MpingProbeSpec>::iterator it =
+      std::upper_bound(pending_.begin(), pending_.end(), spec, EarlierStart);
+  pending_.insert(it, spec);
+}
+
+bool MpingCampaignQueue::Next(double now, MpingProbeSpec *spec,
+                              double *wait) {
+  *wait = -1;
+  for (size_t i = 0; i < pending_.size(); i++) {
+    const MpingProbeSpec& p = pending_[i];
+    double ready = p.start;
+    if (ready > now) {  // the rest start later still
+      if (running_ < max_sessions_ && (*wait < 0 || ready - now < *wait))
+        *wait = ready - now;
+      break;
+    }
+    if (running_ >= max_sessions_)
+      break;
+
+    std::string host = p.config.dst_host;  // p goes with the erase
+    if (running_per_host_[host] >= max_per_host_)
+      continue;
+
+    std::map<std::string, double>::iterator last = last_start_.find(host);
+    if (last != last_start_.end() && last->second + host_gap_ > now) {
+      double gap = last->second + host_gap_ - now;
+      if (*wait < 0 || gap < *wait)
+        *wait = gap;
+      continue;
+    }
+
+    *spec = p;
+    pending_.erase(pending_.begin() + i);
+    running_++;
+    running_per_host_[host]++;
+    last_start_[host] = now;
+    return true;
+  }
+
+  return false;
+}
+
+void MpingCampaignQueue::OnEnd(const std::string& host) {
+  ASSERT(running_ > 0);
+  running_--;
+  if (--running_per_host_[host] <= 0)
+    running_per_host_.erase(host);
+}
+
+MpingCampaign::MpingCampaign(int max_sessions, int max_per_host,
+                             double host_gap, MpingLookup *lookup)
+    : resolver_(kResolverThreads, kDnsTtl, kDnsNegativeTtl, lookup),
+      queue_(max_sessions, max_per_host, host_gap) {
+}
+
+MpingCampaign::~MpingCampaign() {
+  while (!running_.empty())
+    EndProbe(running_.size() - 1, true);
+
+  std::map<std::string, std::vector<MpingSocket*> >::iterator it;
+  for (it = pool_.begin(); it != pool_.end(); ++it) {
+    for (size_t i = 0; i < it->second.size(); i++)
+      delete it->second[i];
+  }
+}
+
+int MpingCampaign::Init(std::string *error) {
+  return resolver_.Init(error);
+}
+
+void MpingCampaign::Add(const MpingProbeSpec& spec) {
+  unresolved_[spec.config.dst_host].push_back(spec);
+  resolver_.Resolve(spec.config.dst_host);
+}
+
+int MpingCampaign::TakeResolved() {
+  std::vector<MpingResolver::Result> results;
+  resolver_.Take(&results);
+
+  int failed = 0;
+  for (size_t i = 0; i < results.size(); i++) {
+    const MpingResolver::Result& r = results[i];
+    std::vector<MpingProbeSpec>& specs = unresolved_[r.host];
+    std::vector<std::string> ordered;
+    MpingSortAddresses(r.ips, &ordered);
+    for (size_t j = 0; j < specs.size(); j++) {
+      if (r.ips.empty()) {
+        LOG(mlab::ERROR, "line %d: cannot resolve %s. %s", specs[j].line,
+            r.host.c_str(), gai_strerror(r.error));
+        failed++;
+        continue;
+      }
+
+      specs[j].config.dst_host = ordered[0];
+      queue_.Add(specs[j]);
+    }
+    unresolved_.erase(r.host);
+  }
+
+  return failed;
+}
+
+std::string MpingCampaign::PoolKey(const MpingConfig& config) {
+  if (config.legacy_seq)  // no nonce to tell stale replies apart
+    return "";
+
+  std::ostringstream key;
+  key << (config.ttl ? "udp" : "icmp") << " " << config.client_mode << " " <<
+         config.busy_poll << " " << config.io_uring << " " <<
+         config.src_addr;
+  return key.str();
+}
+
+int MpingCampaign::StartProbe(const MpingProbeSpec& spec, uint64_t now) {
+  Running r;
+  r.spec = spec;
+  r.session = new MpingSession;
+  r.printer = new Printer(spec);
+  r.end = spec.duration > 0 ?
+      now + static_cast<uint64_t>(spec.duration * kNsPerSec) : 0;
+
+  std::string key = PoolKey(spec.config);
+  std::vector<MpingSocket*> *pool = key.empty() ? NULL : &pool_[key];
+  if (pool && !pool->empty()) {
+    r.socket = pool->back();
+    pool->pop_back();
+  } else {
+    r.socket = new MpingSocket;
+    r.socket->SetBusyPoll(spec.config.busy_poll);
+    r.socket->SetLegacySeq(spec.config.legacy_seq);
+    r.socket->SetUring(spec.config.io_uring);
+  }
+
+  r.session->SetTransport(r.socket);
+  r.session->SetListener(r.printer);
+  running_.push_back(r);
+
+  std::string error;
+  if (r.session->Start(spec.config, &error) < 0) {
+    LOG(mlab::ERROR, "line %d: %s", spec.line, error.c_str());
+    EndProbe(running_.size() - 1, true);
+    return -1;
+  }
+
+  LOG(mlab::INFO, "line %d: probing %s (%s).", spec.line,
+      spec.target.c_str(), spec.config.dst_host.c_str());
+  return 0;
+}
+
+void MpingCampaign::EndProbe(size_t ix, bool failed) {
+  Running r = running_[ix];
+  running_.erase(running_.begin() + ix);
+  queue_.OnEnd(r.spec.config.dst_host);
+
+  delete r.session;
+  delete r.printer;
+  std::string key = PoolKey(r.spec.config);
+  if (failed || key.empty()) {  // a failed socket may be half set up
+    delete r.socket;
+  } else {
+    pool_[key].push_back(r.socket);
+  }
+}
+
+int MpingCampaign::Run() {
+  uint64_t start = MpingClock::NowNs();
+  int failed = 0;
+
+  while (!unresolved_.empty() || !queue_.empty() || !running_.empty()) {
+    failed += TakeResolved();
+    uint64_t now = MpingClock::NowNs();
+    MpingProbeSpec spec;
+    double wait;
+    while (queue_.Next((now - start) / (double)kNsPerSec, &spec, &wait)) {
+      if (StartProbe(spec, now) < 0)
+        failed++;
+    }
+
+    // sleep until a reply, a session timer, a probe's end or start
+    uint64_t wake = wait >= 0 ?
+        now + static_cast<uint64_t>(wait * kNsPerSec) : ~0ULL;
+    std::vector<struct pollfd> fds;
+    for (size_t i = 0; i < running_.size(); i++) {
+      struct pollfd pfd;
+      pfd.fd = running_[i].socket->recv_fd();
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      fds.push_back(pfd);
+      wake = std::min(wake, running_[i].session->next_wakeup());
+      if (running_[i].end)
+        wake = std::min(wake, running_[i].end);
+    }
+    if (!unresolved_.empty()) {  // the next host to resolve
+      struct pollfd pfd;
+      pfd.fd = resolver_.fd();
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      fds.push_back(pfd);
+    }
+
+    if (fds.empty() && wake == ~0ULL)
+      break;  // nothing left that could start
+
+    int timeout = wake == ~0ULL ? -1 : wake <= now ? 0 :
+        static_cast<int>((wake - now + kNsPerMs - 1) / kNsPerMs);
+    if (poll(fds.empty() ? NULL : &fds[0], fds.size(), timeout) < 0 &&
+        errno != EINTR) {
+      LOG(mlab::ERROR, "poll fails. %s [%d]", strerror(errno), errno);
+      return failed + running_.size();
+    }
+
+    for (size_t i = running_.size(); i-- > 0; ) {
+      Running& r = running_[i];
+      if (r.end && MpingClock::NowNs() >= r.end)
+        r.session->Stop();
+
+      int ret = r.session->Poll(0);
+      if (ret < 0) {
+        LOG(mlab::ERROR, "line %d: %s", r.spec.line,
+            r.session->error().c_str());
+        failed++;
+      }
+      if (ret <= 0)
+        EndProbe(i, ret < 0);
+    }
+  }
+
+  return failed;
+}
@@ -0,0 +1,160 @@
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MP_CHECKSUM_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MP_CHECKSUM_NEON
+#endif
+
+#include "mp_checksum.h"
+
+namespace {
+
+// All kernels add the data as native-order 32-bit words into 64-bit lanes;
+// 2^16 == 1 mod 0xffff so folding that gives the 16-bit one's complement
+// sum.  The lanes cannot overflow for anything below 2^32 words.
+uint16_t Fold(uint64_t sum) {
+  sum = (sum & 0xffffffffULL) + (sum >> 32);
+  sum = (sum & 0xffffffffULL) + (sum >> 32);
+  sum = (sum & 0xffff) + (sum >> 16);
+  sum = (sum & 0xffff) + (sum >> 16);
+  sum = (sum & 0xffff) + (sum >> 16);
+  return static_cast<uint16_t>(~sum);
+}
+
+// Trailing bytes, zero padded like the odd byte of the scalar routine.
+uint64_t SumTail(const unsigned char *p, size_t len) {
+  uint32_t words[2] = {0, 0};
+  memcpy(words, p, len);
+  return static_cast<uint64_t>(words[0]) + words[1];
+}
+
+uint64_t SumGeneric(const unsigned char *p, size_t len) {
+  uint64_t sum = 0;
+  uint32_t w[4];
+  while (len >= sizeof(w)) {
+    memcpy(w, p, sizeof(w));
+    sum += static_cast<uint64_t>(w[0]) + w[1] + w[2] + w[3];
+    p += sizeof(w);
+    len -= sizeof(w);
+  }
+  while (len >= 8) {
+    sum += SumTail(p, 8);
+    p += 8;
+    len -= 8;
+  }
+  return sum + SumTail(p, len);
+}
+
+uint16_t CheckSumGeneric(const void *data, size_t len) {
+  return Fold(SumGeneric(static_cast<const unsigned char*>(data), len));
+}
+
+#if defined(MP_CHECKSUM_X86)
+uint16_t CheckSumSSE2(const void *data, size_t len)
+    __attribute__((target("sse2")));
+uint16_t CheckSumSSE2(const void *data, size_t len) {
+  const unsigned char *p = static_cast<const unsigned char*>(data);
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc0 = zero;
+  __m128i acc1 = zero;
+
+  while (len >= 32) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+    acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(a, zero));
+    acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(a, zero));
+    acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(b, zero));
+    acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(b, zero));
+    p += 32;
+    len -= 32;
+  }
+
+  uint64_t lanes[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes),
+                   _mm_add_epi64(acc0, acc1));
+  return Fold(lanes[0] + lanes[1] + SumGeneric(p, len));
+}
+
+uint16_t CheckSumAVX2(const void *data, size_t len)
+    __attribute__((target("avx2")));
+uint16_t CheckSumAVX2(const void *data, size_t len) {
+  const unsigned char *p = static_cast<const unsigned char*>(data);
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i acc0 = zero;
+  __m256i acc1 = zero;
+
+  while (len >= 64) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(a, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(a, zero));
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(b, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(b, zero));
+    p += 64;
+    len -= 64;
+  }
+
+  uint64_t lanes[4];
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes),
+                      _mm256_add_epi64(acc0, acc1));
+  return Fold(lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+              SumGeneric(p, len));
+}
+#endif  // MP_CHECKSUM_X86
+
+#if defined(MP_CHECKSUM_NEON)
+uint16_t CheckSumNEON(const void *data, size_t len) {
+  const unsigned char *p = static_cast<const unsigned char*>(data);
+  uint64x2_t acc0 = vdupq_n_u64(0);
+  uint64x2_t acc1 = vdupq_n_u64(0);
+
+  while (len >= 32) {
+    acc0 = vpadalq_u32(acc0, vreinterpretq_u32_u8(vld1q_u8(p)));
+    acc1 = vpadalq_u32(acc1, vreinterpretq_u32_u8(vld1q_u8(p + 16)));
+    p += 32;
+    len -= 32;
+  }
+
+  uint64x2_t acc = vaddq_u64(acc0, acc1);
+  return Fold(vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1) +
+              SumGeneric(p, len));
+}
+#endif  // MP_CHECKSUM_NEON
+
+MpingCheckSumFunc SelectCheckSum() {
+  MpingCheckSumFunc f = MpingCheckSumKernel("avx2");
+  if (f == NULL)
+    f = MpingCheckSumKernel("sse2");
+  if (f == NULL)
+    f = MpingCheckSumKernel("neon");
+  if (f == NULL)
+    f = MpingCheckSumKernel("generic");
+  return f;
+}
+
+}  // namespace
+
+MpingCheckSumFunc MpingCheckSumKernel(const char *name) {
+  if (strcmp(name, "generic") == 0)
+    return CheckSumGeneric;
+#if defined(MP_CHECKSUM_X86)
+  __builtin_cpu_init();
+  if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2"))
+    return CheckSumSSE2;
+  if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+    return CheckSumAVX2;
+#endif
+#if defined(MP_CHECKSUM_NEON)
+  if (strcmp(name, "neon") == 0)
+    return CheckSumNEON;
+#endif
+  return NULL;
+}
+
+uint16_t MpingCheckSum(const void *data, size_t len) {
+  static const MpingCheckSumFunc kernel = SelectCheckSum();
+  return kernel(data, len);
+}
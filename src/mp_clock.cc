@@ -0,0 +1,154 @@
+#include <time.h>
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define MP_CLOCK_TSC
+#endif
+
+#include "mp_clock.h"
+
+namespace {
+
+#if defined(CLOCK_MONOTONIC_RAW)
+const clockid_t kRawClock = CLOCK_MONOTONIC_RAW;
+#else
+const clockid_t kRawClock = CLOCK_MONOTONIC;
+#endif
+
+const uint64_t kCalibrateNs = 10 * kNsPerMs;
+const int kSamples = 8;  // reads at each end of a calibration, tightest kept
+const int kRounds = 3;  // calibrations that must agree
+const uint64_t kMaxBracketNs = 5000;  // wider, the reads were preempted
+const double kMaxDisagree = 20e-6;  // between rounds, 20 ppm
+const uint64_t kSpinNs = 50000;  // WaitUntil spins, not sleeps, this last
+const int kShift = 32;  // fixed point of the TSC scale
+
+uint64_t RawNs() {
+  struct timespec ts;
+  clock_gettime(kRawClock, &ts);
+  return ts.tv_sec * kNsPerSec + ts.tv_nsec;
+}
+
+// ns = base_ns + (tsc - base_tsc) * mult >> kShift
+struct TscScale {
+  bool use_tsc;
+  uint64_t base_tsc;
+  uint64_t base_ns;
+  uint64_t mult;
+};
+
+#if defined(MP_CLOCK_TSC)
+bool HasInvariantTsc() {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+    return false;
+
+  __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+  return (edx & (1U << 8)) != 0;
+}
+#endif
+
+#if defined(MP_CLOCK_TSC)
+// A TSC read bracketed by two raw clock reads, the tightest of kSamples:
+// a preemption between the reads widens the bracket, not the error.
+struct TscSample {
+  uint64_t tsc;
+  uint64_t ns;  // middle of the bracket
+  uint64_t width;
+};
+
+TscSample Sample() {
+  TscSample best = {0, 0, ~0ULL};
+  for (int i = 0; i < kSamples; i++) {
+    uint64_t before = RawNs();
+    uint64_t tsc = __rdtsc();
+    uint64_t after = RawNs();
+    if (after - before < best.width) {
+      best.tsc = tsc;
+      best.ns = before + (after - before) / 2;
+      best.width = after - before;
+    }
+  }
+  return best;
+}
+#endif
+
+TscScale Calibrate() {
+  TscScale s = {false, 0, 0, 0};
+#if defined(MP_CLOCK_TSC)
+  if (!HasInvariantTsc())
+    return s;
+
+  // a few rounds, each over kCalibrateNs; if they do not agree the TSC
+  // is not to be trusted, and clock_gettime it is
+  uint64_t low = ~0ULL, high = 0;
+  TscSample start = Sample();
+  for (int round = 0; round < kRounds; round++) {
+    TscSample end = start;
+    while (end.ns - start.ns < kCalibrateNs) {
+      end = Sample();
+    }
+    if (start.width > kMaxBracketNs || end.width > kMaxBracketNs ||
+        end.tsc <= start.tsc) {
+      return s;
+    }
+
+    uint64_t mult = ((end.ns - start.ns) << kShift) / (end.tsc - start.tsc);
+    low = std::min(low, mult);
+    high = std::max(high, mult);
+    s.base_tsc = end.tsc;
+    s.base_ns = end.ns;
+    start = end;
+  }
+  if (high - low > low * kMaxDisagree)
+    return s;
+
+  s.use_tsc = true;
+  s.mult = low + (high - low) / 2;
+#endif
+  return s;
+}
+
+const TscScale& Scale() {
+  static const TscScale scale = Calibrate();
+  return scale;
+}
+
+}  // namespace
+
+uint64_t MpingClock::NowNs() {
+  const TscScale& s = Scale();
+#if defined(MP_CLOCK_TSC)
+  if (s.use_tsc) {
+    uint64_t c = __rdtsc();
+    if (c < s.base_tsc)
+      c = s.base_tsc;
+    unsigned __int128 delta =
+        static_cast<unsigned __int128>(c - s.base_tsc) * s.mult;
+    return s.base_ns + static_cast<uint64_t>(delta >> kShift);
+  }
+#endif
+  return RawNs();
+}
+
+const char* MpingClock::Source() {
+  return Scale().use_tsc ? "tsc" : "clock_gettime";
+}
+
+void MpingClock::WaitUntil(uint64_t ns) {
+  uint64_t now = NowNs();
+  while (now + kSpinNs < ns) {
+    uint64_t sleep = ns - now - kSpinNs;
+    struct timespec ts = {static_cast<time_t>(sleep / kNsPerSec),
+                          static_cast<long>(sleep % kNsPerSec)};
+    nanosleep(&ts, NULL);
+    now = NowNs();
+  }
+
+  while (now < ns) {
+    now = NowNs();
+  }
+}
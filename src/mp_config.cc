@@ -0,0 +1,268 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "mp_config.h"
+#include "log.h"
+#include "mlab/mlab.h"
+
+namespace {
+
+const int kDefaultTTL = 255;
+
+int Fail(std::string *error, const std::string& reason) {
+  *error = reason;
+  return -1;
+}
+
+}  // namespace
+
+MpingConfig::MpingConfig()
+    : win_size(4),
+      loop(false),
+      rate(0),
+      slow_start(false),
+      ttl(0),
+      inc_ttl(0),
+      pkt_size(0),
+      loop_size(0),
+      version(false),
+      help(false),
+      debug(false),
+      burst(0),
+      interval(0),
+      dport(0),
+      server_port(0),
+      server_family(SOCKETFAMILY_UNSPEC),
+      client_mode(false),
+      target_queue(0),
+      target_queue_ms(false),
+      knee_search(false),
+      all_hops(false),
+      interleave_sizes(false),
+      busy_poll(0),
+      io_uring(false),
+      legacy_seq(false),
+      loss_timeout(0),
+      dual_stack(false),
+      flows(1),
+      profile(false),
+      max_sessions(16),
+      max_per_host(1),
+      host_gap(0) {
+}
+
+int MpingConfig::ParseArgs(int argc, const char **argv, std::string *error) {
+  for (int i = 1; i < argc; i++) {
+    const char *p = argv[i];
+    if (p[0] != '-') {  // host
+      if (!dst_host.empty()) {
+        return Fail(error, "More than one destination host: " +
+                           std::string(p) + ".");
+      }
+      dst_host = std::string(p);
+      continue;
+    }
+
+    switch (p[1]) {  // those switches without value
+      case 'f': loop = true; continue;
+      case 'S': slow_start = true; continue;
+      case 'V': version = true; continue;
+      case 'd': debug = true; continue;
+      case 'c': client_mode = true; continue;
+      case 'K': knee_search = true; continue;
+      case 'H': all_hops = true; continue;
+      case 'I': interleave_sizes = true; continue;
+      case 'L': legacy_seq = true; continue;
+      case 'D': dual_stack = true; continue;
+      case 'U': io_uring = true; continue;
+      case 'X': profile = true; continue;
+      case '4': server_family = SOCKETFAMILY_IPV4; continue;
+      case '6': server_family = SOCKETFAMILY_IPV6; continue;
+      case 'h': help = true; continue;
+    }
+
+    if (i + 1 >= argc) {
+      return Fail(error, "Missing value for " + std::string(p) + ".");
+    }
+
+    const char *v = argv[++i];
+    switch (p[1]) {
+      case 'n': win_size = atoi(v); break;
+      case 'R': rate = atoi(v); break;
+      case 't': ttl = atoi(v); break;
+      case 's': server_port = atoi(v); break;
+      case 'a': inc_ttl = atoi(v); ttl = inc_ttl; break;
+      case 'b': {
+        if (v[0] == '-') {
+          loop_size = atoi(v);
+        } else {
+          pkt_size = atoi(v);
+        }
+        break;
+      }
+      case 'p': dport = atoi(v); break;
+      case 'B': burst = atoi(v); break;
+      case 'P': busy_poll = atoi(v); break;
+      case 'T': loss_timeout = atof(v); break;
+      case 'E': flows = atoi(v); break;
+      case 'Q': {
+        char *unit;
+        target_queue = strtod(v, &unit);
+        target_queue_ms = (strcmp(unit, "ms") == 0);
+        if (unit == v || (*unit != '\0' && !target_queue_ms)) {
+          return Fail(error, "-Q takes packets, or ms with an ms suffix: " +
+                             std::string(v) + ".");
+        }
+        break;
+      }
+      case 'F': src_addr = std::string(v); break;
+      case 'M': shm_name = std::string(v); break;
+      case 'C': campaign = std::string(v); break;
+      case 'j': max_sessions = atoi(v); break;
+      case 'J': max_per_host = atoi(v); break;
+      case 'G': host_gap = atof(v); break;
+      default:
+        return Fail(error, "Unknown parameter " + std::string(p) + ".");
+    }
+  }
+
+  return 0;
+}
+
+int MpingConfig::Validate(std::string *error) {
+  // client mode
+  if (client_mode) {
+    if (dport == 0) {
+      return Fail(error, "Client mode must have destination port using -p.");
+    }
+
+    if (ttl == 0) {
+      ttl = kDefaultTTL;
+    }
+  }
+
+  // TTL
+  if (ttl > 255 || ttl < 0) {
+    ttl = 255;
+    LOG(mlab::WARNING, "TTL %d is either > 255 or < 0, "
+                       "now set TTL to 255.", ttl);
+  }
+
+  // loop_size [-4, -1]
+  if (loop_size < -4 || loop_size > 0) {
+    return Fail(error, "loop through message size could only take"
+                       "-1, -2, -3 or -4");
+  }
+
+  // target queue
+  if (target_queue < 0) {
+    return Fail(error, "Target queue must be positive.");
+  }
+
+  if (target_queue > 0) {
+    if (inc_ttl > 0 || loop_size < 0) {
+      return Fail(error, "-Q cannot be used together with -a or -b -<sel>.");
+    }
+
+    loop = true;  // the controller picks the window, not the sweep
+  }
+
+  if (knee_search) {
+    if (target_queue > 0) {
+      return Fail(error, "-K and -Q cannot be used together.");
+    }
+
+    loop = true;  // one pass per size, the search picks the windows
+  }
+
+  if (interleave_sizes) {
+    if (loop_size == 0 || pkt_size > 0) {
+      return Fail(error, "-I needs -b -<sel>.");
+    }
+    if (knee_search) {
+      return Fail(error, "-I and -K cannot be used together.");
+    }
+  }
+
+  if (all_hops && inc_ttl == 0) {
+    return Fail(error, "-H needs -a.");
+  }
+
+  if (busy_poll < 0) {
+    return Fail(error, "Spin budget must be positive.");
+  }
+
+  if (io_uring && busy_poll > 0) {
+    return Fail(error, "-U and -P cannot be used together.");
+  }
+
+  // queued probes would all leave with the TTL set last
+  if (io_uring && inc_ttl > 0) {
+    return Fail(error, "-U cannot be used with -a or -H.");
+  }
+
+  if (loss_timeout < 0) {
+    return Fail(error, "Loss timeout must be positive.");
+  }
+
+  if (dual_stack && (inc_ttl > 0 || interleave_sizes || knee_search ||
+                     !shm_name.empty() || server_port > 0 ||
+                     !campaign.empty() || flows > 1)) {
+    return Fail(error, "-D cannot be used with -a, -E, -I, -K, -M, -s "
+                       "or -C.");
+  }
+
+  if (flows < 1) {
+    return Fail(error, "Number of flows must be at least 1.");
+  }
+
+  if (flows > 1) {
+    if (inc_ttl > 0 || interleave_sizes || client_mode) {
+      return Fail(error, "-E cannot be used with -a, -I or -c.");
+    }
+    if (dport + flows - 1 > 65535) {
+      return Fail(error, "-p plus the flows of -E go past port 65535.");
+    }
+  }
+
+  if (profile && (dual_stack || !campaign.empty())) {
+    return Fail(error, "-X cannot be used with -D or -C.");
+  }
+
+  if (max_sessions < 1 || max_per_host < 1 || host_gap < 0) {
+    return Fail(error, "-j and -J must be at least 1, -G positive.");
+  }
+
+  // inc_ttl
+  if (inc_ttl > 255 || inc_ttl < 0) {
+    inc_ttl = 255;
+    LOG(mlab::WARNING, "Auto-increment TTL %u is either > 255 or < 0, "
+                       "now set auto-increment TTL to 255.", inc_ttl);
+  }
+
+  // max packet size
+  if (pkt_size > 65535) {
+    return Fail(error, "Packet size cannot larger than 65535.");
+  }
+
+  // validate local host
+  if (src_addr.length() > 0) {
+    if (mlab::GetSocketFamilyForAddress(src_addr) == SOCKETFAMILY_UNSPEC) {
+      return Fail(error, "Local host " + src_addr + " invalid. "
+                         "Only accept numeric IP address");
+    }
+  }
+
+  // validate UDP destination port
+  if (dport > 0 ) {
+    if (ttl == 0 && !client_mode) {
+      return Fail(error, "-p can only use together with -t -a or -p.");
+    }
+
+    if (dport > 65535) {
+      return Fail(error, "UDP destination port cannot larger than 65535.");
+    }
+  }
+
+  return 0;
+}
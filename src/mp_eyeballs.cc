@@ -0,0 +1,178 @@
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "mp_clock.h"
+#include "mp_eyeballs.h"
+#include "mp_payload.h"
+#include "mp_stats.h"
+#include "mp_transport.h"
+#include "log.h"
+#include "mlab/mlab.h"
+#include "mlab/protocol_header.h"
+#include "mlab/socket_family.h"
+
+namespace {
+
+const uint64_t kAttemptDelay = 250 * kNsPerMs;  // RFC 8305 section 5
+const uint64_t kRaceTimeout = 2 * kNsPerSec;  // after the last attempt
+const uint64_t kResend = kNsPerSec;
+const uint64_t kStep = 10 * kNsPerMs;  // how often to look for replies
+const size_t kRaceBuffer = 9000;  // as mping
+
+bool IsIPv6(const std::string& ip) {
+  return mlab::GetSocketFamilyForAddress(ip) == SOCKETFAMILY_IPV6;
+}
+
+size_t ProbeSize(const std::string& ip, bool legacy) {
+  size_t payload = legacy ? kLegacyPayloadLength : kSessionPayloadLength;
+  return IsIPv6(ip) ?
+      sizeof(mlab::IP6Header) + sizeof(mlab::ICMP6Header) + payload :
+      sizeof(mlab::IP4Header) + sizeof(mlab::ICMP4Header) + payload;
+}
+
+struct Attempt {
+  Attempt() : started(false), failed(false), answered(false), seq(0),
+              next_send(0) { }
+
+  bool started;
+  bool failed;
+  bool answered;
+  uint64_t seq;
+  uint64_t next_send;
+};
+
+}  // namespace
+
+void MpingSortAddresses(const std::set<std::string>& ips,
+                        std::vector<std::string> *ordered) {
+  std::vector<std::string> v6, v4;
+  for (std::set<std::string>::const_iterator it = ips.begin();
+       it != ips.end(); ++it) {
+    if (IsIPv6(*it)) {
+      v6.push_back(*it);
+    } else {
+      v4.push_back(*it);
+    }
+  }
+
+  for (size_t i = 0; i < std::max(v6.size(), v4.size()); i++) {
+    if (i < v6.size())
+      ordered->push_back(v6[i]);
+    if (i < v4.size())
+      ordered->push_back(v4[i]);
+  }
+}
+
+int MpingRaceAddresses(const std::vector<std::string>& ordered,
+                       const std::vector<MpingTransport*>& transports,
+                       const MpingConfig& config, bool each_family,
+                       std::vector<std::string> *responsive) {
+  ASSERT(ordered.size() == transports.size());
+  if (ordered.empty())
+    return 0;
+
+  size_t n = ordered.size();
+  std::vector<Attempt> attempts(n);
+  std::set<bool> families;  // IPv6 or not, of all the addresses
+  for (size_t i = 0; i < n; i++)
+    families.insert(IsIPv6(ordered[i]));
+  std::set<bool> answered;  // families that have
+
+  MpingStat discard(1, config.legacy_seq);  // counts what is unexpected
+  MpingTransport *clock = transports[0];
+  uint64_t next_start = clock->NowNs();
+  uint64_t end = 0;
+  size_t next = 0;  // the next attempt to start
+  bool done = false;
+
+  while (!done) {
+    uint64_t now = clock->NowNs();
+
+    // the next attempt, when due or when nothing started is still going
+    bool live = false;
+    for (size_t i = 0; i < next; i++)
+      live = live || (!attempts[i].failed && !attempts[i].answered);
+    while (next < n && (now >= next_start || !live)) {
+      Attempt& a = attempts[next];
+      MpingTransport *t = transports[next];
+      const std::string& ip = ordered[next++];
+      if (answered.count(IsIPv6(ip)))
+        continue;  // that family has its address
+
+      a.started = true;
+      if (t->Initialize(ip, config.src_addr, config.ttl, kRaceBuffer, 1,
+                        config.dport, config.client_mode) < 0 ||
+          (config.ttl && !t->SetSendTTL(config.ttl))) {
+        LOG(mlab::VERBOSE, "race: cannot open %s.", ip.c_str());
+        a.failed = true;
+        continue;
+      }
+      LOG(mlab::VERBOSE, "race: trying %s.", ip.c_str());
+      a.next_send = now;
+      next_start = now + kAttemptDelay;
+      end = now + kRaceTimeout;
+      live = true;
+      break;
+    }
+    if (!live && next >= n)
+      break;  // every attempt failed
+    if (next >= n && now >= end)
+      break;
+
+    uint64_t wake = std::min(now + kStep, end);
+    if (next < n)
+      wake = std::min(wake, next_start);
+
+    for (size_t i = 0; i < next; i++) {
+      Attempt& a = attempts[i];
+      MpingTransport *t = transports[i];
+      if (!a.started || a.failed || a.answered)
+        continue;
+
+      if (now >= a.next_send) {
+        int err;
+        if (t->SendPacket(++a.seq, ProbeSize(ordered[i], config.legacy_seq),
+                          &err)) {
+          a.next_send = now + kResend;
+        } else if (err == ENOBUFS || err == EINTR) {
+          a.seq--;  // try again on the next step
+        } else {
+          LOG(mlab::VERBOSE, "race: %s fails. %s", ordered[i].c_str(),
+              strerror(err));
+          a.failed = true;
+          continue;
+        }
+      }
+      wake = std::min(wake, a.next_send);
+
+      // only what is already queued
+      t->SetRecvDeadline(std::max(now, (uint64_t)1));
+      int err;
+      uint64_t stamp;
+      uint64_t seq = t->ReceiveAndGetSeq(&err, &discard, &stamp);
+      if (err == 0 && seq > 0 && seq <= a.seq) {
+        a.answered = true;
+        answered.insert(IsIPv6(ordered[i]));
+        responsive->push_back(ordered[i]);
+        LOG(mlab::VERBOSE, "race: %s answers.", ordered[i].c_str());
+      } else if (err != 0 && err != EAGAIN && err != ETIMEDOUT &&
+                 err != EINTR) {
+        a.failed = true;
+      }
+    }
+
+    done = each_family ? answered == families : !answered.empty();
+    if (!done) {  // all of them, to keep one clock
+      for (size_t i = 0; i < n; i++)
+        transports[i]->WaitUntil(wake);
+    }
+  }
+
+  for (size_t i = 0; i < next; i++) {
+    if (attempts[i].started)
+      transports[i]->SetRecvDeadline(0);
+  }
+  return responsive->size();
+}
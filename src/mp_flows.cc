@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+#include "mp_flows.h"
+#include "mp_shm.h"
+#include "mp_stats.h"
+#include "log.h"
+
+namespace {
+
+const double kLossMargin = 0.01;  // loss rate over the median, at least
+const double kRttFactor = 1.5;
+
+double Median(std::vector<double> v) {
+  std::sort(v.begin(), v.end());
+  return v[(v.size() - 1) / 2];
+}
+
+double LossRate(const MpingShmStats& s) {
+  return s.sent ? static_cast<double>(s.lost) / s.sent : 0;
+}
+
+}  // namespace
+
+MpingFlowSpread::MpingFlowSpread(int flows, int win_size,
+                                 bool keep_send_times, double loss_timeout)
+    : MpingStatSplit(flows, win_size, keep_send_times, loss_timeout) {
+}
+
+void MpingFlowSpread::PrintTempStats() {
+  std::vector<std::string> labels;
+  for (size_t i = 0; i < classes(); i++) {
+    MpingShmStats s;
+    stat(i).Snapshot(&s);
+    std::ostringstream label;
+    label << "Flow " << i << " srtt " << s.srtt << " ms";
+    labels.push_back(label.str());
+  }
+  PrintTemp(labels);
+}
+
+void MpingFlowSpread::PrintStats() {
+  std::vector<std::string> labels;
+  for (size_t i = 0; i < classes(); i++) {
+    std::ostringstream label;
+    label << "Flow " << i;
+    labels.push_back(label.str());
+  }
+  Print(labels);
+
+  std::vector<int> suspects;
+  Suspects(&suspects);
+  for (size_t i = 0; i < suspects.size(); i++) {
+    MpingShmStats s;
+    stat(suspects[i]).Snapshot(&s);
+    LOG(mlab::WARNING, "Flow %d stands out: lost %.2f%%, srtt %.3f ms.",
+        suspects[i], LossRate(s) * 100, s.srtt);
+  }
+}
+
+void MpingFlowSpread::Suspects(std::vector<int> *flows) const {
+  std::vector<MpingShmStats> all(classes());
+  std::vector<double> losses, rtts;
+  for (size_t i = 0; i < all.size(); i++) {
+    stat(i).Snapshot(&all[i]);
+    losses.push_back(LossRate(all[i]));
+    if (all[i].srtt >= 0)
+      rtts.push_back(all[i].srtt);
+  }
+
+  double loss = Median(losses);
+  double rtt = rtts.empty() ? -1 : Median(rtts);
+  for (size_t i = 0; i < all.size(); i++) {
+    double r = LossRate(all[i]);
+    if ((r > 2 * loss && r > loss + kLossMargin) ||
+        (rtt > 0 && all[i].srtt > kRttFactor * rtt)) {
+      flows->push_back(i);
+    }
+  }
+}
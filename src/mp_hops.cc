@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "mp_hops.h"
+#include "log.h"
+
+namespace {
+
+// enough for the p99 of a hop, bounds memory on long runs
+const size_t kMaxSamples = 4096;
+
+// |p| quantile of |v|, reorders |v|.  -1 when empty.
+double Quantile(std::vector<double> *v, double p) {
+  if (v->empty())
+    return -1.0;
+
+  size_t k = std::min(v->size() - 1, static_cast<size_t>(p * v->size()));
+  std::nth_element(v->begin(), v->begin() + k, v->end());
+  return (*v)[k];
+}
+
+}  // namespace
+
+MpingHopStats::MpingHopStats(int max_ttl)
+    : max_ttl_(max_ttl),
+      rng_(88172645463325252ULL),
+      hops_(max_ttl) {
+  ASSERT(max_ttl_ > 0);
+}
+
+void MpingHopStats::OnSend(uint64_t seq) {
+  hops_[TtlFor(seq) - 1].sent++;
+}
+
+void MpingHopStats::OnRecv(uint64_t seq, const std::string& from,
+                           double rtt) {
+  Hop& hop = hops_[TtlFor(seq) - 1];
+  hop.received++;
+  hop.from[from]++;
+
+  // reservoir sampling keeps every reply equally likely in the sample
+  hop.seen++;
+  if (hop.rtts.size() < kMaxSamples) {
+    hop.rtts.push_back(rtt);
+  } else {
+    rng_ ^= rng_ << 13;
+    rng_ ^= rng_ >> 7;
+    rng_ ^= rng_ << 17;
+    uint64_t slot = rng_ % hop.seen;
+    if (slot < kMaxSamples)
+      hop.rtts[slot] = rtt;
+  }
+}
+
+void MpingHopStats::Print(const std::string& dst_addr) {
+  std::cout << std::left << std::setw(4) << "Hop" << std::setw(40) <<
+               "Address" << std::right << std::setw(8) << "Sent" <<
+               std::setw(8) << "Recv" << std::setw(8) << "Loss%" <<
+               std::setw(9) << "Min" << std::setw(9) << "p50" <<
+               std::setw(9) << "p90" << std::setw(9) << "p99" <<
+               std::setw(9) << "Queue" << std::endl;
+
+  std::cout << std::fixed << std::setprecision(2);
+  for (int ttl = 1; ttl <= max_ttl_; ttl++) {
+    Hop& hop = hops_[ttl - 1];
+
+    // the responder that answered most, "+n" for others (ECMP, MPLS)
+    std::string addr = "*";
+    uint64_t most = 0;
+    for (std::map<std::string, uint64_t>::const_iterator it =
+             hop.from.begin(); it != hop.from.end(); ++it) {
+      if (it->second > most) {
+        most = it->second;
+        addr = it->first;
+      }
+    }
+    if (hop.from.size() > 1) {
+      std::ostringstream others;
+      others << addr << " +" << hop.from.size() - 1;
+      addr = others.str();
+    }
+
+    double loss = hop.sent ?
+        100.0 * (hop.sent - std::min(hop.received, hop.sent)) / hop.sent : 0;
+    double p50 = Quantile(&hop.rtts, 0.5);
+    double p90 = Quantile(&hop.rtts, 0.9);
+    double p99 = Quantile(&hop.rtts, 0.99);
+    double min = hop.rtts.empty() ? -1.0 :
+                 *std::min_element(hop.rtts.begin(), hop.rtts.end());
+
+    std::cout << std::left << std::setw(4) << ttl << std::setw(40) << addr <<
+                 std::right << std::setw(8) << hop.sent << std::setw(8) <<
+                 hop.received << std::setw(8) << loss << std::setw(9) <<
+                 min << std::setw(9) << p50 << std::setw(9) << p90 <<
+                 std::setw(9) << p99 << std::setw(9) <<
+                 (min >= 0 ? p50 - min : -1.0) << std::endl;
+
+    if (hop.from.count(dst_addr))
+      break;
+  }
+  std::cout.unsetf(std::ios::floatfield);
+  std::cout << std::setprecision(6);
+}
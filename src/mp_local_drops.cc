@@ -0,0 +1,114 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if defined(OS_LINUX)
+#include <linux/sock_diag.h>
+#endif
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "mp_local_drops.h"
+#include "log.h"
+
+namespace {
+
+const char *kProcTables[] = {
+  "/proc/net/raw", "/proc/net/raw6", "/proc/net/udp", "/proc/net/udp6"
+};
+
+const size_t kInodeColumn = 9;
+
+}  // namespace
+
+size_t MpingSizeRecvBuffer(int fd, size_t bytes) {
+  int want = bytes > INT_MAX / 2 ? INT_MAX / 2 : static_cast<int>(bytes);
+  bool set = false;
+#if defined(SO_RCVBUFFORCE)
+  set = setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &want, sizeof(want)) == 0;
+#endif
+  if (!set && setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &want, sizeof(want)) < 0) {
+    LOG(mlab::WARNING, "set receive buffer fails. %s [%d]", strerror(errno),
+        errno);
+  }
+
+  int got = 0;
+  socklen_t len = sizeof(got);
+  if (getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &got, &len) < 0)
+    return 0;
+  return got / 2;
+}
+
+bool MpingEnableRxqOverflow(int fd) {
+#if defined(SO_RXQ_OVFL)
+  int on = 1;
+  return setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) == 0;
+#else
+  return false;
+#endif
+}
+
+bool MpingRxqOverflow(const struct msghdr *msg, uint32_t *drops) {
+#if defined(SO_RXQ_OVFL)
+  for (struct cmsghdr *c = CMSG_FIRSTHDR(const_cast<struct msghdr *>(msg));
+       c; c = CMSG_NXTHDR(const_cast<struct msghdr *>(msg), c)) {
+    if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL &&
+        c->cmsg_len >= CMSG_LEN(sizeof(*drops))) {
+      memcpy(drops, CMSG_DATA(c), sizeof(*drops));
+      return true;
+    }
+  }
+#endif
+  return false;
+}
+
+bool MpingSocketDrops(int fd, uint32_t *drops) {
+#if defined(SO_MEMINFO) && defined(OS_LINUX)
+  uint32_t meminfo[SK_MEMINFO_VARS];
+  socklen_t len = sizeof(meminfo);
+  if (getsockopt(fd, SOL_SOCKET, SO_MEMINFO, meminfo, &len) == 0 &&
+      len > SK_MEMINFO_DROPS * sizeof(uint32_t)) {
+    *drops = meminfo[SK_MEMINFO_DROPS];
+    return true;
+  }
+#endif
+
+  struct stat st;
+  if (fstat(fd, &st) < 0)
+    return false;
+  for (size_t i = 0; i < sizeof(kProcTables) / sizeof(kProcTables[0]); i++) {
+    std::ifstream table(kProcTables[i]);
+    if (table && MpingProcNetDrops(table, st.st_ino, drops))
+      return true;
+  }
+  return false;
+}
+
+bool MpingProcNetDrops(std::istream& table, unsigned long inode,
+                       uint32_t *drops) {
+  std::string line;
+  std::getline(table, line);  // the column names
+  while (std::getline(table, line)) {
+    std::istringstream in(line);
+    std::vector<std::string> columns;
+    std::string column;
+    while (in >> column)
+      columns.push_back(column);
+
+    // sl local rem st tx:rx tr:when retrnsmt uid timeout inode ref
+    // pointer drops
+    if (columns.size() <= kInodeColumn + 3)
+      continue;
+    if (strtoul(columns[kInodeColumn].c_str(), NULL, 10) != inode)
+      continue;
+
+    *drops = strtoul(columns.back().c_str(), NULL, 10);
+    return true;
+  }
+  return false;
+}
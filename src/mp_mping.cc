@@ -2,14 +2,33 @@
 #include <signal.h>
 #include <stdio.h>
 #include <string.h>
-#include <sys/time.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
 #include <set>
-
+#include <vector>
+
+#include "mp_busy_poll.h"
+#include "mp_campaign.h"
+#include "mp_clock.h"
+#include "mp_eyeballs.h"
+#include "mp_flows.h"
+#include "mp_hops.h"
 #include "mp_mping.h"
+#include "mp_payload.h"
+#include "mp_probe_loop.h"
+#include "mp_profile.h"
+#include "mp_queue.h"
 #include "mp_socket.h"
 #include "mp_stats.h"
+#include "mp_search.h"
+#include "mp_shm.h"
+#include "mp_sweep.h"
+#include "mp_switching.h"
+#include "mp_transport.h"
+#include "mp_window.h"
 #include "log.h"
 #include "scoped_ptr.h"
 #include "mlab/accepted_socket.h"
@@ -26,35 +45,153 @@ namespace {
       -f          Loop forever (Don't increment # messages in transit)\n\
       -R <rate>   Rate at which to limit number of messages in transit\n\
       -S          Use a TCP style slowstart\n\
+      -Q <q>[ms]  Adjust the window every RTT to hold a standing queue of\n\
+                  <q> packets, or <q> ms of queueing delay.  Forces -f,\n\
+                  -n is the largest window\n\
+      -K          Search for the throughput knee and the buffer size per\n\
+                  message size instead of stepping through every window\n\
+                  up to -n\n\
+      -P <us>     Spin up to <us> microseconds for each reply before\n\
+                  blocking, with SO_BUSY_POLL on the receive socket\n\
+      -U          Send and receive through io_uring where the kernel has\n\
+                  it (Linux 6.0), plain sockets otherwise.  Not with -a\n\
+      -X          Time the send, receive, parse, stats and print phases\n\
+                  of the probe or server loop, histograms at the end\n\
 \n\
       -t <ttl>    Send UDP packets (instead of ICMP) with a TTL of <ttl>\n\
       -a <ttlmax> Auto-increment TTL up to ttlmax.  Forces -t\n\
+      -H          With -a, probe all TTLs at once and print a table of\n\
+                  loss, RTT and queueing per hop\n\
 \n\
       -b <len>    Message length in bytes, including IP header, etc\n\
       -b -<sel>   Loop through message sizes: -1:selected sizes\n\
                   or steps of: -2:64 -3:128 -4:256\n\
+      -I          With -b -<sel>, interleave all the sizes in one window\n\
+                  instead of one size after the other, stats per size\n\
       -B <bnum>   Send <bnum> packets in burst, should smaller than <num>\n\
+      -E <k>      Spread probes over <k> flows, by ICMP identifier or UDP\n\
+                  destination port, stats per flow\n\
       -p <port>   If UDP, destination port number\n\
 \n\
       -s <sport>  Server mode, liten on UDP <sport>\n\
       -4          Server mode, use IPv4\n\
       -6          Server mode, use IPv6\n\
       -c          Client mode, sending with UDP to a server running -s\n\
+      -T <ms>     Declare a probe lost after <ms>, default from the RTT\n\
+                  and its variance\n\
+      -L          Legacy payload: 32 bit sequence, no session nonce,\n\
+                  for servers and parsers older than the 64 bit one\n\
+      -M <name>   Publish live counters in shared memory segment <name>,\n\
+                  see mping_shm_reader\n\
+\n\
+      -C <file>   Run the probes of campaign <file> from one process,\n\
+                  one per line: <start s> <duration s> <switches> <host>\n\
+      -j <num>    Campaign: run up to <num> probes at once (16)\n\
+      -J <num>    Campaign: run up to <num> probes at once to one host (1)\n\
+      -G <sec>    Campaign: start probes to one host <sec> apart (0)\n\
 \n\
       -V, -d  Version, Debug (verbose)\n\
 \n\
       -F <addr>   Select a source interface\n\
+      -D          Probe the host's IPv4 and IPv6 address side by side,\n\
+                  stats for each\n\
       <host>     Target host\n";
 
 const size_t kMaxBuffer = 9000;  // > 2 FDDI?
-const int kNbTab[] = {64, 100, 500, 1000, 1500, 2000, 3000, 4000, 0};
 const char *kVersion = "mping version: 2.0 (2013.06)";
-const int kDefaultTTL = 255;
 
 int haltf;
-int tick;
+uint64_t tick;  // end of the current second in ns, 0 to resync
 bool timedout;
 
+void PublishStats(MpingShmWriter *shm, const MpingStat& stat, uint64_t now,
+                  MpingShmStats *snapshot) {
+  stat.Snapshot(snapshot);
+  snapshot->updated_ns = now;
+  shm->Publish(*snapshot);
+}
+
+// What GoProbing does for each probe beyond MpingStat, each part NULL
+// while its switch is off.
+class ToolHooks : public MpingProbeHooks {
+  public:
+    ToolHooks()
+        : transport(NULL), loop(NULL), stat(NULL), hops(NULL), sweep(NULL),
+          spread(NULL), busy(NULL), shm(NULL), snapshot(NULL), queue(NULL),
+          fit(NULL), winctl(NULL), search(NULL), packet_size(0),
+          window(NULL) { }
+
+    virtual void BeforeSend(uint64_t seq, size_t *size) {
+      if (hops)
+        transport->SetSendTTL(hops->TtlFor(seq));
+      if (sweep)
+        *size = sweep->SizeFor(seq);
+    }
+
+    virtual void OnSend(uint64_t seq, uint64_t now) {
+      if (hops)
+        hops->OnSend(seq);
+      if (sweep)
+        sweep->EnqueueSend(seq, now);
+      if (spread)
+        spread->EnqueueSend(seq, now);
+    }
+
+    virtual void OnReply(uint64_t seq, uint64_t now, uint64_t send_time,
+                         double rtt) {
+      if (sweep)
+        sweep->EnqueueRecv(seq, now, send_time);
+      if (spread)
+        spread->EnqueueRecv(seq, now, send_time);
+      if (shm)
+        PublishStats(shm, *stat, now, snapshot);
+      if (rtt < 0)  // duplicate, late or not ours
+        return;
+
+      size_t size = sweep ? sweep->SizeFor(seq) : packet_size;
+      if (busy)
+        busy->OnRtt(rtt);
+      if (queue)
+        queue->OnRecv(rtt, size);
+      if (fit)
+        fit->OnRtt(size, rtt);
+      if (hops)
+        hops->OnRecv(seq, transport->GetFromAddress(), rtt);
+
+      if (winctl) {
+        winctl->OnRecv(seq, rtt, loop->sent());
+        if (*window > 0)  // 0 drains the tail, keep it
+          *window = winctl->window();
+      }
+      if (search) {
+        search->OnRecv(seq, rtt, now, loop->sent());
+        if (*window > 0)
+          *window = search->done() ? 0 : search->window();
+      }
+    }
+
+    MpingTransport *transport;
+    MpingProbeLoop *loop;
+    MpingStat *stat;
+    MpingHopStats *hops;
+    MpingSizeSweep *sweep;
+    MpingFlowSpread *spread;
+    MpingBusyPoll *busy;
+    MpingShmWriter *shm;
+    MpingShmStats *snapshot;
+    MpingQueueEst *queue;
+    MpingSwitchingFit *fit;
+    MpingWindowCtl *winctl;
+    MpingKneeSearch *search;  // of the current size
+    size_t packet_size;  // of the current size, without -I
+    uint16_t *window;  // in transit, GoProbing's
+};
+
+void recv_timedout() {
+  timedout = true;
+  tick = 0;
+}
+
 void ring(int signo) {
   struct sigaction sa, osa;
   sigemptyset(&sa.sa_mask);
@@ -63,8 +200,7 @@ void ring(int signo) {
   if (sigaction(SIGALRM, &sa, &osa) < 0) {
     LOG(mlab::FATAL, "sigaction SIGALRM. %s [%d]", strerror(errno), errno);
   }
-  timedout = true;
-  tick = 0;
+  recv_timedout();
 }
 
 void halt(int signo) {
@@ -87,11 +223,37 @@ void halt(int signo) {
 }  // namespace
 
 void MPing::Run() {
+  if (!config.campaign.empty()) {
+    RunCampaign();
+    return;
+  }
+
   if (dest_ips.empty()) {
     LOG(mlab::ERROR, "No target address.");
     return;
   }
 
+  // preferred first, then those that answer first, then the rest
+  std::vector<std::string> ordered;
+  MpingSortAddresses(dest_ips, &ordered);
+  std::vector<std::string> targets;
+  if (!transport && (ordered.size() > 1 || config.dual_stack)) {
+    RaceAddresses(ordered, &targets);
+    if (targets.empty())
+      LOG(mlab::WARNING, "No address answers, trying them in turn.");
+  }
+  for (size_t i = 0; i < ordered.size(); i++) {
+    if (std::find(targets.begin(), targets.end(), ordered[i]) ==
+        targets.end()) {
+      targets.push_back(ordered[i]);
+    }
+  }
+
+  if (config.dual_stack) {
+    RunDualStack(targets);
+    return;
+  }
+
   struct sigaction sa, osa;
   sigemptyset(&sa.sa_mask);
   sa.sa_handler = ring;
@@ -106,8 +268,8 @@ void MPing::Run() {
   }
   haltf = 0;
 
-  for (std::set<std::string>::iterator it = dest_ips.begin();
-       it != dest_ips.end(); ++it) {
+  for (std::vector<std::string>::iterator it = targets.begin();
+       it != targets.end(); ++it) {
     LOG(mlab::INFO, "destination IP: %s", it->c_str());
 
     if (GoProbing(*it) < 0) {
@@ -119,24 +281,106 @@ void MPing::Run() {
   }
 }
 
+void MPing::RaceAddresses(const std::vector<std::string>& ordered,
+                          std::vector<std::string> *responsive) {
+  std::vector<MpingSocket*> sockets;
+  std::vector<MpingTransport*> transports;
+  for (size_t i = 0; i < ordered.size(); i++) {
+    sockets.push_back(new MpingSocket);
+    sockets.back()->SetLegacySeq(config.legacy_seq);
+    transports.push_back(sockets.back());
+  }
+
+  MpingRaceAddresses(ordered, transports, config, config.dual_stack,
+                     responsive);
+  for (size_t i = 0; i < responsive->size(); i++)
+    LOG(mlab::INFO, "%s answers.", (*responsive)[i].c_str());
+
+  for (size_t i = 0; i < sockets.size(); i++)
+    delete sockets[i];
+}
+
+void MPing::RunDualStack(const std::vector<std::string>& targets) {
+  // the first of each family is the one that answered, if any did
+  std::vector<std::string> picked;
+  for (size_t i = 0; i < targets.size(); i++) {
+    SocketFamily family = mlab::GetSocketFamilyForAddress(targets[i]);
+    bool seen = false;
+    for (size_t j = 0; j < picked.size(); j++)
+      seen = seen || mlab::GetSocketFamilyForAddress(picked[j]) == family;
+    if (!seen)
+      picked.push_back(targets[i]);
+  }
+  if (picked.size() < 2) {
+    LOG(mlab::WARNING, "%s has only one address family.",
+        config.dst_host.c_str());
+  }
+
+  MpingCampaign campaign(picked.size(), 1, 0, NULL);
+  std::string error;
+  if (campaign.Init(&error) < 0) {
+    LOG(mlab::ERROR, "%s", error.c_str());
+    return;
+  }
+  for (size_t i = 0; i < picked.size(); i++) {
+    MpingProbeSpec spec;
+    spec.config = config;
+    spec.config.dual_stack = false;
+    spec.config.dst_host = picked[i];
+    spec.target = picked[i];
+    campaign.Add(spec);
+  }
+
+  int failed = campaign.Run();
+  if (failed > 0)
+    LOG(mlab::ERROR, "%d of %lu families failed.", failed, picked.size());
+}
+
+void MPing::RunCampaign() {
+  std::ifstream in(config.campaign.c_str());
+  if (!in) {
+    LOG(mlab::ERROR, "Cannot read campaign %s.", config.campaign.c_str());
+    return;
+  }
+
+  std::vector<MpingProbeSpec> specs;
+  std::string error;
+  if (MpingReadCampaign(in, &specs, &error) < 0) {
+    LOG(mlab::ERROR, "%s %s", config.campaign.c_str(), error.c_str());
+    return;
+  }
+
+  MpingCampaign campaign(config.max_sessions, config.max_per_host,
+                         config.host_gap, NULL);
+  if (campaign.Init(&error) < 0) {
+    LOG(mlab::ERROR, "%s", error.c_str());
+    return;
+  }
+  for (size_t i = 0; i < specs.size(); i++)
+    campaign.Add(specs[i]);
+
+  int failed = campaign.Run();
+  LOG(mlab::INFO, "campaign done, %d of %lu probes failed.", failed,
+      specs.size());
+}
+
 void MPing::RunServer() {
   bool have_data = false;
-  size_t packet_size = std::max(kMaxBuffer, pkt_size);
-  const char *PayloadHeader = "mlab-seq#";
-  const int PayloadHeaderLength = 9;
-
+  size_t packet_size = std::max(kMaxBuffer, config.pkt_size);
   int unexpected = 0;
   int seq_recv = 0;
   int sent_back = 0;
   int total_recv = 0;
   int out_of_order = 0;
-  unsigned int mrseq = 0;  // sequence number starts from 1.
+  uint64_t mrseq = 0;  // sequence number starts from 1.
+  MpingProfile profile;
+  profile.Enable(config.profile);
 
-  LOG(mlab::INFO, "Running server mode, port %u.", server_port);
+  LOG(mlab::INFO, "Running server mode, port %u.", config.server_port);
 
   // create server socket
   scoped_ptr<mlab::ListenSocket> mylistensock(mlab::ListenSocket::CreateOrDie(
-      server_port, SOCKETTYPE_UDP, server_family));
+      config.server_port, SOCKETTYPE_UDP, config.server_family));
 
   scoped_ptr<mlab::AcceptedSocket> mysock(mylistensock->Accept());
 
@@ -156,15 +400,18 @@ void MPing::RunServer() {
   while (1) {
     errno = 0;
     ssize_t recv_bytes = 0;
+    uint64_t phase = profile.Start();
     mlab::Packet recv_packet = mysock->Receive(packet_size, &recv_bytes);
     if (recv_bytes < 0) {
       if (errno == EAGAIN) {
         if (have_data) {
-          // print stats
+          // print stats, the client is done
           std::cout << "Total received=" << total_recv << " seq received=" <<
                        seq_recv << " send back=" << sent_back <<
                        " total out-of-order=" << out_of_order <<
                        " total unexpected=" << unexpected << std::endl;
+          if (profile.enabled())
+            profile.Print();
           have_data = false;
         } else {
           continue;
@@ -174,70 +421,133 @@ void MPing::RunServer() {
       }
     }
 
+    profile.Stop(MpingProfile::kReceive, phase);
     total_recv++;
 
-    if (recv_packet.length() < (PayloadHeaderLength + sizeof(unsigned int))) {
-      LOG(mlab::VERBOSE, "recv a packet smaller than min size.");
-      unexpected++;
-      continue;
-    }
-
-    std::string head(recv_packet.buffer(), PayloadHeaderLength);
-    if (head.compare(PayloadHeader) != 0){
+    // echo either payload format, see mp_payload.h
+    bool legacy;
+    uint32_t nonce;
+    uint64_t rseq, send_time;
+    phase = profile.Start();
+    bool ours = MpingReadPayload(recv_packet.buffer(), recv_packet.length(),
+                                 &legacy, &nonce, &rseq, &send_time);
+    profile.Stop(MpingProfile::kParse, phase);
+    if (!ours) {
       LOG(mlab::VERBOSE, "recv a packet not for this program.");
       unexpected++;
       continue;
     }
 
+    phase = profile.Start();
     have_data = true;
     seq_recv++;
-    const unsigned int *seq =
-        reinterpret_cast<const unsigned int*>(recv_packet.buffer() +
-                                              PayloadHeaderLength);
-
-    unsigned int rseq = ntohl(*seq);
     if (mrseq > rseq) {
       out_of_order++;
     } else {
       mrseq = rseq;
     }
+    profile.Stop(MpingProfile::kStats, phase);
 
+    phase = profile.Start();
     mysock->Send(recv_packet, NULL);
+    profile.Stop(MpingProfile::kSend, phase);
     sent_back++;
   }
 }
 
 bool MPing::IsServerMode() const {
-  return (server_port > 0);
+  return (config.server_port > 0);
 }
 
 int MPing::GoProbing(const std::string& dst_addr) {
   size_t maxsize;
-  unsigned int sseq = 0;  // send sequence
-  unsigned int mrseq = 0;  // recv sequence
-  bool start_burst = false;  // set true when win_size > burst size
   timedout = true;
+  tick = 0;
 
-  maxsize = std::max(pkt_size, kMaxBuffer);
-
-  scoped_ptr<MpingSocket> mysock(new MpingSocket);
+  maxsize = std::max(config.pkt_size, kMaxBuffer);
+  MpingProfile profile;
+  profile.Enable(config.profile);
+
+  scoped_ptr<MpingSocket> ownsock(transport ? NULL : new MpingSocket);
+  MpingTransport *mysock = transport ? transport : ownsock.get();
+  if (ownsock.get()) {
+    ownsock->SetBusyPoll(config.busy_poll);
+    ownsock->SetLegacySeq(config.legacy_seq);
+    ownsock->SetFlows(config.flows);
+    ownsock->SetUring(config.io_uring);
+    ownsock->SetProfile(&profile);
+  }
 
   if (mysock->Initialize(
-          dst_addr, src_addr, ttl, maxsize, win_size, dport, client_mode) < 0) {
+          dst_addr, config.src_addr, config.ttl, maxsize, config.win_size,
+          config.dport, config.client_mode) < 0) {
     return -1;
   }
-
-  scoped_ptr<MpingStat> mystat(new MpingStat(win_size));
+  if (!transport)
+    LOG(mlab::VERBOSE, "clock source: %s", MpingClock::Source());
+  MpingBusyPoll *busy = ownsock.get() ? ownsock->busy_poll() : NULL;
+
+  scoped_ptr<MpingStat> mystat(
+      new MpingStat(config.win_size, config.legacy_seq));
+  mystat->SetLossTimeout(config.loss_timeout);
+
+  scoped_ptr<MpingShmWriter> shm(config.shm_name.empty() ? NULL :
+                                                         new MpingShmWriter);
+  MpingShmStats snapshot;
+  memset(&snapshot, 0, sizeof(snapshot));
+  snapshot.pid = getpid();
+  if (shm.get() && shm->Open(config.shm_name) < 0) {
+    return -1;
+  }
+  scoped_ptr<MpingWindowCtl> winctl(config.target_queue > 0 ?
+      new MpingWindowCtl(config.win_size, config.target_queue,
+                         config.target_queue_ms) : NULL);
+  scoped_ptr<MpingHopStats> hops(config.all_hops ?
+                                 new MpingHopStats(config.ttl) : NULL);
+  if (hops.get())  // replies of near hops overtake far ones
+    mystat->SetReorderThreshold(0);
+
+  std::vector<size_t> sizes;
+  for (int ix = 0;
+       config.interleave_sizes && MpingSweepSize(config.loop_size, ix); ix++)
+    sizes.push_back(MpingSweepSize(config.loop_size, ix));
+  scoped_ptr<MpingSizeSweep> sweep(config.interleave_sizes ?
+      new MpingSizeSweep(sizes, config.win_size, config.legacy_seq,
+                         config.loss_timeout) : NULL);
+  scoped_ptr<MpingFlowSpread> spread(config.flows > 1 ?
+      new MpingFlowSpread(config.flows, config.win_size, config.legacy_seq,
+                          config.loss_timeout) : NULL);
+  scoped_ptr<MpingSwitchingFit> fit(config.loop_size < 0 ?
+                                    new MpingSwitchingFit : NULL);
+  // every hop has its own RTT, no single queue to speak of
+  scoped_ptr<MpingQueueEst> queue(hops.get() ? NULL : new MpingQueueEst);
+
+  MpingProbeLoop loop(config, mysock, mystat.get());
+  loop.SetProfile(&profile);
+  ToolHooks tool;
+  tool.transport = mysock;
+  tool.loop = &loop;
+  tool.stat = mystat.get();
+  tool.hops = hops.get();
+  tool.sweep = sweep.get();
+  tool.spread = spread.get();
+  tool.busy = busy;
+  tool.shm = shm.get();
+  tool.snapshot = &snapshot;
+  tool.queue = queue.get();
+  tool.fit = fit.get();
+  tool.winctl = winctl.get();
+  loop.SetHooks(&tool);
 
   int tempttl = 1;
-  if (inc_ttl == 0)
-    tempttl = ttl;
+  if (config.inc_ttl == 0 || hops.get())  // one pass, the TTL goes per packet
+    tempttl = config.ttl;
 
   // first loop: ttl
-  for (; tempttl <= ttl; tempttl++) {
+  for (; tempttl <= config.ttl; tempttl++) {
     if (haltf > 1) break;
 
-    if (ttl) {
+    if (config.ttl) {
       mysock->SetSendTTL(tempttl);
     }
 
@@ -249,69 +559,72 @@ int MPing::GoProbing(const std::string& dst_addr) {
 
       // current packet size, include IP header length
       size_t packet_size = 0;
-      if (pkt_size > 0) {  // set packet size: use static packet size
-        packet_size = pkt_size;
+      if (config.pkt_size > 0) {  // set packet size: use static packet size
+        packet_size = config.pkt_size;
+        if (nbix != 0)
+          break;
+      } else if (sweep.get()) {  // set packet size: all at once
+        packet_size = sweep->max_size();
         if (nbix != 0)
           break;
       } else {  // set packet size: increase packet size
-        if (loop_size == -1) {
-          if (kNbTab[nbix] == 0)
-            break;
-
-          packet_size = kNbTab[nbix];
-        } else if (loop_size == -2) {
-          if ((nbix+1)*64 > 1500)
-            break;
-
-          packet_size = (nbix+1)*64;
-        } else if (loop_size == -3) {
-          if ((nbix+1)*128 > 2048)
-            break;
-
-          packet_size = (nbix+1)*128;
-        } else if (loop_size == -4) {
-          if ((nbix+1)*256 > 4500)
-            break;
-
-          packet_size = (nbix+1)*256;
-        } else {
+        if (config.loop_size < -4 || config.loop_size > -1) {
           LOG(mlab::FATAL, "Wrong loop throught message size %d.\n%s",
-              loop_size, usage);
+              config.loop_size, usage);
         }
+
+        packet_size = MpingSweepSize(config.loop_size, nbix);
+        if (packet_size == 0)
+          break;
       }  // end of set packet size
 
+      scoped_ptr<MpingKneeSearch> search(config.knee_search ?
+          new MpingKneeSearch(config.win_size, packet_size, loop.sent()) :
+          NULL);
+      tool.search = search.get();
+      tool.packet_size = packet_size;
+
       // third loop: window size
       // no -f flag:        1,2,3,....,win_size,0,break
       // -f w/ other loops: win_size,break
       // -f no other loops: win_size,win_size,...<interrupt>,0,break
       // 0 is to collect all trailing messages still in transit
       uint16_t intran;  // current window size
-      for (intran = loop?win_size:1; intran; intran?intran++:0) {
+      tool.window = &intran;
+      for (intran = config.loop?config.win_size:1; intran; intran?intran++:0) {
         int mustsend = 0;
-        struct timeval now;
+        uint64_t now = mysock->NowNs();
 
         if (haltf)
           intran = 0;
 
-        if (intran > win_size) {
-          if (loop) {
-            if (inc_ttl > 0 || loop_size < 0)
+        if (intran > 0 && search.get()) {
+          intran = search->done() ? 0 : search->window();
+        }
+
+        if (intran > config.win_size) {
+          if (config.loop) {
+            if (config.inc_ttl > 0 || config.loop_size < 0)
               break;
             else
-              intran = win_size;
+              intran = config.win_size;
           } else {
             intran = 0;
           }
         }
 
+        if (intran > 0 && winctl.get()) {
+          intran = winctl->window();
+        }
+
         if (intran > 0 && timedout) {
           mustsend = 1;
           timedout = false;
         }
 
         // printing
-        if (!loop || inc_ttl > 0 || loop_size < 0) {
-          if (ttl > 0) {
+        if (!config.loop || config.inc_ttl > 0 || config.loop_size < 0) {
+          if (config.ttl > 0) {
             LOG(mlab::INFO, "ttl %d, packet size %lu, window size %d",
                 tempttl, packet_size, intran);
           } else {
@@ -323,125 +636,132 @@ int MPing::GoProbing(const std::string& dst_addr) {
        // if (tick == 0) {
        //   LOG(mlab::INFO, "tick is 0 now.");
        // }
-        if (!tick) {  // sync to system clock
-          gettimeofday(&now, 0);
-          tick = now.tv_sec;
-          while (tick >= now.tv_sec) {
-            gettimeofday(&now, 0);
-          }
+        if (!tick) {  // sync to the next whole second of the clock
+          tick = (now / kNsPerSec + 1) * kNsPerSec;
+          mysock->WaitUntil(tick);
+          now = mysock->NowNs();
         }
 
-        alarm(2);  // reset each time called, recv timeout if recv block
+        // reset each time called, recv timeout if recv block
+        mysock->ArmRecvTimeout(2);
 
         // fourth loop: with in 1 sec
-        tick++;
+        tick += kNsPerSec;
 
 #ifdef MP_PRINT_TIMELINE
-        int out = 0;  // for debug
+        uint64_t first_seq = loop.sent();  // for debug
 #endif
-        while (tick >= now.tv_sec) {
-          int maxopen;
-          unsigned int rseq;
+        while (now < tick) {
           int err;
-          bool timeout = false;
-          int diff, need_send = 0;
-
-          // send
-          if (burst ==  0 || !start_burst) {  // no burst
-            maxopen = slow_start?2:10;
-            diff = (int)(sseq - mrseq - intran);
-            need_send = (diff < 0)?std::min(maxopen, (0-diff)):mustsend;
-          } else {  // start burst, now we have built the window
-            diff = (int)(sseq - mrseq + burst - intran);
-            need_send = (diff > 0)?mustsend:burst;
+          bool bursting = loop.bursting();
+          if (loop.Send(intran, mustsend, packet_size, &err) < 0) {
+            LOG(mlab::FATAL, "send fails. %s [%d]", strerror(err), err);
           }
-
           mustsend = 0;
-
-          while (need_send > 0) {
-            sseq++;
-            bool success = mysock->SendPacket(sseq, packet_size, &err);
-
-            if (!success) {  // send fails
-              if (err != EINTR) {
-                if (err == ENOBUFS) {
-                  LOG(mlab::INFO, "send buffer run out.");
-                  maxopen = 0;
-                  sseq--;
-                } else {
-                  if (err != ECONNREFUSED) {  // because we connect on UDP sock
-                    LOG(mlab::FATAL, "send fails. %s [%d]", strerror(err), err);
-                  } else {
-                    sseq--;
-                  }
-                }
-              }
-              else {
-                timeout = true;
-                break;
-              }
-            } else {  // send success, update counters
-              gettimeofday(&now, 0);
-              mystat->EnqueueSend(sseq, now);
-#ifdef MP_PRINT_TIMELINE
-              out++;
-#endif
-
-              if (burst > 0 && intran >= burst &&
-                  !start_burst && (sseq-mrseq-intran) == 0) {
-                // let the on-flight reach window size, then start burst
-                LOG(mlab::INFO, "start burst, window %d, burst %d",
-                    intran, burst);
-                start_burst = true;  // once set, stay true
-              }
-              need_send--;
-            }
+          if (!bursting && loop.bursting()) {
+            LOG(mlab::INFO, "start burst, window %d, burst %d",
+                intran, config.burst);
           }
-
-          if (timeout) {
+          if (err == ENOBUFS) {
+            LOG(mlab::INFO, "send buffer run out.");
+          } else if (err == EINTR) {
             LOG(mlab::INFO, "send being interrupted.");
             break;  // almost never happen
           }
 
-          // recv
-          rseq = mysock->ReceiveAndGetSeq(&err, mystat.get());
-          if (err != 0) {
-            //if (err == EINTR)
-             // continue;
-           // else
-            if (err != EINTR)
-              LOG(mlab::FATAL, "recv fails. %s [%d]", strerror(err), err);
-          } else {
-            gettimeofday(&now, 0);
-            mystat->EnqueueRecv(rseq, now);
-
-            if ((int)(sseq - rseq) < 0) {
-              LOG(mlab::ERROR, "recv a seq larger than sent %d %d %d",
-                  mrseq, rseq, sseq);
-            } else {
-              mrseq = rseq;
-            }
+          // recv; with the window full, wake up for the next timeout so
+          // its credit is not held until some reply comes
+          uint64_t rseq;
+          double rtt;
+          mysock->SetRecvDeadline(
+              mystat->in_flight() >= intran ? mystat->next_timeout() : 0);
+          if (loop.Receive(&rseq, &rtt, &err) < 0) {
+            LOG(mlab::FATAL, "recv fails. %s [%d]", strerror(err), err);
+          } else if (err == ETIMEDOUT) {  // without SIGALRM, see transport
+            recv_timedout();
           }
 #ifdef MP_PRINT_TIMELINE
-          if (out >= 50) {
+          if (loop.sent() - first_seq >= 50) {
             break;
           }
 #endif
-          gettimeofday(&now, 0);
+          now = mysock->NowNs();
         }  // end of fourth loop: time tick
 
+        uint64_t phase = profile.Start();
+        if (winctl.get()) {
+          winctl->PrintTempStats(packet_size);
+        }
+        if (search.get()) {
+          search->OnTick(loop.sent());
+        }
+        if (busy) {
+          busy->PrintTempStats();
+        }
+        mystat->Expire(mysock->NowNs());
+        uint64_t drops;
+        if (mysock->TakeLocalDrops(&drops))  // not the path's loss
+          mystat->OnLocalDrops(drops);
+        if (queue.get()) {
+          queue->OnTick(1.0, mystat->lost_temp());
+          queue->PrintTempStats();
+        }
         mystat->PrintTempStats();
+        if (shm.get()) {
+          PublishStats(shm.get(), *mystat.get(), mysock->NowNs(), &snapshot);
+        }
+        if (sweep.get()) {
+          sweep->Expire(mysock->NowNs());
+          sweep->PrintTempStats();
+        }
+        if (spread.get()) {
+          spread->Expire(mysock->NowNs());
+          spread->PrintTempStats();
+        }
+        if (fit.get()) {
+          fit->OnTick(sweep.get() ? 0 : packet_size, 1.0);
+          fit->PrintTempStats();
+        }
+        profile.Stop(MpingProfile::kPrint, phase);
       }  // end of third loop: window size
+
+      if (search.get()) {
+        search->PrintResult();
+      }
+      if (fit.get() && !sweep.get()) {
+        fit->EndSize(packet_size);
+      }
     }  // end of second loop: buffer size
 
-    if (inc_ttl > 0) {
+    if (config.inc_ttl > 0 && !hops.get()) {
       LOG(mlab::INFO, "From %s", mysock->GetFromAddress().c_str());
     }
 
     if (haltf == 1) haltf = 0;
   }  // end of first loop: ttl
 
+  uint64_t drops;
+  if (mysock->TakeLocalDrops(&drops))
+    mystat->OnLocalDrops(drops);
   mystat->PrintStats();
+  if (queue.get()) {
+    queue->PrintStats();
+  }
+  if (sweep.get()) {
+    sweep->PrintStats();
+  }
+  if (spread.get()) {
+    spread->PrintStats();
+  }
+  if (fit.get()) {
+    fit->PrintTempStats();
+  }
+  if (hops.get()) {
+    hops->Print(dst_addr);
+  }
+  if (profile.enabled()) {
+    profile.Print();
+  }
 
 #ifdef MP_PRINT_TIMELINE
   mystat->PrintTimeLine();
@@ -451,101 +771,21 @@ int MPing::GoProbing(const std::string& dst_addr) {
 }
 
 MPing::MPing(const int& argc, const char** argv)
-    : win_size(4),
-      loop(false),
-      rate(0),
-      slow_start(false),
-      ttl(0),
-      inc_ttl(0),
-      pkt_size(0),
-      loop_size(0),
-      version(false),
-      debug(false),
-      burst(0),
-      interval(0),
-      dport(0),
-      server_port(0),
-      server_family(SOCKETFAMILY_UNSPEC),
-      client_mode(false) {
-  int ac = argc;
-  const char **av = argv;
-  const char *p;
-  bool host_set = false;
-
+    : transport(NULL) {
   if (argc < 2) {
     printf("%s", usage);
     exit(0);
   }
 
-  ac--;
-  av++;
-
-  while (ac > 0) {
-    p = *av++;  // p point to switch, av point to value
-    if (p[0] == '-') {
-      if (ac == 1) {
-        switch (p[1]) {  // those switches without value
-          case 'f': loop = true; av--; break;
-          case 'S': slow_start = true; av--; break;
-          case 'V': version = true; av--; break;
-          case 'd': debug = true; av--; break;
-          case 'c': client_mode = true; av--; break;
-          case '4': server_family = SOCKETFAMILY_IPV4; av--; break;
-          case '6': server_family = SOCKETFAMILY_IPV6; av--; break;
-          case 'h':  // fall through
-          default: std::cout << usage << std::endl; exit(0); break;
-        }
-      } else {
-        switch (p[1]) {
-          case 'n': { win_size = atoi(*av); ac--; break; }
-          case 'f': { loop = true; av--; break; }
-          case 'R': { rate = atoi(*av); ac--; break; }
-          case 'S': { slow_start = true; av--; break; }
-          case 't': { ttl = atoi(*av); ac--; break; }
-          case 's': { server_port = atoi(*av); ac--; break; }
-          case 'a': { inc_ttl = atoi(*av); ttl = inc_ttl; ac--; break; }
-          case 'b': {
-            p = *av;
-            if (p[0] == '-') {
-              loop_size = atoi(*av);
-            } else {
-              pkt_size = atoi(*av);
-            }
-
-            ac--;
-            break;
-          }
-          case 'p': { dport = atoi(*av); ac--; break; }
-          case 'B': { burst = atoi(*av); ac--; break; }
-          case 'V': { version = true; av--; break; }
-          case 'd': { debug = true; av--; break; }
-          case 'c': { client_mode = true; av--; break; };
-          case '4': { server_family = SOCKETFAMILY_IPV4; av--; break; }
-          case '6': { server_family = SOCKETFAMILY_IPV6; av--; break; }
-          case 'F': { src_addr = std::string(*av); ac--; break; }
-          default: {
-            LOG(mlab::FATAL, "Unknown parameter -%c\n%s", p[1], usage); break;
-          }
-        }
-      }
-    } else {  // host
-      if (!host_set) {
-        dst_host = std::string(p);
-        av--;
-        host_set = 1;
-      }else{
-        LOG(mlab::FATAL, "\n%s", usage);
-      }
-    }
-
-    ac--;
-    av++;
+  std::string error;
+  if (config.ParseArgs(argc, argv, &error) < 0) {
+    LOG(mlab::FATAL, "%s\n%s", error.c_str(), usage);
   }
 
-  // must have set host
-  // if (!host_set) {
-  //   LOG(mlab::FATAL, "Must have destination host. \n%s", usage);
-  // }
+  if (config.help) {
+    std::cout << usage << std::endl;
+    exit(0);
+  }
 
   ValidatePara();
 }
@@ -553,94 +793,53 @@ MPing::MPing(const int& argc, const char** argv)
 void MPing::ValidatePara() {
 
   // print version
-  if (version) {
+  if (config.version) {
     std::cout << kVersion << std::endl;
     exit(0);
   }
 
   // server mode
-  if (server_port > 0) {
-    if (server_port > 65535) {
+  if (config.server_port > 0) {
+    if (config.server_port > 65535) {
       LOG(mlab::FATAL, "Server port cannot larger than 65535.");
     }
 
-    if (server_family == SOCKETFAMILY_UNSPEC){
+    if (config.server_family == SOCKETFAMILY_UNSPEC){
       LOG(mlab::FATAL, "Need to know the socket family, use -4 or -6.");
     }
 
     return;
   }
 
-  if (debug) {
+  if (config.debug) {
     mlab::SetLogSeverity(mlab::VERBOSE);
   }
 
-  // destination set?
-  if (dst_host.empty()) {
-    LOG(mlab::FATAL, "Must have destination host. \n%s", usage);
-  }
-
-  // client mode
-  if (client_mode) {
-    if (dport == 0) {
-      LOG(mlab::FATAL, "Client mode must have destination port using -p.");
+  // the campaign file has the destinations
+  if (!config.campaign.empty()) {
+    std::string error;
+    if (config.Validate(&error) < 0) {
+      LOG(mlab::FATAL, "%s\n%s", error.c_str(), usage);
     }
 
-    if (ttl == 0) {
-      ttl = kDefaultTTL;
-    }
-  }
-
-  // TTL
-  if (ttl > 255 || ttl < 0) {
-    ttl = 255;
-    LOG(mlab::WARNING, "TTL %d is either > 255 or < 0, "
-                       "now set TTL to 255.", ttl);
+    return;
   }
 
-  // loop_size [-4, -1]
-  if (loop_size < -4 || loop_size > 0) {
-    LOG(mlab::FATAL, "loop through message size could only take"
-                     "-1, -2, -3 or -4");
+  // destination set?
+  if (config.dst_host.empty()) {
+    LOG(mlab::FATAL, "Must have destination host. \n%s", usage);
   }
 
-  // inc_ttl
-  if (inc_ttl > 255 || inc_ttl < 0) {
-    inc_ttl = 255;
-    LOG(mlab::WARNING, "Auto-increment TTL %u is either > 255 or < 0, "
-                       "now set auto-increment TTL to 255.", inc_ttl);
+  std::string error;
+  if (config.Validate(&error) < 0) {
+    LOG(mlab::FATAL, "%s\n%s", error.c_str(), usage);
   }
 
   // destination host
-  mlab::Host dest(dst_host);
+  mlab::Host dest(config.dst_host);
   if (dest.resolved_ips.empty()) {
-    LOG(mlab::FATAL, "Destination host %s invalid.", dst_host.c_str());
+    LOG(mlab::FATAL, "Destination host %s invalid.", config.dst_host.c_str());
   } else {  // set destination ip set
     dest_ips = dest.resolved_ips;
   }
-
-  // max packet size
-  if (pkt_size > 65535) {
-    LOG(mlab::FATAL, "Packet size cannot larger than 65535.");
-  }
-
-  // validate local host
-  if (src_addr.length() > 0) {
-    if (mlab::GetSocketFamilyForAddress(src_addr) == SOCKETFAMILY_UNSPEC) {
-      LOG(mlab::FATAL, "Local host %s invalid. Only accept numeric IP address",
-          src_addr.c_str());
-    }
-  }
-
-  // validate UDP destination port
-  if (dport > 0 ) {
-    if (ttl == 0 && !client_mode) {
-      LOG(mlab::FATAL, "-p can only use together with -t -a or -p.\n%s", usage);
-    }
-
-    if (dport > 65535) {
-      LOG(mlab::FATAL, "UDP destination port cannot larger than 65535.");
-    }
-  }
 }
-
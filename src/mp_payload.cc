@@ -0,0 +1,107 @@
+#if defined(OS_LINUX) || defined(OS_MACOSX)
+#include <arpa/inet.h>
+#elif defined(OS_WINDOWS)
+#include <winsock2.h>
+#endif
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mp_clock.h"
+#include "mp_payload.h"
+
+namespace {
+
+const char kLegacyHeader[] = "mlab-seq#";
+const char kSessionHeader[] = "mlab-ssn#";
+
+void Put64(char *buf, uint64_t v) {
+  uint32_t hi = htonl(static_cast<uint32_t>(v >> 32));
+  uint32_t lo = htonl(static_cast<uint32_t>(v));
+  memcpy(buf, &hi, sizeof(hi));
+  memcpy(buf + 4, &lo, sizeof(lo));
+}
+
+uint64_t Get64(const char *buf) {
+  uint32_t hi, lo;
+  memcpy(&hi, buf, sizeof(hi));
+  memcpy(&lo, buf + 4, sizeof(lo));
+  return (static_cast<uint64_t>(ntohl(hi)) << 32) | ntohl(lo);
+}
+
+// Catches corrupted or truncated stamps, not forgery.
+uint32_t Check(uint32_t nonce, uint64_t seq, uint64_t send_time) {
+  uint64_t h = nonce * 0x9e3779b97f4a7c15ULL;
+  h = (h ^ seq) * 0xff51afd7ed558ccdULL;
+  h = (h ^ (h >> 33) ^ send_time) * 0xc4ceb9fe1a85ec53ULL;
+  return static_cast<uint32_t>(h ^ (h >> 32));
+}
+
+}  // namespace
+
+size_t MpingWritePayload(char *buf, bool legacy, uint32_t nonce,
+                         uint64_t seq, uint64_t send_time) {
+  if (legacy) {
+    uint32_t s = htonl(static_cast<uint32_t>(seq));
+    memcpy(buf, kLegacyHeader, kPayloadHeaderLength);
+    memcpy(buf + kPayloadHeaderLength, &s, sizeof(s));
+    return kLegacyPayloadLength;
+  }
+
+  uint32_t n = htonl(nonce);
+  uint32_t c = htonl(Check(nonce, seq, send_time));
+  char *p = buf + kPayloadHeaderLength;
+  memcpy(buf, kSessionHeader, kPayloadHeaderLength);
+  memcpy(p, &n, sizeof(n));
+  Put64(p + 4, seq);
+  Put64(p + 12, send_time);
+  memcpy(p + 20, &c, sizeof(c));
+  return kSessionPayloadLength;
+}
+
+bool MpingReadPayload(const char *buf, size_t len, bool *legacy,
+                      uint32_t *nonce, uint64_t *seq, uint64_t *send_time) {
+  if (len >= kSessionPayloadLength &&
+      memcmp(buf, kSessionHeader, kPayloadHeaderLength) == 0) {
+    const char *p = buf + kPayloadHeaderLength;
+    uint32_t n, c;
+    memcpy(&n, p, sizeof(n));
+    memcpy(&c, p + 20, sizeof(c));
+    *legacy = false;
+    *nonce = ntohl(n);
+    *seq = Get64(p + 4);
+    *send_time = Get64(p + 12);
+    return ntohl(c) == Check(*nonce, *seq, *send_time);
+  }
+
+  if (len >= kLegacyPayloadLength &&
+      memcmp(buf, kLegacyHeader, kPayloadHeaderLength) == 0) {
+    uint32_t s;
+    memcpy(&s, buf + kPayloadHeaderLength, sizeof(s));
+    *legacy = true;
+    *nonce = 0;
+    *seq = ntohl(s);
+    *send_time = 0;
+    return true;
+  }
+
+  return false;
+}
+
+uint32_t MpingNewNonce() {
+  uint32_t nonce = 0;
+  int fd = open("/dev/urandom", O_RDONLY);
+  if (fd >= 0) {
+    if (read(fd, &nonce, sizeof(nonce)) != sizeof(nonce))
+      nonce = 0;
+    close(fd);
+  }
+
+  if (nonce == 0) {  // no urandom, mix the clock and the pid
+    uint64_t x = MpingClock::NowNs() ^ (static_cast<uint64_t>(getpid()) << 32);
+    x *= 2685821657736338717ULL;
+    nonce = static_cast<uint32_t>(x >> 32);
+  }
+
+  return nonce ? nonce : 1;
+}
@@ -0,0 +1,96 @@
+#include <errno.h>
+
+#include <algorithm>
+
+#include "mp_probe_loop.h"
+#include "mp_stats.h"
+#include "mp_transport.h"
+#include "log.h"
+
+MpingProbeLoop::MpingProbeLoop(const MpingConfig& config,
+                               MpingTransport *transport, MpingStat *stat)
+    : transport_(transport),
+      stat_(stat),
+      hooks_(NULL),
+      profile_(NULL),
+      max_open_(config.slow_start ? 2 : 10),
+      burst_(config.burst),
+      start_burst_(false),
+      sseq_(0) {
+}
+
+int MpingProbeLoop::Send(int window, bool force, size_t size, int *error) {
+  *error = 0;
+
+  // lost probes give their credit back, see MpingStat
+  int64_t inflight = (int64_t)stat_->in_flight();
+  int need_send;
+  if (burst_ == 0 || !start_burst_) {  // no burst
+    int diff = (int)(inflight - window);
+    need_send = diff < 0 ? std::min(max_open_, -diff) : force;
+  } else {  // start burst, now we have built the window
+    int diff = (int)(inflight + burst_ - window);
+    need_send = diff > 0 ? force : burst_;
+  }
+
+  while (need_send > 0) {
+    size_t probe_size = size;
+    if (hooks_)
+      hooks_->BeforeSend(sseq_ + 1, &probe_size);
+
+    uint64_t phase = StartPhase();
+    bool success = transport_->SendPacket(sseq_ + 1, probe_size, error);
+    StopPhase(MpingProfile::kSend, phase);
+    if (!success) {
+      if (*error == ECONNREFUSED)  // an earlier probe's, we connect UDP
+        continue;
+      return *error == ENOBUFS || *error == EINTR ? 0 : -1;
+    }
+    *error = 0;
+
+    sseq_++;
+    phase = StartPhase();
+    uint64_t now = transport_->NowNs();
+    stat_->EnqueueSend(sseq_, now);
+    if (hooks_)
+      hooks_->OnSend(sseq_, now);
+    StopPhase(MpingProfile::kStats, phase);
+
+    // let the in flight reach the window, then start burst
+    if (burst_ > 0 && window >= burst_ && !start_burst_ &&
+        (int64_t)stat_->in_flight() == window) {
+      start_burst_ = true;  // once set, stay true
+    }
+    need_send--;
+  }
+
+  return 0;
+}
+
+int MpingProbeLoop::Receive(uint64_t *seq, double *rtt, int *error) {
+  uint64_t send_time;
+  uint64_t phase = StartPhase();
+  uint64_t rseq = transport_->ReceiveAndGetSeq(error, stat_, &send_time);
+  StopPhase(MpingProfile::kReceive, phase);
+  if (*error == EAGAIN) {  // the receive deadline, a probe may time out
+    stat_->Expire(transport_->NowNs());
+    return 0;
+  }
+  if (*error == ETIMEDOUT || *error == EINTR)
+    return 0;
+  if (*error != 0)
+    return -1;
+
+  phase = StartPhase();
+  uint64_t now = transport_->NowNs();
+  *seq = rseq;
+  *rtt = stat_->EnqueueRecv(rseq, now, send_time);
+  if ((int64_t)(sseq_ - rseq) < 0) {
+    LOG(mlab::ERROR, "recv a seq larger than sent %llu %llu",
+        (unsigned long long)rseq, (unsigned long long)sseq_);
+  }
+  if (hooks_)
+    hooks_->OnReply(rseq, now, send_time, *rtt);
+  StopPhase(MpingProfile::kStats, phase);
+  return 1;
+}
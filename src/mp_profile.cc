@@ -0,0 +1,87 @@
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+
+#include "mp_profile.h"
+
+namespace {
+
+const char *kPhaseNames[MpingProfile::kPhases] = {
+  "send", "receive", "parse", "stats", "print"
+};
+
+int BucketFor(uint64_t cycles) {
+  int b = 0;
+  while (cycles && b < MpingProfile::kBuckets - 1) {
+    cycles >>= 1;
+    b++;
+  }
+  return b;
+}
+
+}  // namespace
+
+MpingProfile::MpingProfile()
+    : enabled_(false) {
+  memset(count_, 0, sizeof(count_));
+  memset(total_, 0, sizeof(total_));
+  memset(max_, 0, sizeof(max_));
+  memset(buckets_, 0, sizeof(buckets_));
+}
+
+void MpingProfile::Add(Phase phase, uint64_t cycles) {
+  count_[phase]++;
+  total_[phase] += cycles;
+  if (cycles > max_[phase])
+    max_[phase] = cycles;
+  buckets_[phase][BucketFor(cycles)]++;
+}
+
+uint64_t MpingProfile::Percentile(Phase phase, double q) const {
+  if (count_[phase] == 0)
+    return 0;
+
+  uint64_t rank = static_cast<uint64_t>(q * count_[phase] + 0.5);
+  if (rank < 1)
+    rank = 1;
+  uint64_t seen = 0;
+  for (int b = 0; b < kBuckets; b++) {
+    seen += buckets_[phase][b];
+    if (seen >= rank)
+      return b == 0 ? 0 : std::min<uint64_t>(max_[phase], (1ULL << b) - 1);
+  }
+  return max_[phase];
+}
+
+void MpingProfile::Print() const {
+  std::cout << "Profile in " << Unit() << ", receive includes parse:" <<
+               std::endl;
+  for (int p = 0; p < kPhases; p++) {
+    Phase phase = static_cast<Phase>(p);
+    if (count_[p] == 0)
+      continue;
+
+    std::cout << "  " << kPhaseNames[p] << " count=" << count_[p] <<
+                 " total=" << total_[p] << " mean=" <<
+                 total_[p] / count_[p] << " p50<=" <<
+                 Percentile(phase, 0.5) << " p99<=" <<
+                 Percentile(phase, 0.99) << " max=" << max_[p] << std::endl;
+
+    // bucket i holds [2^(i-1), 2^i)
+    std::cout << "   ";
+    for (int b = 0; b < kBuckets; b++) {
+      if (buckets_[p][b])
+        std::cout << " <2^" << b << ":" << buckets_[p][b];
+    }
+    std::cout << std::endl;
+  }
+}
+
+const char* MpingProfile::Unit() {
+#if defined(MP_PROFILE_TSC)
+  return "cycles";
+#else
+  return "ns";
+#endif
+}
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+#include "mp_queue.h"
+#include "log.h"
+
+MpingQueueEst::MpingQueueEst()
+    : base_rtt_(-1.0),
+      queue_ms_(0.0),
+      queue_pkts_(0.0),
+      mean_size_(0.0),
+      capacity_(0.0),
+      buffer_pkts_(-1.0),
+      max_queue_pkts_(0.0),
+      replies_(0),
+      recv_temp_(0),
+      rtt_sum_temp_(0.0),
+      min_rtt_temp_(-1.0) {
+}
+
+void MpingQueueEst::OnRecv(double rtt, size_t size) {
+  replies_++;
+  mean_size_ += (size - mean_size_) / replies_;
+
+  recv_temp_++;
+  rtt_sum_temp_ += rtt;
+  if (min_rtt_temp_ < 0 || rtt < min_rtt_temp_)
+    min_rtt_temp_ = rtt;
+
+  if (base_rtt_ < 0 || rtt < base_rtt_)
+    base_rtt_ = rtt;
+}
+
+void MpingQueueEst::OnTick(double seconds, unsigned int lost) {
+  min_rtts_.push_back(min_rtt_temp_);
+  if (min_rtts_.size() > kBaseIntervals)
+    min_rtts_.pop_front();
+
+  // base over the sliding intervals only, this one included
+  base_rtt_ = -1.0;
+  for (size_t i = 0; i < min_rtts_.size(); i++) {
+    if (min_rtts_[i] >= 0 && (base_rtt_ < 0 || min_rtts_[i] < base_rtt_))
+      base_rtt_ = min_rtts_[i];
+  }
+
+  if (recv_temp_ > 0 && seconds > 0) {
+    double rate = recv_temp_ / seconds;
+    capacity_ = std::max(capacity_, rate);
+
+    queue_ms_ = std::max(0.0, rtt_sum_temp_ / recv_temp_ - base_rtt_);
+    queue_pkts_ = rate * queue_ms_ / 1000;
+    max_queue_pkts_ = std::max(max_queue_pkts_, queue_pkts_);
+    if (lost > 0)
+      buffer_pkts_ = std::max(buffer_pkts_, queue_pkts_);
+  } else {
+    queue_ms_ = 0.0;
+    queue_pkts_ = 0.0;
+  }
+
+  recv_temp_ = 0;
+  rtt_sum_temp_ = 0.0;
+  min_rtt_temp_ = -1.0;
+}
+
+void MpingQueueEst::PrintTempStats() const {
+  if (base_rtt_ < 0)
+    return;
+
+  std::cout << std::fixed << std::setprecision(2) <<
+               "Queue " << queue_pkts_ << " pkts " << queue_bytes() <<
+               " bytes " << queue_ms_ << " ms base rtt " << base_rtt_ <<
+               " ms";
+  if (buffer_pkts_ >= 0)
+    std::cout << " buffer " << buffer_pkts_ << " pkts";
+  std::cout << std::endl;
+  std::cout.unsetf(std::ios::floatfield);
+  std::cout << std::setprecision(6);
+}
+
+void MpingQueueEst::PrintStats() const {
+  if (base_rtt_ < 0)
+    return;
+
+  std::cout << std::fixed << std::setprecision(2) <<
+               "Total max queue=" << max_queue_pkts_ << " pkts " <<
+               max_queue_pkts_ * mean_size_ << " bytes " <<
+               (capacity_ > 0 ? max_queue_pkts_ * 1000 / capacity_ : 0.0) <<
+               " ms capacity=" << capacity_ << " pkt/s " <<
+               capacity_ * mean_size_ * 8 / 1000000 << " Mbps";
+  if (buffer_pkts_ >= 0) {
+    std::cout << " buffer=" << buffer_pkts_ << " pkts " <<
+                 buffer_pkts_ * mean_size_ << " bytes " <<
+                 (capacity_ > 0 ? buffer_pkts_ * 1000 / capacity_ : 0.0) <<
+                 " ms";
+  } else {
+    std::cout << " buffer>" << max_queue_pkts_ << " pkts (no loss)";
+  }
+  std::cout << std::endl;
+  std::cout.unsetf(std::ios::floatfield);
+  std::cout << std::setprecision(6);
+}
@@ -0,0 +1,183 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mp_clock.h"
+#include "mp_resolver.h"
+#include "log.h"
+
+namespace {
+
+bool IsNumeric(const std::string& host) {
+  char buf[sizeof(struct in6_addr)];
+  return inet_pton(AF_INET, host.c_str(), buf) == 1 ||
+         inet_pton(AF_INET6, host.c_str(), buf) == 1;
+}
+
+}  // namespace
+
+int MpingSystemLookup::Lookup(const std::string& host,
+                              std::set<std::string> *ips) {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;  // one entry per address
+
+  struct addrinfo *res = NULL;
+  int ret = getaddrinfo(host.c_str(), NULL, &hints, &res);
+  if (ret != 0)
+    return ret;
+
+  for (struct addrinfo *p = res; p; p = p->ai_next) {
+    char buf[INET6_ADDRSTRLEN];
+    if (getnameinfo(p->ai_addr, p->ai_addrlen, buf, sizeof(buf), NULL, 0,
+                    NI_NUMERICHOST) == 0) {
+      ips->insert(buf);
+    }
+  }
+  freeaddrinfo(res);
+  return ips->empty() ? EAI_NONAME : 0;
+}
+
+MpingResolver::MpingResolver(int threads, double ttl, double negative_ttl,
+                             MpingLookup *lookup)
+    : lookup_(lookup ? lookup : &system_),
+      ttl_(static_cast<uint64_t>(ttl * kNsPerSec)),
+      negative_ttl_(static_cast<uint64_t>(negative_ttl * kNsPerSec)),
+      num_threads_(threads),
+      quit_(false) {
+  ASSERT(threads > 0);
+  pipe_[0] = pipe_[1] = -1;
+  pthread_mutex_init(&mu_, NULL);
+  pthread_cond_init(&wake_, NULL);
+}
+
+int MpingResolver::Init(std::string *error) {
+  ASSERT(pipe_[0] < 0);
+  if (pipe(pipe_) < 0) {
+    *error = std::string("resolver pipe fails. ") + strerror(errno);
+    pipe_[0] = pipe_[1] = -1;
+    return -1;
+  }
+  fcntl(pipe_[0], F_SETFL, fcntl(pipe_[0], F_GETFL) | O_NONBLOCK);
+  fcntl(pipe_[1], F_SETFL, fcntl(pipe_[1], F_GETFL) | O_NONBLOCK);
+
+  for (int i = 0; i < num_threads_; i++) {
+    pthread_t t;
+    int ret = pthread_create(&t, NULL, Worker, this);
+    if (ret != 0) {
+      if (threads_.empty()) {
+        *error = std::string("No resolver thread. ") + strerror(ret);
+        return -1;
+      }
+      LOG(mlab::WARNING, "resolver thread %d fails to start.", i);
+      break;
+    }
+    threads_.push_back(t);
+  }
+  return 0;
+}
+
+MpingResolver::~MpingResolver() {
+  pthread_mutex_lock(&mu_);
+  quit_ = true;
+  pthread_cond_broadcast(&wake_);
+  pthread_mutex_unlock(&mu_);
+
+  for (size_t i = 0; i < threads_.size(); i++)
+    pthread_join(threads_[i], NULL);
+
+  pthread_cond_destroy(&wake_);
+  pthread_mutex_destroy(&mu_);
+  if (pipe_[0] >= 0) {
+    close(pipe_[0]);
+    close(pipe_[1]);
+  }
+}
+
+void MpingResolver::Resolve(const std::string& host) {
+  ASSERT(pipe_[0] >= 0);
+  pthread_mutex_lock(&mu_);
+  if (IsNumeric(host)) {
+    Result r;
+    r.host = host;
+    r.ips.insert(host);
+    r.error = 0;
+    Done(r);
+  } else if (busy_.count(host) == 0) {
+    std::map<std::string, Entry>::iterator hit = cache_.find(host);
+    if (hit != cache_.end() && hit->second.expires > MpingClock::NowNs()) {
+      Result r;
+      r.host = host;
+      r.ips = hit->second.ips;
+      r.error = hit->second.error;
+      Done(r);
+    } else {
+      busy_.insert(host);
+      todo_.push_back(host);
+      pthread_cond_signal(&wake_);
+    }
+  }
+  pthread_mutex_unlock(&mu_);
+}
+
+void MpingResolver::Done(const Result& r) {
+  done_.push_back(r);
+  char c = 0;
+  if (write(pipe_[1], &c, 1) < 0 && errno != EAGAIN) {
+    LOG(mlab::ERROR, "resolver pipe fails. %s [%d]", strerror(errno), errno);
+  }
+}
+
+void MpingResolver::Take(std::vector<Result> *results) {
+  char buf[64];
+  while (read(pipe_[0], buf, sizeof(buf)) > 0) { }
+
+  pthread_mutex_lock(&mu_);
+  results->insert(results->end(), done_.begin(), done_.end());
+  done_.clear();
+  pthread_mutex_unlock(&mu_);
+}
+
+size_t MpingResolver::pending() const {
+  pthread_mutex_lock(&mu_);
+  size_t n = busy_.size() + done_.size();
+  pthread_mutex_unlock(&mu_);
+  return n;
+}
+
+void* MpingResolver::Worker(void *self) {
+  static_cast<MpingResolver *>(self)->Work();
+  return NULL;
+}
+
+void MpingResolver::Work() {
+  pthread_mutex_lock(&mu_);
+  while (true) {
+    while (!quit_ && todo_.empty())
+      pthread_cond_wait(&wake_, &mu_);
+    if (quit_)
+      break;
+
+    Result r;
+    r.host = todo_.front();
+    todo_.pop_front();
+    pthread_mutex_unlock(&mu_);
+
+    r.error = lookup_->Lookup(r.host, &r.ips);
+    if (r.error != 0)
+      r.ips.clear();
+
+    pthread_mutex_lock(&mu_);
+    Entry& e = cache_[r.host];
+    e.ips = r.ips;
+    e.error = r.error;
+    e.expires = MpingClock::NowNs() + (r.error ? negative_ttl_ : ttl_);
+    busy_.erase(r.host);
+    Done(r);
+  }
+  pthread_mutex_unlock(&mu_);
+}
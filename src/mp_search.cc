@@ -0,0 +1,349 @@
+#include <math.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+#include "mp_clock.h"
+#include "mp_search.h"
+#include "log.h"
+
+namespace {
+
+const int kWarmupRounds = 1;  // let the queue settle at a new window
+const int kMinRounds = 5;
+const int kMaxRounds = 50;
+const int kMaxTicks = 2;  // seconds
+const double kPrecision = 0.02;  // CI half width relative to the mean
+const double kGrowth = 0.1;  // doubling the window must add this much rate
+const double kPlateau = 0.02;  // within this of capacity is saturated
+const double kLossStep = 0.01;  // delivery drop that counts as loss onset
+const double kMinLost = 3;  // extra lost probes that count as loss onset
+const int kTolerance = 32;  // bisect to 1/kTolerance of the window
+
+double time_diff(uint64_t new_t, uint64_t old_t) {
+  return (int64_t)(new_t - old_t) / (double)kNsPerSec;  // in sec
+}
+
+}  // namespace
+
+MpingKneeSearch::MpingKneeSearch(int max_window, size_t packet_size,
+                                 uint64_t sseq)
+    : max_window_(std::max(max_window, 1)),
+      packet_size_(packet_size),
+      phase_(kBracketKnee),
+      window_(1),
+      lo_(0),
+      hi_(0),
+      knee_(0),
+      capacity_(0.0),
+      buffer_(-1),
+      base_rtt_(-1.0),
+      base_probes_(0.0),
+      base_lost_(0.0),
+      first_(0),
+      last_(0) {
+  Start(window_, sseq);
+}
+
+void MpingKneeSearch::Start(int window, uint64_t sseq) {
+  window_ = window;
+  start_seq_ = sseq;
+  loss_start_ = sseq;
+  round_end_ = sseq;
+  round_start_ = 0;
+  in_round_ = false;
+  warmup_ = kWarmupRounds;
+  ticks_ = 0;
+  round_recv_ = 0;
+  recv_ = 0;
+  max_seq_ = sseq;
+  n_ = 0;
+  mean_ = m2_ = 0.0;
+  rtt_sum_ = 0.0;
+  rtt_num_ = 0;
+}
+
+void MpingKneeSearch::OnRecv(uint64_t seq, double rtt, uint64_t now,
+                             uint64_t sseq) {
+  if (phase_ == kDone)
+    return;
+
+  if (first_ == 0)
+    first_ = now;
+  last_ = now;
+
+  if (base_rtt_ < 0 || rtt < base_rtt_)
+    base_rtt_ = rtt;
+
+  if ((int64_t)(seq - start_seq_) <= 0)
+    return;  // sent at the previous window
+
+  // loss is only counted for packets sent after the warmup, the burst
+  // that opens a larger window may overflow the queue on its own
+  if (warmup_ == 0 && (int64_t)(seq - loss_start_) > 0) {
+    recv_++;
+    if ((int64_t)(seq - max_seq_) > 0)
+      max_seq_ = seq;
+  }
+
+  // a round runs until a packet sent after its start comes back
+  if (!in_round_) {
+    in_round_ = true;
+    round_start_ = now;
+    round_end_ = sseq;
+    round_recv_ = 0;
+    return;
+  }
+
+  round_recv_++;
+  if (warmup_ == 0) {
+    rtt_sum_ += rtt;
+    rtt_num_++;
+  }
+
+  if ((int64_t)(seq - round_end_) <= 0)
+    return;
+
+  double secs = time_diff(now, round_start_);
+  if (warmup_ > 0) {
+    if (--warmup_ == 0) {
+      loss_start_ = sseq;
+      max_seq_ = sseq;
+    }
+  } else if (secs > 0) {
+    double rate = round_recv_ / secs;
+    n_++;
+    double delta = rate - mean_;
+    mean_ += delta / n_;
+    m2_ += delta * (rate - mean_);
+  }
+
+  round_start_ = now;
+  round_end_ = sseq;
+  round_recv_ = 0;
+
+  if (n_ >= kMaxRounds) {
+    Finish(sseq);
+  } else if (n_ >= kMinRounds) {
+    double half_width = 1.96 * sqrt(m2_ / (n_ - 1) / n_);
+    if (half_width <= kPrecision * mean_)
+      Finish(sseq);
+  }
+}
+
+void MpingKneeSearch::OnTick(uint64_t sseq) {
+  if (phase_ == kDone)
+    return;
+
+  if (++ticks_ >= kMaxTicks) {
+    LOG(mlab::VERBOSE, "search: window %d did not converge.", window_);
+    Finish(sseq);
+  }
+}
+
+void MpingKneeSearch::Finish(uint64_t sseq) {
+  Measurement m;
+  m.window = window_;
+  m.rate = mean_;
+  m.half_width = n_ > 1 ? 1.96 * sqrt(m2_ / (n_ - 1) / n_) : mean_;
+  m.rtt = rtt_num_ ? rtt_sum_ / rtt_num_ : 0.0;
+
+  // anything below the highest sequence seen should have come back
+  unsigned int expected =
+      warmup_ ? 0 : static_cast<unsigned int>(max_seq_ - loss_start_);
+  m.probes = expected;
+  m.delivered = expected ? std::min(1.0, (double)recv_ / expected) : 0.0;
+  if (!Lossy(m)) {  // pool the path's background loss
+    base_probes_ += m.probes;
+    base_lost_ += (1.0 - m.delivered) * m.probes;
+  }
+
+  LOG(mlab::INFO, "search: packet size %lu, window %d, rate %.1f+-%.1f "
+                  "pkt/s, rtt %.3f ms, delivered %.4f",
+      packet_size_, m.window, m.rate, m.half_width, m.rtt, m.delivered);
+
+  done_.push_back(m);
+  Next(m);
+
+  if (phase_ != kDone)
+    Start(window_, sseq);
+}
+
+bool MpingKneeSearch::Saturated(const Measurement& m) const {
+  // can't tell it apart from the plateau
+  return m.rate + m.half_width >= (1.0 - kPlateau) * capacity_;
+}
+
+bool MpingKneeSearch::Lossy(const Measurement& m) const {
+  // loss above the background loss of the windows so far, by a few
+  // probes and by more than chance: two proportion z-test at 3 sigma
+  if (m.probes == 0)
+    return m.delivered == 0.0;
+
+  double lost = (1.0 - m.delivered) * m.probes;
+  double p = base_probes_ > 0 ? base_lost_ / base_probes_ : 0.0;
+  double excess = (1.0 - m.delivered) - p;
+  if (excess <= kLossStep || excess * m.probes < kMinLost)
+    return false;
+
+  double pooled = (base_lost_ + lost) / (base_probes_ + m.probes);
+  double sigma = sqrt(pooled * (1 - pooled) *
+                      (1.0 / m.probes + 1.0 / std::max(base_probes_, 1.0)));
+  return excess > 3 * sigma;
+}
+
+bool MpingKneeSearch::Narrow() const {
+  return hi_ - lo_ <= std::max(1, hi_ / kTolerance);
+}
+
+void MpingKneeSearch::Next(const Measurement& m) {
+  switch (phase_) {
+    case kBracketKnee: {
+      const Measurement *prev =
+          done_.size() >= 2 ? &done_[done_.size() - 2] : NULL;
+      // keep doubling unless the rate clearly stopped growing
+      if (prev == NULL ||
+          (m.rate + m.half_width >=
+               (prev->rate - prev->half_width) * (1 + kGrowth) &&
+           !Lossy(m))) {
+        if (m.window >= max_window_) {  // still growing at the largest
+          capacity_ = m.rate;
+          phase_ = kDone;
+        } else {
+          window_ = std::min(2 * window_, max_window_);
+        }
+        break;
+      }
+
+      // bracket the knee between the measured windows
+      capacity_ = std::max(m.rate, prev->rate);
+      hi_ = m.window;
+      lo_ = 0;
+      for (size_t i = 0; i < done_.size(); i++) {
+        if (Saturated(done_[i]))
+          hi_ = std::min(hi_, done_[i].window);
+      }
+      for (size_t i = 0; i < done_.size(); i++) {
+        if (!Saturated(done_[i]) && done_[i].window < hi_)
+          lo_ = std::max(lo_, done_[i].window);
+      }
+
+      phase_ = kBisectKnee;
+      if (Narrow())
+        EndKnee();
+      else
+        window_ = lo_ + (hi_ - lo_) / 2;
+      break;
+    }
+    case kBisectKnee: {
+      capacity_ = std::max(capacity_, m.rate);
+      if (Saturated(m))
+        hi_ = m.window;
+      else
+        lo_ = m.window;
+
+      if (Narrow())
+        EndKnee();
+      else
+        window_ = lo_ + (hi_ - lo_) / 2;
+      break;
+    }
+    case kBracketLoss: {
+      if (Lossy(m)) {
+        hi_ = m.window;
+        phase_ = kBisectLoss;
+        if (Narrow())
+          EndLoss();
+        else
+          window_ = lo_ + (hi_ - lo_) / 2;
+      } else if (m.window >= max_window_) {
+        phase_ = kDone;  // no loss up to the largest window
+      } else {
+        lo_ = m.window;
+        window_ = std::min(2 * window_, max_window_);
+      }
+      break;
+    }
+    case kBisectLoss: {
+      if (Lossy(m))
+        hi_ = m.window;
+      else
+        lo_ = m.window;
+
+      if (Narrow())
+        EndLoss();
+      else
+        window_ = lo_ + (hi_ - lo_) / 2;
+      break;
+    }
+    case kDone:
+      break;
+  }
+}
+
+void MpingKneeSearch::EndKnee() {
+  knee_ = hi_;
+
+  // loss onset: reuse what the knee search already saw above the knee
+  lo_ = knee_;
+  hi_ = 0;
+  for (size_t i = 0; i < done_.size(); i++) {
+    const Measurement& d = done_[i];
+    if (d.window < knee_)
+      continue;
+    if (Lossy(d)) {
+      if (hi_ == 0 || d.window < hi_)
+        hi_ = d.window;
+    }
+  }
+  for (size_t i = 0; i < done_.size(); i++) {
+    const Measurement& d = done_[i];
+    if (!Lossy(d) && d.window > lo_ && (hi_ == 0 || d.window < hi_))
+      lo_ = d.window;
+  }
+
+  if (hi_ > 0) {
+    phase_ = kBisectLoss;
+    if (Narrow())
+      EndLoss();
+    else
+      window_ = lo_ + (hi_ - lo_) / 2;
+  } else if (lo_ >= max_window_) {
+    phase_ = kDone;
+  } else {
+    phase_ = kBracketLoss;
+    window_ = std::min(2 * lo_, max_window_);
+  }
+}
+
+void MpingKneeSearch::EndLoss() {
+  // the queue overflows once the window exceeds pipe plus buffer
+  buffer_ = std::max(0, hi_ - 1 - knee_);
+  phase_ = kDone;
+}
+
+void MpingKneeSearch::PrintResult() const {
+  std::cout << std::fixed << std::setprecision(2) << "Knee: packet size " <<
+               packet_size_;
+  if (knee_ == 0) {
+    std::cout << " no knee up to window " << max_window_ << " rate " <<
+                 capacity_ << " pkt/s";
+  } else {
+    std::cout << " window " << knee_ << " capacity " << capacity_ <<
+                 " pkt/s " << capacity_ * packet_size_ * 8 / 1000000.0 <<
+                 " Mbps";
+    if (buffer_ < 0) {
+      std::cout << " buffer > " << max_window_ - knee_ << " pkts";
+    } else {
+      std::cout << " buffer " << buffer_ << " pkts " <<
+                   buffer_ * packet_size_ << " bytes " <<
+                   (capacity_ > 0 ? buffer_ * 1000.0 / capacity_ : 0.0) <<
+                   " ms";
+    }
+  }
+  std::cout << " base rtt " << base_rtt_ << " ms, " << done_.size() <<
+               " windows in " << time_diff(last_, first_) << " s" << std::endl;
+  std::cout.unsetf(std::ios::floatfield);
+  std::cout << std::setprecision(6);
+}
@@ -0,0 +1,279 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "mp_clock.h"
+#include "mp_payload.h"
+#include "mp_probe_loop.h"
+#include "mp_session.h"
+#include "mp_socket.h"
+#include "mp_stats.h"
+#include "mp_sweep.h"
+#include "mp_transport.h"
+#include "mp_window.h"
+#include "log.h"
+#include "mlab/mlab.h"
+#include "mlab/protocol_header.h"
+#include "mlab/socket_family.h"
+
+namespace {
+
+const size_t kMaxBuffer = 9000;  // as mping
+
+}  // namespace
+
+MpingSession::MpingSession()
+    : transport_(NULL),
+      listener_(NULL),
+      socket_(NULL),
+      stat_(NULL),
+      loop_(NULL),
+      winctl_(NULL),
+      state_(kIdle),
+      size_ix_(0),
+      window_(0),
+      tick_(0) {
+}
+
+MpingSession::~MpingSession() {
+  delete winctl_;
+  delete loop_;
+  delete stat_;
+  delete socket_;
+}
+
+int MpingSession::Check(const MpingConfig& config, std::string *error) {
+  if (config.inc_ttl > 0 || config.all_hops || config.interleave_sizes ||
+      config.knee_search || !config.shm_name.empty() ||
+      config.server_port > 0 || !config.campaign.empty() ||
+      config.dual_stack || config.flows > 1 || config.profile) {
+    *error = "-a, -E, -H, -I, -K, -M, -s, -C, -D and -X need the mping "
+             "tool.";
+    return -1;
+  }
+  return 0;
+}
+
+int MpingSession::Start(const MpingConfig& config, std::string *error) {
+  if (state_ != kIdle) {
+    *error = "Session already started.";
+    return -1;
+  }
+
+  config_ = config;
+  if (config_.Validate(error) < 0)
+    return -1;
+
+  if (Check(config_, error) < 0)
+    return -1;
+
+  sizes_.clear();
+  if (config_.pkt_size > 0) {
+    sizes_.push_back(config_.pkt_size);
+  } else {
+    for (int ix = 0; MpingSweepSize(config_.loop_size, ix); ix++)
+      sizes_.push_back(MpingSweepSize(config_.loop_size, ix));
+  }
+  if (sizes_.empty()) {
+    *error = "Must have message length, use -b.";
+    return -1;
+  }
+
+  if (config_.win_size < 1) {
+    *error = "Window size must be positive.";
+    return -1;
+  }
+
+  if (config_.dst_host.empty()) {
+    *error = "Must have destination host.";
+    return -1;
+  }
+
+  // Poll must not wait on DNS, resolve it first, e.g. with MpingResolver
+  const std::string& dst_addr = config_.dst_host;
+  SocketFamily family = mlab::GetSocketFamilyForAddress(dst_addr);
+  if (family == SOCKETFAMILY_UNSPEC) {
+    *error = "Destination " + dst_addr + " is not an IP address.";
+    return -1;
+  }
+
+  // a short packet is the fault of -b, say so before opening anything
+  size_t payload = config_.legacy_seq ? kLegacyPayloadLength :
+                                        kSessionPayloadLength;
+  size_t min_size = family == SOCKETFAMILY_IPV6 ?
+      sizeof(mlab::IP6Header) + sizeof(mlab::ICMP6Header) + payload :
+      sizeof(mlab::IP4Header) + sizeof(mlab::ICMP4Header) + payload;
+  size_t max_size = *std::max_element(sizes_.begin(), sizes_.end());
+  if (*std::min_element(sizes_.begin(), sizes_.end()) < min_size) {
+    *error = "Message length (-b) too small for this destination.";
+    return -1;
+  }
+
+  if (!transport_) {
+    socket_ = new MpingSocket;
+    socket_->SetBusyPoll(config_.busy_poll);
+    socket_->SetLegacySeq(config_.legacy_seq);
+    socket_->SetUring(config_.io_uring);
+    transport_ = socket_;
+  }
+
+  if (transport_->Initialize(
+          dst_addr, config_.src_addr, config_.ttl,
+          std::max(max_size, kMaxBuffer), config_.win_size,
+          config_.dport, config_.client_mode) < 0) {
+    *error = "Cannot open the probe to " + dst_addr + ".";
+    return -1;
+  }
+  if (config_.ttl)
+    transport_->SetSendTTL(config_.ttl);
+
+  stat_ = new MpingStat(config_.win_size, config_.legacy_seq);
+  stat_->SetLossTimeout(config_.loss_timeout);
+  loop_ = new MpingProbeLoop(config_, transport_, stat_);
+  if (config_.target_queue > 0) {
+    winctl_ = new MpingWindowCtl(config_.win_size, config_.target_queue,
+                                 config_.target_queue_ms);
+  }
+
+  window_ = config_.loop ? config_.win_size : 1;
+  if (winctl_)
+    window_ = winctl_->window();
+  tick_ = transport_->NowNs() + kNsPerSec;
+  state_ = kRunning;
+  return 0;
+}
+
+int MpingSession::Fail(const std::string& what, int err) {
+  error_ = what + " " + strerror(err);
+  state_ = kFailed;
+  transport_->SetRecvDeadline(0);
+  return -1;
+}
+
+int MpingSession::Send() {
+  int err;
+  if (loop_->Send(window_, false, sizes_[size_ix_], &err) < 0)
+    return Fail("send fails.", err);
+  return 0;  // the rest on the next Poll after ENOBUFS or EINTR
+}
+
+void MpingSession::OnReply(uint64_t seq, double rtt) {
+  if (winctl_ && rtt >= 0) {
+    winctl_->OnRecv(seq, rtt, loop_->sent());
+    if (window_ > 0)  // 0 drains the tail, keep it
+      window_ = winctl_->window();
+  }
+}
+
+int MpingSession::Poll(uint64_t wait_ns) {
+  if (state_ != kRunning)
+    return state_ == kFailed ? -1 : 0;
+
+  uint64_t now = transport_->NowNs();
+  if (now >= tick_) {
+    EndInterval(now);
+    if (state_ != kRunning)
+      return 0;
+  }
+
+  if (Send() < 0)
+    return -1;
+
+  // wait for the first reply, or what is due; then take what is queued
+  uint64_t wake = next_wakeup();
+  uint64_t deadline = (wake > now && wait_ns < wake - now) ? now + wait_ns :
+                                                             wake;
+  while (now < tick_) {
+    int err;
+    uint64_t rseq;
+    double rtt;
+    transport_->SetRecvDeadline(std::max(deadline, (uint64_t)1));
+    int ret = loop_->Receive(&rseq, &rtt, &err);
+    if (ret == 0)
+      break;
+    if (ret < 0)
+      return Fail("recv fails.", err);
+
+    OnReply(rseq, rtt);
+    if (Send() < 0)  // the reply gave its credit back
+      return -1;
+    now = transport_->NowNs();
+    deadline = now;
+  }
+
+  now = transport_->NowNs();
+  stat_->Expire(now);
+  if (now >= tick_)
+    EndInterval(now);
+  return state_ == kRunning ? 1 : 0;
+}
+
+void MpingSession::Stop() {
+  if (state_ == kRunning)
+    Finish();
+}
+
+uint64_t MpingSession::next_wakeup() const {
+  if (state_ != kRunning)
+    return 0;
+
+  uint64_t timeout = stat_->next_timeout();
+  return timeout ? std::min(timeout, tick_) : tick_;
+}
+
+int MpingSession::fd() const {
+  return socket_ ? socket_->recv_fd() : -1;
+}
+
+void MpingSession::Fill(MpingShmStats *stats, uint64_t now) const {
+  memset(stats, 0, sizeof(*stats));
+  stats->magic = kMpingShmMagic;
+  stats->version = kMpingShmVersion;
+  stats->pid = getpid();
+  stats->updated_ns = now;
+  stat_->Snapshot(stats);
+}
+
+void MpingSession::EndInterval(uint64_t now) {
+  stat_->Expire(now);
+  MpingShmStats stats;
+  Fill(&stats, now);
+  if (listener_)
+    listener_->OnInterval(stats, window_, sizes_[size_ix_]);
+  stat_->EndInterval();
+
+  if (window_ == 0) {  // the trailing replies are in
+    Finish();
+    return;
+  }
+
+  // -f holds the window, each size for one second if there are more;
+  // otherwise the window steps up through each size
+  bool next_size = config_.loop ? sizes_.size() > 1 :
+                                  ++window_ > config_.win_size;
+  if (next_size) {
+    if (++size_ix_ < sizes_.size()) {
+      window_ = config_.loop ? config_.win_size : 1;
+    } else {
+      size_ix_--;
+      window_ = 0;
+    }
+  }
+
+  // a late Poll skips the seconds it missed rather than catching up
+  tick_ += kNsPerSec;
+  if (tick_ <= now)
+    tick_ = now + kNsPerSec;
+}
+
+void MpingSession::Finish() {
+  stat_->Finish();
+  MpingShmStats stats;
+  Fill(&stats, transport_->NowNs());
+  state_ = kDone;
+  transport_->SetRecvDeadline(0);
+  if (listener_)
+    listener_->OnDone(stats);
+}
@@ -0,0 +1,131 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "mp_shm.h"
+#include "log.h"
+
+namespace {
+
+const size_t kWords = sizeof(MpingShmStats) / sizeof(uint64_t);
+const size_t kSeqWord = 1;  // after magic and version
+
+// every field 8 bytes, so the segment is a plain array of words
+typedef char ShmStatsIsWords[
+    sizeof(MpingShmStats) % sizeof(uint64_t) == 0 ? 1 : -1];
+
+uint64_t* Words(MpingShmStats *s) {
+  return reinterpret_cast<uint64_t *>(s);
+}
+
+const uint64_t* Words(const MpingShmStats *s) {
+  return reinterpret_cast<const uint64_t *>(s);
+}
+
+}  // namespace
+
+MpingShmWriter::MpingShmWriter()
+    : shared_(NULL) {
+}
+
+MpingShmWriter::~MpingShmWriter() {
+  if (shared_ != NULL) {
+    munmap(shared_, sizeof(*shared_));
+    shm_unlink(name_.c_str());
+  }
+}
+
+int MpingShmWriter::Open(const std::string& name) {
+  ASSERT(shared_ == NULL);
+
+  int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+  if (fd < 0) {
+    LOG(mlab::ERROR, "shm_open %s fails. %s [%d]", name.c_str(),
+        strerror(errno), errno);
+    return -1;
+  }
+
+  if (ftruncate(fd, sizeof(MpingShmStats)) < 0) {
+    LOG(mlab::ERROR, "ftruncate %s fails. %s [%d]", name.c_str(),
+        strerror(errno), errno);
+    close(fd);
+    return -1;
+  }
+
+  void *p = mmap(NULL, sizeof(MpingShmStats), PROT_READ | PROT_WRITE,
+                 MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    LOG(mlab::ERROR, "mmap %s fails. %s [%d]", name.c_str(),
+        strerror(errno), errno);
+    return -1;
+  }
+
+  name_ = name;
+  shared_ = static_cast<MpingShmStats *>(p);
+  memset(shared_, 0, sizeof(*shared_));
+  shared_->magic = kMpingShmMagic;
+  shared_->version = kMpingShmVersion;
+
+  MpingShmStats empty;
+  memset(&empty, 0, sizeof(empty));
+  empty.srtt = -1.0;
+  empty.min_rtt = -1.0;
+  empty.last_rtt = -1.0;
+  Publish(empty);
+  return 0;
+}
+
+void MpingShmWriter::Publish(const MpingShmStats& snapshot) {
+  if (shared_ == NULL)
+    return;
+
+  uint64_t *dst = Words(shared_);
+  const uint64_t *src = Words(&snapshot);
+  uint64_t seq = __atomic_load_n(&dst[kSeqWord], __ATOMIC_RELAXED);
+
+  // odd: readers that start now retry, those in flight see seq change
+  __atomic_store_n(&dst[kSeqWord], seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  for (size_t i = kSeqWord + 1; i < kWords; i++)
+    __atomic_store_n(&dst[i], src[i], __ATOMIC_RELAXED);
+
+  __atomic_store_n(&dst[kSeqWord], seq + 2, __ATOMIC_RELEASE);
+}
+
+const MpingShmStats* MpingShmOpenReader(const std::string& name) {
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    return NULL;
+
+  void *p = mmap(NULL, sizeof(MpingShmStats), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  return p == MAP_FAILED ? NULL : static_cast<const MpingShmStats *>(p);
+}
+
+bool MpingShmRead(const MpingShmStats *shared, MpingShmStats *out) {
+  const uint64_t *src = Words(shared);
+  uint64_t *dst = Words(out);
+
+  while (true) {
+    uint64_t before = __atomic_load_n(&src[kSeqWord], __ATOMIC_ACQUIRE);
+    if (before & 1) {  // being written, the probe is never long
+      sched_yield();
+      continue;
+    }
+
+    for (size_t i = 0; i < kWords; i++)
+      dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&src[kSeqWord], __ATOMIC_RELAXED) == before)
+      break;
+  }
+
+  // newer probes only append, what we know of is still there
+  return out->magic == kMpingShmMagic && out->version >= kMpingShmVersion;
+}
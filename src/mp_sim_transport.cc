@@ -0,0 +1,140 @@
+#include <errno.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include "mp_clock.h"
+#include "mp_sim_transport.h"
+#include "log.h"
+
+namespace {
+
+const uint64_t kNsPerUsec = 1000ULL;
+
+}  // namespace
+
+MpingSimTransport::MpingSimTransport(const MpingSimConfig& config)
+    : config_(config),
+      ttl_(0),
+      now_ns_(config.start_sec * kNsPerSec),
+      link_free_ns_(0),
+      recv_deadline_ns_(0),
+      wake_ns_(0),
+      rng_(config.seed ? config.seed : 1),
+      sent_(0),
+      delivered_(0),
+      queue_drops_(0),
+      random_drops_(0),
+      reordered_(0),
+      max_queue_bytes_(0) {
+  ASSERT(config_.rate_bps > 0);
+  ASSERT(config_.start_sec > 0);  // time 0 means "not received" to stats
+}
+
+int MpingSimTransport::Initialize(const std::string& destip,
+                                  const std::string& srcip,
+                                  int ttl, size_t pktsize, int wndsize,
+                                  uint16_t port, bool clientmode) {
+  destip_ = destip;
+  from_ = destip;
+  return 0;
+}
+
+double MpingSimTransport::Uniform() {
+  // xorshift64*, good enough for loss draws and fully reproducible
+  rng_ ^= rng_ >> 12;
+  rng_ ^= rng_ << 25;
+  rng_ ^= rng_ >> 27;
+  return ((rng_ * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+bool MpingSimTransport::SendPacket(const uint64_t& seq, size_t size,
+                                   int *error) {
+  sent_++;
+
+  if (config_.loss > 0 && Uniform() < config_.loss) {
+    random_drops_++;
+    return true;  // lost on the path, the sender can't tell
+  }
+
+  if (config_.hops > 0 && ttl_ > 0 && ttl_ < config_.hops) {
+    // time exceeded before the bottleneck
+    Reply r = {now_ns_ + 2 * config_.delay_us * kNsPerUsec * ttl_ /
+                   config_.hops,
+               seq, now_ns_, ttl_};
+    in_flight_.push(r);
+    return true;
+  }
+
+  // drop-tail queue in front of the bottleneck
+  size_t backlog = 0;
+  if (link_free_ns_ > now_ns_) {
+    backlog = static_cast<size_t>(
+        (link_free_ns_ - now_ns_) * (config_.rate_bps / 8.0 / kNsPerSec));
+  }
+
+  if (backlog + size > config_.buffer_bytes) {
+    queue_drops_++;
+    return true;
+  }
+
+  if (backlog + size > max_queue_bytes_)
+    max_queue_bytes_ = backlog + size;
+
+  uint64_t start = std::max(now_ns_, link_free_ns_);
+  link_free_ns_ = start + size * 8 * kNsPerSec / config_.rate_bps;
+
+  uint64_t arrival = link_free_ns_ + 2 * config_.delay_us * kNsPerUsec;
+  if (config_.reorder > 0 && Uniform() < config_.reorder) {
+    arrival += config_.reorder_delay_us * kNsPerUsec;
+    reordered_++;
+  }
+
+  Reply r = {arrival, seq, now_ns_, 0};
+  in_flight_.push(r);
+  return true;
+}
+
+uint64_t MpingSimTransport::ReceiveAndGetSeq(int* error, MpingStat *mpstat,
+                                             uint64_t *send_time) {
+  uint64_t next = in_flight_.empty() ? ~0ULL : in_flight_.top().arrival;
+  // like a socket with no alarm set, block for good if never armed
+  uint64_t timeout = recv_deadline_ns_ ? recv_deadline_ns_ : ~0ULL;
+  if (wake_ns_ && wake_ns_ < timeout && next > wake_ns_) {
+    now_ns_ = std::max(now_ns_, wake_ns_);
+    *error = EAGAIN;
+    return 0;
+  }
+
+  if (in_flight_.empty() || next > timeout) {
+    // nothing comes back before the timeout: sit it out, or give up on
+    // the spot rather than wait forever
+    now_ns_ = std::max(now_ns_, recv_deadline_ns_);
+    *error = ETIMEDOUT;
+    return 0;
+  }
+
+  Reply r = in_flight_.top();
+  in_flight_.pop();
+  now_ns_ = std::max(now_ns_, r.arrival);
+  delivered_++;
+  if (r.hop == 0) {
+    from_ = destip_;
+  } else {
+    std::ostringstream router;
+    router << "10.255.0." << r.hop;
+    from_ = router.str();
+  }
+
+  *error = 0;
+  *send_time = r.send_time;
+  return r.seq;
+}
+
+void MpingSimTransport::WaitUntil(uint64_t deadline) {
+  now_ns_ = std::max(now_ns_, deadline);
+}
+
+void MpingSimTransport::ArmRecvTimeout(unsigned int seconds) {
+  recv_deadline_ns_ = now_ns_ + seconds * kNsPerSec;
+}
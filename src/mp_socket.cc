@@ -1,14 +1,21 @@
 #if defined(OS_LINUX) || defined(OS_MACOSX)
 #include <arpa/inet.h>
 #include <netinet/ip_icmp.h>
+#include <poll.h>
 #elif defined(OS_WINDOWS)
 #include <winsock2.h>
 #endif
 #include <errno.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "log.h"
+#include "mp_checksum.h"
+#include "mp_clock.h"
+#include "mp_local_drops.h"
+#include "mp_payload.h"
 #include "mp_socket.h"
+#include "mp_trace.h"
 #include "mlab/host.h"
 #include "mlab/mlab.h"
 #include "mlab/protocol_header.h"
@@ -18,9 +25,6 @@ namespace {
 
 const int kMPDefaultTTL = 128;
 
-const char *kPayloadHeader = "mlab-seq#";
-const int kPayloadHeaderLength = 9;
-
 int AddressFamilyFor(SocketFamily family) {
   switch (family) {
     case SOCKETFAMILY_UNSPEC: return AF_UNSPEC;
@@ -30,40 +34,81 @@ int AddressFamilyFor(SocketFamily family) {
   return AF_UNSPEC;
 }
 
+// Fills |sa| with numeric address |ip| and |port|, returns its length.
+socklen_t FillAddress(const std::string& ip, uint16_t port,
+                      sockaddr_storage *sa) {
+  memset(sa, 0, sizeof(*sa));
+  switch (mlab::GetSocketFamilyForAddress(ip)) {
+    case SOCKETFAMILY_IPV4: {
+      sockaddr_in *in = reinterpret_cast<sockaddr_in*>(sa);
+      in->sin_family = AF_INET;
+      in->sin_port = htons(port);
+      inet_pton(in->sin_family, ip.c_str(), &(in->sin_addr));
+      return sizeof(sockaddr_in);
+    }
+    case SOCKETFAMILY_IPV6: {
+      sockaddr_in6 *in6 = reinterpret_cast<sockaddr_in6*>(sa);
+      in6->sin6_family = AF_INET6;
+      in6->sin6_port = htons(port);
+      inet_pton(in6->sin6_family, ip.c_str(), &(in6->sin6_addr));
+      return sizeof(sockaddr_in6);
+    }
+    case SOCKETFAMILY_UNSPEC:
+      break;
+  }
+  return 0;
+}
+
+uint16_t UdpPort(uint16_t port) {
+  return port > 0 ? port : 32768 + (rand() % 32768);  // random port > 32768
+}
+
+// Numeric form of the address in |sa|.
+std::string AddressOf(const sockaddr_storage& sa) {
+  char addr[INET6_ADDRSTRLEN] = "";
+  const void *src = sa.ss_family == AF_INET6 ?
+      static_cast<const void *>(
+          &reinterpret_cast<const sockaddr_in6 *>(&sa)->sin6_addr) :
+      static_cast<const void *>(
+          &reinterpret_cast<const sockaddr_in *>(&sa)->sin_addr);
+  inet_ntop(sa.ss_family, src, addr, sizeof(addr));
+  return addr;
+}
+
+// Destination port of |flow|, wrapping within the ephemeral range.
+uint16_t FlowPort(uint16_t port, int flow) {
+  int p = port + flow;
+  return p > 65535 ? p - 32768 : p;
+}
+
 }  // namespace
 
 int MpingSocket::Initialize(const std::string& destip, const std::string& srcip,
                             int ttl, size_t pktsize, int wndsize,
                             uint16_t port, bool clientmode) {
-  family_ = mlab::GetSocketFamilyForAddress(destip);
-
-  ASSERT(family_ != SOCKETFAMILY_UNSPEC);
-  size_t min_size = 0;
-
-  // check packet size
-  switch (family_) {
-    case SOCKETFAMILY_IPV4: {
-      min_size = sizeof(mlab::IP4Header) + kPayloadHeaderLength +
-                 sizeof(unsigned int) + sizeof(mlab::ICMP4Header);
-      if (pktsize < min_size)
-        LOG(mlab::FATAL, "Packet size should be no less than %lu for IPv4.",
-            min_size);
-
-      break;
-    }
-    case SOCKETFAMILY_IPV6: {
-      min_size = sizeof(mlab::IP6Header) + kPayloadHeaderLength +
-                 sizeof(unsigned int) + sizeof(mlab::ICMP6Header);
-      if (pktsize < min_size)
-        LOG(mlab::FATAL, "Packet size should be no less than %lu for IPv6.",
-            min_size);
+  SocketFamily family = mlab::GetSocketFamilyForAddress(destip);
+  if (family == SOCKETFAMILY_UNSPEC) {
+    LOG(mlab::ERROR, "%s is not an IP address.", destip.c_str());
+    return -1;
+  }
 
-      break;
-    }
-    case SOCKETFAMILY_UNSPEC:
-      LOG(mlab::FATAL, "unknow destination address family.");
+  size_t payload_length = legacy_seq_ ? kLegacyPayloadLength :
+                                        kSessionPayloadLength;
+  size_t min_size = family == SOCKETFAMILY_IPV6 ?
+      sizeof(mlab::IP6Header) + payload_length + sizeof(mlab::ICMP6Header) :
+      sizeof(mlab::IP4Header) + payload_length + sizeof(mlab::ICMP4Header);
+  if (pktsize < min_size) {
+    LOG(mlab::ERROR, "Packet size should be no less than %lu for IPv%d.",
+        min_size, family == SOCKETFAMILY_IPV6 ? 6 : 4);
+    return -1;
   }
 
+  SocketFamily old_family = family_;
+  family_ = family;
+  payload_length_ = payload_length;
+  nonce_ = legacy_seq_ ? 0 : MpingNewNonce();
+  last_sent_ = 0;
+
   // handle sourceip
   if (srcip.length() != 0) {
     srcaddr_.ss_family =
@@ -88,6 +133,24 @@ int MpingSocket::Initialize(const std::string& destip, const std::string& srcip,
   }
 
   fromaddr_ = destip;
+  recv_deadline_ = 0;
+
+  // sockets of an earlier Initialize of the same family and transport
+  // only need to point at the new destination
+  if ((icmp_sock || udp_sock) && family_ == old_family &&
+      use_udp_ == (ttl != 0) && client_mode_ == clientmode &&
+      src_ip_ == srcip) {
+    return Retarget(destip, pktsize, wndsize, port);
+  }
+
+  delete uring_;  // before the socket it receives on
+  uring_ = NULL;
+  delete icmp_sock;
+  icmp_sock = NULL;
+  delete udp_sock;
+  udp_sock = NULL;
+  client_mode_ = false;
+  src_ip_ = srcip;
 
   // create sockets and initialize buffer
   // ICMP v4 and v6 buffer: ICMP header + payload
@@ -120,18 +183,14 @@ int MpingSocket::Initialize(const std::string& destip, const std::string& srcip,
                                                                     0, 0, 0));
         // TODO: add get buffer method to protocol headers
         memcpy(buffer_, icmphdr.get(), sizeof(mlab::ICMP4Header));
-        memcpy(buffer_ + sizeof(mlab::ICMP4Header), kPayloadHeader,
-               kPayloadHeaderLength);
-        buffer_length_ = sizeof(mlab::ICMP4Header) + kPayloadHeaderLength;
+        buffer_length_ = sizeof(mlab::ICMP4Header);
         break;
       }
       case SOCKETFAMILY_IPV6: {
         scoped_ptr<mlab::ICMP6Header> icmp6hdr(new mlab::ICMP6Header(128, 0,
                                                                      0, 0));
         memcpy(buffer_, icmp6hdr.get(), sizeof(mlab::ICMP6Header));
-        memcpy(buffer_ + sizeof(mlab::ICMP6Header), kPayloadHeader,
-               kPayloadHeaderLength);
-        buffer_length_ = sizeof(mlab::ICMP6Header) + kPayloadHeaderLength;
+        buffer_length_ = sizeof(mlab::ICMP6Header);
         break;
       }
       case SOCKETFAMILY_UNSPEC: {
@@ -140,25 +199,14 @@ int MpingSocket::Initialize(const std::string& destip, const std::string& srcip,
       }
     }
 
-    // validate buffer size
-    if (icmp_sock->GetRecvBufferSize() < (pktsize * wndsize)) {
-      LOG(mlab::WARNING, "Change recv buffer size.");
-      icmp_sock->SetRecvBufferSize(pktsize * wndsize);
-    }
-
+    // validate buffer size, the receive one is SetupRecvQueue's
     if (icmp_sock->GetSendBufferSize() < pktsize) {
       LOG(mlab::WARNING, "Change send buffer size.");
       icmp_sock->SetSendBufferSize(pktsize);
     }
   } else {  // UDP socket to send
     use_udp_ = true;
-    uint16_t dport;
-
-    if (port > 0) {
-      dport = port;
-    } else {
-      dport = 32768 + (rand() % 32768);  // random port > 32768
-    }
+    uint16_t dport = UdpPort(port);
 
     udp_sock = mlab::ClientSocket::Create(mlab::Host(destip), dport,
                                                SOCKETTYPE_UDP, family_);
@@ -169,25 +217,7 @@ int MpingSocket::Initialize(const std::string& destip, const std::string& srcip,
     // bind UDP socket to a src ip with port 0 (kernel will choose random port)
     if (srcip.length() != 0) {
       sockaddr_storage sa, da;
-      socklen_t size = 0;
-      switch (srcaddr_.ss_family) {
-        case AF_INET: {
-          sockaddr_in *in = reinterpret_cast<sockaddr_in*>(&da);
-          in->sin_family = AF_INET;
-          in->sin_port = htons(dport);
-          inet_pton(in->sin_family, destip.c_str(), &(in->sin_addr));
-          size = sizeof(sockaddr_in);
-          break;
-        }
-        case AF_INET6: {
-          sockaddr_in6 *in6 = reinterpret_cast<sockaddr_in6*>(&da);
-          in6->sin6_family = AF_INET6;
-          in6->sin6_port = htons(dport);
-          inet_pton(in6->sin6_family, destip.c_str(), &(in6->sin6_addr));
-          size = sizeof(sockaddr_in6);
-          break;
-        }
-      }
+      socklen_t size = FillAddress(destip, dport, &da);
 
       // un connect the socket to unbind it, otherwise the bind will fail
       sa.ss_family = AF_UNSPEC;
@@ -218,6 +248,8 @@ int MpingSocket::Initialize(const std::string& destip, const std::string& srcip,
 
     }
 
+    SetFlowAddresses(destip, dport);
+
     if (!clientmode) {
       // icmp to recv
       icmp_sock =
@@ -229,12 +261,7 @@ int MpingSocket::Initialize(const std::string& destip, const std::string& srcip,
 
       // icmp_sock->Connect(mlab::Host(destip));
 
-      // validate socket buffer size
-      if (icmp_sock->GetRecvBufferSize() < (pktsize * wndsize)) {
-        LOG(mlab::INFO, "Set recv buffer to %lu.", pktsize * wndsize);
-        icmp_sock->SetRecvBufferSize(pktsize * wndsize);
-      }
-
+      // validate socket buffer size, the receive one is SetupRecvQueue's
       if (udp_sock->GetSendBufferSize() < pktsize) {
         LOG(mlab::INFO, "Set send buffer to %lu.", pktsize * wndsize);
         udp_sock->SetSendBufferSize(pktsize);
@@ -243,14 +270,111 @@ int MpingSocket::Initialize(const std::string& destip, const std::string& srcip,
       client_mode_ = true;
     }
 
-    // build packet
-    memcpy(buffer_, kPayloadHeader, kPayloadHeaderLength);
-    buffer_length_ = kPayloadHeaderLength;
+    // build packet: payload only
+    buffer_length_ = 0;
+  }
+
+  if (busy_poll_) {
+    busy_poll_->Setup(client_mode_ ? udp_sock->raw() : icmp_sock->raw());
+  }
+
+  SetupRecvQueue(pktsize * wndsize);
+  SelectPaths();
+
+  if (use_uring_) {
+    std::string why;
+    uring_ = MpingUring::Create(
+        client_mode_ ? udp_sock->raw() : icmp_sock->raw(), pktsize, &why);
+    if (!uring_) {
+      LOG(mlab::WARNING, "No io_uring (%s), using plain sockets.",
+          why.c_str());
+    }
+  }
+
+  return 0;
+}
+
+int MpingSocket::Retarget(const std::string& destip, size_t pktsize,
+                          int wndsize, uint16_t port) {
+  // replies to the previous destination still queued fail the nonce
+  // check of the new one; the legacy payload has no nonce to tell them
+  sockaddr_storage da;
+  socklen_t size;
+  int fd;
+  if (use_udp_) {
+    uint16_t dport = UdpPort(port);
+    size = FillAddress(destip, dport, &da);
+    fd = udp_sock->raw();
+    SetFlowAddresses(destip, dport);
+  } else {  // only receive ECHO REP from destip, as Initialize
+    size = FillAddress(destip, 0, &da);
+    fd = icmp_sock->raw();
   }
 
+  if (connect(fd, reinterpret_cast<const sockaddr*>(&da), size) < 0) {
+    LOG(mlab::ERROR, "re-connect to %s fails. %s [%d]",
+        destip.c_str(), strerror(errno), errno);
+    return -1;
+  }
+
+  SetupRecvQueue(pktsize * wndsize);
   return 0;
 }
 
+void MpingSocket::SetupRecvQueue(size_t bytes) {
+  int fd = client_mode_ ? udp_sock->raw() : icmp_sock->raw();
+  size_t got = MpingSizeRecvBuffer(fd, bytes);
+  if (got < bytes) {
+    LOG(mlab::WARNING, "Receive buffer is %lu bytes, short of the %lu of "
+        "a full window; raise net.core.rmem_max or run with "
+        "CAP_NET_ADMIN.", got, bytes);
+  } else {
+    LOG(mlab::INFO, "Set recv buffer to %lu.", got);
+  }
+
+  if (!MpingEnableRxqOverflow(fd))
+    LOG(mlab::VERBOSE, "No SO_RXQ_OVFL. %s [%d]", strerror(errno), errno);
+
+  // count from here; replies to an earlier destination are not ours
+  rxq_drops_ = 0;
+  track_drops_ = false;
+  if (MpingSocketDrops(fd, &rxq_drops_)) {
+    track_drops_ = true;
+  }
+  drops_base_ = rxq_drops_;
+}
+
+bool MpingSocket::TakeLocalDrops(uint64_t *drops) {
+  if (!icmp_sock && !udp_sock)
+    return false;
+
+  // the counter as of now, or as of the last reply
+  uint32_t now = rxq_drops_;
+  int fd = client_mode_ ? udp_sock->raw() : icmp_sock->raw();
+  if (!MpingSocketDrops(fd, &now) && !track_drops_)
+    return false;
+
+  *drops = static_cast<uint32_t>(now - drops_base_);
+  drops_base_ = now;
+  return true;
+}
+
+void MpingSocket::SetFlowAddresses(const std::string& destip,
+                                   uint16_t port) {
+  flow_addrs_.clear();
+  if (flows_ <= 1)
+    return;
+
+  flow_addrs_.resize(flows_);
+  for (int i = 0; i < flows_; i++)
+    flow_addr_len_ = FillAddress(destip, FlowPort(port, i), &flow_addrs_[i]);
+}
+
+void MpingSocket::SetBusyPoll(unsigned int budget_us) {
+  delete busy_poll_;
+  busy_poll_ = budget_us > 0 ? new MpingBusyPoll(budget_us) : NULL;
+}
+
 bool MpingSocket::SetSendTTL(const int& ttl) {
   if (!use_udp_) {
     LOG(mlab::ERROR, "Not using UDP, no need to set TTL.");
@@ -258,239 +382,302 @@ bool MpingSocket::SetSendTTL(const int& ttl) {
   }
 
   ASSERT(udp_sock != NULL);
+  if (family_ == SOCKETFAMILY_IPV6) {  // IP_TTL only for v4-mapped
+    return setsockopt(udp_sock->raw(), IPPROTO_IPV6, IPV6_UNICAST_HOPS, &ttl,
+                      sizeof(ttl)) == 0;
+  }
   return setsockopt(udp_sock->raw(), IPPROTO_IP, IP_TTL, &ttl, sizeof(ttl)) ==
          0;
 }
 
 MpingSocket::~MpingSocket() {
+  delete uring_;
+  uring_ = NULL;
+
   delete icmp_sock;
   icmp_sock = NULL;
 
   delete udp_sock;
   udp_sock = NULL;
+
+  delete busy_poll_;
+  busy_poll_ = NULL;
 }
 
-bool MpingSocket::SendPacket(const unsigned int& seq, size_t size,
-                             int *error) const {
-  char buf[size];
-  size_t send_size = 0;
-  unsigned int* seq_ptr;
+bool MpingSocket::SendPacket(const uint64_t& seq, size_t size,
+                             int *error) {
+  ASSERT(send_ != NULL);
+  return (this->*send_)(seq, size, error);
+}
 
-  ASSERT(family_ != SOCKETFAMILY_UNSPEC);
+uint64_t MpingSocket::ReceiveAndGetSeq(int* error, MpingStat *mpstat,
+                                       uint64_t *send_time) {
+  ASSERT(receive_ != NULL);
+  ASSERT(mpstat != NULL);
+  return (this->*receive_)(error, mpstat, send_time);
+}
 
+void MpingSocket::SelectPaths() {
   switch (family_) {
-    case SOCKETFAMILY_IPV4: {
-      if (size < sizeof(mlab::IP4Header) + buffer_length_ + sizeof(seq)) {
-        LOG(mlab::FATAL, "send packet size is smaller than MIN.");
-      }
-      send_size = size - sizeof(mlab::IP4Header);
-      if (use_udp_) {
-        send_size -= sizeof(mlab::UDPHeader);
+    case SOCKETFAMILY_IPV4:
+      if (!use_udp_) {
+        send_ = &MpingSocket::SendAs<SOCKETFAMILY_IPV4, kProbeEcho>;
+        receive_ = &MpingSocket::ReceiveAs<SOCKETFAMILY_IPV4, kProbeEcho>;
+      } else if (!client_mode_) {
+        send_ = &MpingSocket::SendAs<SOCKETFAMILY_IPV4, kProbeUdpErrors>;
+        receive_ =
+            &MpingSocket::ReceiveAs<SOCKETFAMILY_IPV4, kProbeUdpErrors>;
+      } else {
+        send_ = &MpingSocket::SendAs<SOCKETFAMILY_IPV4, kProbeUdpClient>;
+        receive_ =
+            &MpingSocket::ReceiveAs<SOCKETFAMILY_IPV4, kProbeUdpClient>;
       }
       break;
-    }
-    case SOCKETFAMILY_IPV6: {
-      if (size < sizeof(mlab::IP6Header) + buffer_length_ + sizeof(seq)) {
-        LOG(mlab::FATAL, "send packet size is smaller than MIN.");
-      }
-      send_size = size - sizeof(mlab::IP6Header);
-      if (use_udp_) {
-        send_size -= sizeof(mlab::UDPHeader);
+    case SOCKETFAMILY_IPV6:
+      if (!use_udp_) {
+        send_ = &MpingSocket::SendAs<SOCKETFAMILY_IPV6, kProbeEcho>;
+        receive_ = &MpingSocket::ReceiveAs<SOCKETFAMILY_IPV6, kProbeEcho>;
+      } else if (!client_mode_) {
+        send_ = &MpingSocket::SendAs<SOCKETFAMILY_IPV6, kProbeUdpErrors>;
+        receive_ =
+            &MpingSocket::ReceiveAs<SOCKETFAMILY_IPV6, kProbeUdpErrors>;
+      } else {
+        send_ = &MpingSocket::SendAs<SOCKETFAMILY_IPV6, kProbeUdpClient>;
+        receive_ =
+            &MpingSocket::ReceiveAs<SOCKETFAMILY_IPV6, kProbeUdpClient>;
       }
       break;
-    }
-    case SOCKETFAMILY_UNSPEC: return 0;
+    case SOCKETFAMILY_UNSPEC:
+      send_ = NULL;
+      receive_ = NULL;
+      break;
   }
+}
 
-  memcpy(buf, buffer_, buffer_length_);
-  seq_ptr = reinterpret_cast<unsigned int*>(buf + buffer_length_);
-  *seq_ptr = htonl(seq);
+template <SocketFamily F, MpingProbeMode M>
+bool MpingSocket::SendAs(const uint64_t& seq, size_t size, int *error) {
+  typedef MpingProbeLayout<F, M> Layout;
+
+  if (size < Layout::kSendOverhead + Layout::kProbeHeader + payload_length_) {
+    *error = EINVAL;  // smaller than the headers and payload
+    return false;
+  }
 
-  bool success = false;
-  // TODO: use protocol enum so that adding TCP is trivial
-  if (!use_udp_) {  // ICMP
-    ASSERT(icmp_sock != NULL);
-    if (family_ == SOCKETFAMILY_IPV4) {
-      // set checksum
+  size_t send_size = size - Layout::kSendOverhead;
+  char buf[send_size];
+  memcpy(buf, buffer_, Layout::kProbeHeader);
+  MpingWritePayload(buf + Layout::kProbeHeader, legacy_seq_, nonce_, seq,
+                    NowNs());
+  last_sent_ = seq;
+
+  int flow = flows_ > 1 ? static_cast<int>((seq - 1) % flows_) : 0;
+  if (M == kProbeEcho) {
+    if (flows_ > 1) {  // echo identifier, after type, code and checksum
+      uint16_t id = htons(static_cast<uint16_t>(flow));
+      memcpy(buf + 4, &id, sizeof(id));
+    }
+    if (F == SOCKETFAMILY_IPV4) {  // the kernel does ICMPv6's
       mlab::ICMP4Header *p = reinterpret_cast<mlab::ICMP4Header *>(buf);
-      p->icmp_checksum = mlab::InternetCheckSum(buf, send_size);
+      p->icmp_checksum = MpingCheckSum(buf, send_size);
     }
-    ssize_t bytes_sent = 0;
-    success = icmp_sock->Send(mlab::Packet(buf, send_size), &bytes_sent);
-    if (!success) *error = errno;
-  } else {  // UDP
-    ASSERT(udp_sock != NULL);
-    ssize_t bytes_sent = 0;
-    success = udp_sock->Send(mlab::Packet(buf, send_size), &bytes_sent);
-    if (!success) *error = errno;
   }
-  return success;
-}
 
-unsigned int MpingSocket::ReceiveAndGetSeq(int* error, MpingStat *mpstat) {
-  if (client_mode_) {
-    ASSERT(udp_sock != NULL);
+  int fd = M == kProbeEcho ? icmp_sock->raw() : udp_sock->raw();
+  const sockaddr_storage *to = M != kProbeEcho && !flow_addrs_.empty() ?
+                               &flow_addrs_[flow] : NULL;
+  if (uring_) {  // queued, leaves with the next receive
+    if (!uring_->QueueSend(fd, buf, send_size,
+                           reinterpret_cast<const sockaddr*>(to),
+                           flow_addr_len_, error)) {
+      return false;
+    }
   } else {
-    ASSERT(icmp_sock != NULL);
+    // connected but for the UDP port of each flow
+    ssize_t sent = to ? sendto(fd, buf, send_size, 0,
+                               reinterpret_cast<const sockaddr*>(to),
+                               flow_addr_len_) :
+                        send(fd, buf, send_size, 0);
+    if (sent < 0) {
+      *error = errno;
+      return false;
+    }
   }
-  ASSERT(mpstat != NULL);
-  ASSERT(family_ != SOCKETFAMILY_UNSPEC);
+  MPING_TRACE_SEND(seq, send_size);
+  return true;
+}
 
-//  size_t recv_size = 0;
-  size_t min_recv_size = 0;
-  size_t should_recv_size = 0;
-  size_t icmp_offset = 0;
-  size_t payload_offset = sizeof(mlab::ICMP4Header);
-  int err = 0;
+template <SocketFamily F, MpingProbeMode M>
+uint64_t MpingSocket::ReceiveAs(int* error, MpingStat *mpstat,
+                                uint64_t *send_time) {
+  typedef MpingProbeLayout<F, M> Layout;
+  typedef typename Layout::IcmpHeader IcmpHeader;
+
+  const size_t should_recv_size = Layout::kRecvHeaders + payload_length_;
+  int fd = M == kProbeUdpClient ? udp_sock->raw() : icmp_sock->raw();
+  char buf[should_recv_size];
+  std::string from;
 
   LOG(mlab::VERBOSE, "start receive loop.");
 
-  switch (family_) {
-    case SOCKETFAMILY_IPV4: {
-      min_recv_size = sizeof(mlab::IP4Header) + sizeof(mlab::ICMP4Header);
-      icmp_offset = sizeof(mlab::IP4Header);
-
-      if (use_udp_) {
-        // recv_size = size + sizeof(mlab::IP4Header) + 
-         //           sizeof(mlab::ICMP4Header);
-        should_recv_size = 2 * sizeof(mlab::IP4Header) + 
-                           sizeof(mlab::ICMP4Header) +
-                           sizeof(mlab::UDPHeader) +
-                           buffer_length_ + sizeof(unsigned int);
-        payload_offset = payload_offset +
-                         sizeof(mlab::IP4Header) + sizeof(mlab::UDPHeader);
-      } else {
-        // recv_size = size;
-        should_recv_size = sizeof(mlab::IP4Header) + buffer_length_ + 
-                      sizeof(unsigned int);
+  while (1) {
+    ssize_t recv_bytes;
+    sockaddr_storage sa;
+    if (uring_) {
+      uint64_t now = MpingClock::NowNs();
+      uint64_t wait = !recv_deadline_ ? ~0ULL :
+          recv_deadline_ > now ? recv_deadline_ - now : 0;
+      recv_bytes = uring_->Receive(buf, should_recv_size, &sa, wait, error);
+      if (recv_bytes < 0)
+        return 0;
+    } else {
+      if (busy_poll_) {
+        int spin = busy_poll_->Spin(fd);
+        if (spin == EINTR) {
+          *error = EINTR;
+          return 0;
+        }
       }
-
-      break;
-    }
-    case SOCKETFAMILY_IPV6: {
-      if (use_udp_) {
-        // recv_size = size + sizeof(mlab::ICMP6Header);
-        should_recv_size = sizeof(mlab::ICMP6Header) + 
-                           sizeof(mlab::IP6Header) +
-                           sizeof(mlab::UDPHeader) +
-                           buffer_length_ + sizeof(unsigned int);
-        payload_offset = payload_offset + 
-                         sizeof(mlab::IP6Header) + sizeof(mlab::UDPHeader);
-      } else {
-        // recv_size = size - sizeof(mlab::IP6Header);
-        should_recv_size = buffer_length_ + sizeof(unsigned int);
+      if (recv_deadline_) {
+        uint64_t now = MpingClock::NowNs();
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        // past the deadline, still take what is already queued
+        int wait_ms = now < recv_deadline_ ? static_cast<int>(
+            (recv_deadline_ - now + kNsPerMs - 1) / kNsPerMs) : 0;
+        int ready = poll(&pfd, 1, wait_ms);
+        if (ready <= 0) {
+          *error = ready < 0 ? errno : EAGAIN;
+          return 0;
+        }
       }
 
-      min_recv_size = sizeof(mlab::ICMP6Header);
-      break;
-    }
-    case SOCKETFAMILY_UNSPEC:
-      return 0;
-  }
-
-  if (client_mode_) {
-    should_recv_size = buffer_length_ + sizeof(unsigned int);
-    payload_offset = 0;
-  }
-
-  const char *ptr;
-  while (1) {
-    mlab::Packet recv_packet("");
-    ssize_t recv_bytes = 0;
-    if (client_mode_) {
-      recv_packet = udp_sock->Receive(should_recv_size, &recv_bytes);
-    } else {
-      recv_packet = icmp_sock->Receive(should_recv_size, &recv_bytes);
-    }
-    if (recv_bytes < 0) {
-      *error = errno;
-      return 0;
+      struct iovec iov;
+      iov.iov_base = buf;
+      iov.iov_len = should_recv_size;
+      char control[kMpingRxqControlSize];
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_name = &sa;
+      msg.msg_namelen = sizeof(sa);
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      recv_bytes = recvmsg(fd, &msg, 0);
+      if (recv_bytes < 0) {
+        *error = errno;
+        return 0;
+      }
+      // the drop counter rides along with SO_RXQ_OVFL
+      if (MpingRxqOverflow(&msg, &rxq_drops_))
+        track_drops_ = true;
     }
 
-    ptr = recv_packet.buffer();
-
-    if (!client_mode_) {
-      // check length: ICMP?
-      if (recv_packet.length() < min_recv_size) {
+    MPING_TRACE_RECEIVE(recv_bytes);
+    uint64_t parse = profile_ ? profile_->Start() : 0;
+
+    // ICMP errors come from the hop that dropped the probe, not the
+    // destination: keep where from
+    if (M == kProbeUdpErrors)
+      from = AddressOf(sa);
+
+    const char *ptr = NULL;
+    const IcmpHeader *icmp_ptr =
+        reinterpret_cast<const IcmpHeader *>(buf + Layout::kIcmpOffset);
+    MpingReplyKind kind = MpingClassifyReply<F, M>(buf, recv_bytes,
+                                                   payload_length_, &ptr);
+    MPING_TRACE_CLASSIFY(kind);
+    if (kind != kReplyOk && profile_)
+      profile_->Stop(MpingProfile::kParse, parse);
+    switch (kind) {
+      case kReplyOk:
+        break;
+      case kReplyShort:
         LOG(mlab::VERBOSE, "recv a packet smaller than regular %s.",
-            family_==SOCKETFAMILY_IPV4?"ICMP":"ICMPv6");
+            F == SOCKETFAMILY_IPV4 ? "ICMP" : "ICMPv6");
         mpstat->LogUnexpected();
         continue;
-      }
-      ptr += icmp_offset;  // now ptr is at icmp header
-      const mlab::ICMP4Header *icmp_ptr =
-          reinterpret_cast<const mlab::ICMP4Header *>(ptr);
-
-      // check length: include payload?
-      if (recv_packet.length() < should_recv_size) {
+      case kReplyTruncated:
         LOG(mlab::VERBOSE,
             "recv icmp packet size is smaller than expected. "
             "ICMP type %u code %u.", icmp_ptr->icmp_type,
             icmp_ptr->icmp_code);
         mpstat->LogUnexpected();
         continue;
-      }
-
-      // check ICMP message type: echo reply? or dst_unreach time_exceeded?
-      if (use_udp_) {
-        if (icmp_ptr->icmp_type !=
-                (family_==SOCKETFAMILY_IPV4?ICMP_DEST_UNREACH:1) &&
-            icmp_ptr->icmp_type !=
-                (family_==SOCKETFAMILY_IPV4?ICMP_TIME_EXCEEDED:3)) {
+      case kReplyWrongType:
+        if (M == kProbeEcho) {
           LOG(mlab::VERBOSE,
-              "recv an ICMP message with wrong type, type %u code %u",
+              "recv a non-echoreply packet. ICMP type %u, code %u.",
               icmp_ptr->icmp_type, icmp_ptr->icmp_code);
-          mpstat->LogUnexpected();
-          continue;
-        }
-
-        // UDP, check IP protocol type: UDP?
-        uint8_t proto;
-        if (family_==SOCKETFAMILY_IPV4) {
-          const mlab::IP4Header *ip_ptr = 
-              reinterpret_cast<const mlab::IP4Header *>(ptr + 
-                                                     sizeof(mlab::ICMP4Header));
-          proto = ip_ptr->protocol;
         } else {
-          const mlab::IP6Header *ip_ptr = 
-              reinterpret_cast<const mlab::IP6Header *>(ptr + 
-                                                     sizeof(mlab::ICMP4Header));
-          proto = ip_ptr->next_header;
-        }
-
-        if (proto != IPPROTO_UDP) {
-          LOG(mlab::VERBOSE, "not an ICMP for UDP, for protocol %u.", proto);
-          mpstat->LogUnexpected();
-          continue;
-        }
-      } else {
-        if (icmp_ptr->icmp_type != 
-                (family_==SOCKETFAMILY_IPV4?ICMP_ECHOREPLY:129)) {
           LOG(mlab::VERBOSE,
-              "recv a non-echoreply packet. ICMP type %u, code %u.",
+              "recv an ICMP message with wrong type, type %u code %u",
               icmp_ptr->icmp_type, icmp_ptr->icmp_code);
-          mpstat->LogUnexpected();
-          continue;
         }
-      }
+        mpstat->LogUnexpected();
+        continue;
+      case kReplyNotUdp:
+        LOG(mlab::VERBOSE, "not an ICMP for UDP, for protocol %u.",
+            Layout::Family::Protocol(
+                reinterpret_cast<const typename Layout::IpHeader *>(
+                    icmp_ptr + 1)));
+        mpstat->LogUnexpected();
+        continue;
     }
 
     // check payload
-    ptr += payload_offset;  // now ptr is at the beginning of the payload
-    std::string head(ptr, kPayloadHeaderLength);
-    if (head.compare(kPayloadHeader) != 0) {
+    size_t left = recv_bytes - (ptr - buf);
+    bool legacy;
+    uint32_t nonce;
+    uint64_t seq;
+    bool ours = MpingReadPayload(ptr, left, &legacy, &nonce, &seq, send_time);
+    if (profile_)
+      profile_->Stop(MpingProfile::kParse, parse);
+    if (!ours) {
       LOG(mlab::VERBOSE, "recv an packet not for this program.");
       mpstat->LogUnexpected();
       continue;
     }
 
-    ptr += kPayloadHeaderLength;
-    const unsigned int *seq = reinterpret_cast<const unsigned int*>(ptr);
-    *error = err;
-    return ntohl(*seq);
+    // another run to the same host, or the other payload format: not
+    // ours, keep it out of the stats
+    if (legacy != legacy_seq_ || nonce != nonce_) {
+      LOG(mlab::VERBOSE, "recv a packet of another session, nonce %x.",
+          nonce);
+      continue;
+    }
+
+    if (!from.empty())
+      fromaddr_ = from;
+    *error = 0;
+    return legacy ? MpingWidenSeq(static_cast<uint32_t>(seq), last_sent_) :
+                    seq;
   }
 }
 
+int MpingSocket::recv_fd() const {
+  if (uring_)
+    return uring_->fd();
+  if (client_mode_)
+    return udp_sock ? udp_sock->raw() : -1;
+  return icmp_sock ? icmp_sock->raw() : -1;
+}
+
 const std::string MpingSocket::GetFromAddress() const {
   return fromaddr_;
 }
+
+uint64_t MpingSocket::NowNs() {
+  return MpingClock::NowNs();
+}
+
+void MpingSocket::WaitUntil(uint64_t deadline) {
+  MpingClock::WaitUntil(deadline);
+}
+
+void MpingSocket::ArmRecvTimeout(unsigned int seconds) {
+  // SIGALRM interrupts the blocking recv with EINTR.
+  alarm(seconds);
+}
@@ -0,0 +1,58 @@
+#include <algorithm>
+#include <iostream>
+
+#include "mp_stat_split.h"
+#include "mp_stats.h"
+#include "log.h"
+
+MpingStatSplit::MpingStatSplit(int classes, int win_size,
+                               bool keep_send_times, double loss_timeout) {
+  ASSERT(classes > 0);
+
+  // each class holds its share of the window
+  int share = std::max(1, win_size / classes);
+  for (int i = 0; i < classes; i++) {
+    stats_.push_back(new MpingStat(share, keep_send_times));
+    stats_.back()->SetLossTimeout(loss_timeout);
+  }
+}
+
+MpingStatSplit::~MpingStatSplit() {
+  for (size_t i = 0; i < stats_.size(); i++)
+    delete stats_[i];
+}
+
+MpingStat* MpingStatSplit::StatFor(uint64_t seq, uint64_t *sub) const {
+  *sub = (seq - 1) / stats_.size() + 1;
+  return stats_[ClassFor(seq)];
+}
+
+void MpingStatSplit::EnqueueSend(uint64_t seq, uint64_t time) {
+  uint64_t sub;
+  StatFor(seq, &sub)->EnqueueSend(sub, time);
+}
+
+void MpingStatSplit::EnqueueRecv(uint64_t seq, uint64_t time,
+                                 uint64_t send_time) {
+  uint64_t sub;
+  StatFor(seq, &sub)->EnqueueRecv(sub, time, send_time);
+}
+
+void MpingStatSplit::Expire(uint64_t now) {
+  for (size_t i = 0; i < stats_.size(); i++)
+    stats_[i]->Expire(now);
+}
+
+void MpingStatSplit::PrintTemp(const std::vector<std::string>& labels) {
+  for (size_t i = 0; i < stats_.size(); i++) {
+    std::cout << labels[i] << ": ";
+    stats_[i]->PrintTempStats();
+  }
+}
+
+void MpingStatSplit::Print(const std::vector<std::string>& labels) {
+  for (size_t i = 0; i < stats_.size(); i++) {
+    std::cout << labels[i] << ": ";
+    stats_[i]->PrintStats();
+  }
+}
@@ -1,71 +1,255 @@
-#include <climits>
+#include <math.h>
+
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 
 #include "mlab/mlab.h"
+#include "mp_clock.h"
 #include "mp_mping.h"
+#include "mp_shm.h"
 #include "mp_stats.h"
+#include "mp_trace.h"
 #include "log.h"
 
 namespace {
 
-double time_sub(const struct timeval *new_t, const struct timeval *old_t) {
-  struct timeval temp;
+const uint64_t kWordBits = 64;
+const double kInitialTimeout = 1000.0;  // ms, before any RTT sample
+const double kMinTimeout = 10.0;  // ms
+const double kTimeoutGranularity = 1.0;  // ms, the wheel tick
+const uint64_t kReorderThreshold = 3;  // as TCP's duplicate ACKs
 
-  temp.tv_usec = new_t->tv_usec - old_t->tv_usec;
-  temp.tv_sec = new_t->tv_sec - old_t -> tv_sec;
-  if (temp.tv_usec < 0) {
-    --temp.tv_sec;
-    temp.tv_usec += 1000000;
-  }
+double time_sub(uint64_t new_t, uint64_t old_t) {
+  return (int64_t)(new_t - old_t) / (double)kNsPerMs;  // in millisec
+}
+
+int PopCount(uint64_t word) {
+  return __builtin_popcountll(word);
+}
 
-  return (temp.tv_sec * 1000.0 + temp.tv_usec / 1000.0);  // in millisec
+// Bits of word |w| for sequences first..last, at least one in the word.
+uint64_t WordMask(uint64_t w, uint64_t first, uint64_t last) {
+  uint64_t lo = first > w * kWordBits ? (first - 1) % kWordBits : 0;
+  uint64_t hi = std::min(last - 1 - w * kWordBits, kWordBits - 1);
+  return (hi == kWordBits - 1 ? ~0ULL : (1ULL << (hi + 1)) - 1) &
+         ~((1ULL << lo) - 1);
 }
 
 }  // namespace
 
-void MpingStat::EnqueueSend(unsigned int seq, 
-                            struct timeval time) {
-  SendQueueNode TempNode;
-  TempNode.seq = seq;
-  TempNode.send_time = time;
-  TempNode.recv_time.tv_sec = 0;
-  TempNode.recv_time.tv_usec = 0;
+MpingStat::MpingStat(const int& win_size, bool keep_send_times)
+    : unexpect_num_(0),
+      unexpect_num_temp_(0),
+      max_recv_seq_(1),
+      out_of_order_(0),
+      out_of_order_temp_(0),
+      recv_num_(0),
+      recv_num_temp_(0),
+      recv_unique_num_(0),
+      recv_unique_num_temp_(0),
+      send_num_(0),
+      send_num_temp_(0),
+      duplicate_num_(0),
+      duplicate_num_temp_(0),
+      lost_num_(0),
+      lost_num_temp_(0),
+      late_num_(0),
+      late_num_temp_(0),
+      lost_earlier_temp_(0),
+      track_local_drops_(false),
+      local_drops_(0),
+      local_drops_temp_(0),
+      window_size_(win_size),
+      timeout_ms_(0.0),
+      srtt_(-1.0),
+      rttvar_(0.0),
+      min_rtt_(-1.0),
+      last_rtt_(-1.0),
+      interval_(0),
+      interval_first_seq_(1),
+      wheel_(static_cast<uint64_t>(kTimeoutGranularity * kNsPerMs)),
+      in_flight_(0),
+      reorder_threshold_(kReorderThreshold),
+      reorder_seq_(0),
+      max_sent_seq_(0),
+      base_word_(0) {
+  // 4 windows of history, plus the word being filled
+  size_t words = (4 * std::max(win_size, 1) + kWordBits - 1) / kWordBits + 1;
+  recv_bitmap_.resize(words, 0);
+  lost_bitmap_.resize(words, 0);
+  released_bitmap_.resize(words, 0);
+  if (keep_send_times)
+    send_times_.resize(words * kWordBits, 0);
+}
+
+void MpingStat::Advance(uint64_t seq) {
+  uint64_t word = (seq - 1) / kWordBits;
+  while (word >= base_word_ + recv_bitmap_.size()) {
+    size_t idx = base_word_ % recv_bitmap_.size();
+    uint64_t first = base_word_ * kWordBits + 1;
+    uint64_t unresolved = ~(recv_bitmap_[idx] | lost_bitmap_[idx]);
+    unsigned int lost = PopCount(unresolved);
+    // charged to the interval they were sent in, as ChargeLost does
+    unsigned int earlier = 0;
+    if (interval_first_seq_ > first) {
+      uint64_t last = std::min(interval_first_seq_ - 1,
+                               first + kWordBits - 1);
+      earlier = PopCount(unresolved & WordMask(base_word_, first, last));
+    }
+    if (lost)
+      MPING_TRACE_LOSS(first, first + kWordBits - 1, lost);
+    lost_num_ += lost;
+    lost_num_temp_ += lost - earlier;
+    lost_earlier_temp_ += earlier;
+    in_flight_ -= kWordBits - PopCount(released_bitmap_[idx]);
+    recv_bitmap_[idx] = 0;
+    lost_bitmap_[idx] = 0;
+    released_bitmap_[idx] = 0;
+    base_word_++;
+  }
+}
+
+void MpingStat::ChargeLost(const MpingTimerWheel::Run& run) {
+  uint64_t first = std::max(run.first, base_word_ * kWordBits + 1);
+  uint64_t last = std::min(run.last, max_sent_seq_);
+  unsigned int lost = 0;
+
+  // word by word: bits first..last not received nor lost yet
+  for (uint64_t w = (first - 1) / kWordBits;
+       first <= last && w <= (last - 1) / kWordBits; w++) {
+    size_t idx = w % recv_bitmap_.size();
+    uint64_t mask = WordMask(w, first, last) &
+                    ~(recv_bitmap_[idx] | lost_bitmap_[idx]);
+    lost_bitmap_[idx] |= mask;
+    lost += PopCount(mask);
+  }
+  if (first <= last)
+    Release(first, last);
+
+  if (lost)
+    MPING_TRACE_LOSS(first, last, lost);
+  lost_num_ += lost;
+  if (run.interval == interval_)
+    lost_num_temp_ += lost;
+  else
+    lost_earlier_temp_ += lost;
+}
+
+unsigned int MpingStat::Release(uint64_t first, uint64_t last) {
+  first = std::max(first, base_word_ * kWordBits + 1);
+  last = std::min(last, max_sent_seq_);
+  unsigned int released = 0;
+
+  for (uint64_t w = (first - 1) / kWordBits;
+       first <= last && w <= (last - 1) / kWordBits; w++) {
+    size_t idx = w % released_bitmap_.size();
+    uint64_t mask = WordMask(w, first, last) & ~released_bitmap_[idx];
+    released_bitmap_[idx] |= mask;
+    released += PopCount(mask);
+  }
+
+  in_flight_ -= released;
+  return released;
+}
+
+void MpingStat::SampleRtt(double rtt) {
+  last_rtt_ = rtt;
+  if (min_rtt_ < 0 || rtt < min_rtt_)
+    min_rtt_ = rtt;
+
+  // RFC 6298
+  if (srtt_ < 0) {
+    srtt_ = rtt;
+    rttvar_ = rtt / 2;
+  } else {
+    rttvar_ = 0.75 * rttvar_ + 0.25 * fabs(srtt_ - rtt);
+    srtt_ = 0.875 * srtt_ + 0.125 * rtt;
+  }
+}
+
+double MpingStat::loss_timeout() const {
+  if (timeout_ms_ > 0)
+    return timeout_ms_;
+  if (srtt_ < 0)
+    return kInitialTimeout;
+
+  // RFC 6298, but at least srtt / 2 of slack: a queue building up moves
+  // the RTT in steps that the variance has not seen yet
+  return std::max(kMinTimeout, srtt_ + std::max(srtt_ / 2, 4 * rttvar_));
+}
+
+void MpingStat::Expire(uint64_t now) {
+  wheel_.Advance(now, &expired_);
+  for (size_t i = 0; i < expired_.size(); i++)
+    ChargeLost(expired_[i]);
+  expired_.clear();
+}
 
-  int idx = (seq-1) % send_queue_size_;  // seq 1 is stored at send_queue[0]
+void MpingStat::EnqueueSend(uint64_t seq, uint64_t time) {
   send_num_++;
   send_num_temp_++;
 
-  if (seq <= send_queue_size_) {  // no record in queue
-    send_queue.push_back(TempNode);
-  } else {
-    if (send_queue.at(idx).recv_time.tv_sec == 0) {  // previous one recved
-      lost_num_++;
-      lost_num_temp_++;
-    } 
+  Expire(time);
+  Advance(seq);
+  if (seq > max_sent_seq_)
+    max_sent_seq_ = seq;
+  in_flight_++;
+  wheel_.Add(seq, time + static_cast<uint64_t>(loss_timeout() * kNsPerMs),
+             interval_);
+  if (!send_times_.empty())
+    send_times_[(seq - 1) % send_times_.size()] = time;
 
-    send_queue.at(idx) = TempNode;
-  }
-  
 #ifdef MP_PRINT_TIMELINE
   // timeline
-  if (seq > INT_MAX) {
-    LOG(mlab::FATAL, "send sequence number is too large.");
-  } else {
-    timeline.push_back((int)seq);
-  }
+  timeline.push_back((int64_t)seq);
 #endif
 }
 
-void MpingStat::EnqueueRecv(unsigned int seq, 
-                            struct timeval time) {
-  int idx = (seq-1) % send_queue_size_;
+double MpingStat::EnqueueRecv(uint64_t seq, uint64_t time,
+                              uint64_t send_time) {
+  double rtt = -1.0;
 
-  if (send_queue.at(idx).seq == seq) {
-    if (send_queue.at(idx).recv_time.tv_sec == 0) {
+  Expire(time);
+  if (seq == 0 || seq > max_sent_seq_) {
+    unexpect_num_++;
+    unexpect_num_temp_++;
+  } else if ((seq - 1) / kWordBits < base_word_) {
+    // slid out of the bitmap and charged as lost, the stamp it carries
+    // still gives the RTT
+    late_num_++;
+    late_num_temp_++;
+    if (send_time != 0) {
+      rtt = time_sub(time, send_time);
+      SampleRtt(rtt);
+    }
+  } else {
+    size_t idx = ((seq - 1) / kWordBits) % recv_bitmap_.size();
+    uint64_t& word = recv_bitmap_[idx];
+    uint64_t bit = 1ULL << ((seq - 1) % kWordBits);
+
+    if (lost_bitmap_[idx] & bit) {  // timed out, charged as lost already
+      late_num_++;
+      late_num_temp_++;
+      if (send_time != 0)
+        rtt = time_sub(time, send_time);
+      else if (!send_times_.empty())
+        rtt = time_sub(time, send_times_[(seq - 1) % send_times_.size()]);
+      // no retransmissions, so no ambiguity: a timeout that was too short
+      // must learn from it
+      if (rtt >= 0)
+        SampleRtt(rtt);
+    } else if ((word & bit) == 0) {
+      word |= bit;
+      Release(seq, seq);
       recv_unique_num_++;
       recv_unique_num_temp_++;
-      send_queue.at(idx).recv_time = time;  // only record first recv time
+      if (send_time != 0)
+        rtt = time_sub(time, send_time);
+      else if (!send_times_.empty())
+        rtt = time_sub(time, send_times_[(seq - 1) % send_times_.size()]);
+      if (rtt >= 0)
+        SampleRtt(rtt);
     } else {  // dup packet
       duplicate_num_++;
       duplicate_num_temp_++;
@@ -76,10 +260,14 @@ void MpingStat::EnqueueRecv(unsigned int seq,
       out_of_order_temp_++;
     } else {
       max_recv_seq_ = seq;
+      // what trails it by more than the threshold is not coming back in
+      // time to matter for the window
+      if (reorder_threshold_ > 0 && seq > reorder_threshold_ + 1 &&
+          seq - reorder_threshold_ - 1 > reorder_seq_) {
+        Release(reorder_seq_ + 1, seq - reorder_threshold_ - 1);
+        reorder_seq_ = seq - reorder_threshold_ - 1;
+      }
     }
-  } else if (seq > send_queue.at(idx).seq) {
-    unexpect_num_++;
-    unexpect_num_temp_++;
   }
 
   recv_num_++;
@@ -87,13 +275,39 @@ void MpingStat::EnqueueRecv(unsigned int seq,
 
   // timeline
 #ifdef MP_PRINT_TIMELINE
-  if (seq > INT_MAX) {
-    LOG(mlab::FATAL, "recv sequence number is too large.");
-  } else {
-    int s = (int)seq;
-    timeline.push_back(0 - s);
-  }
+  timeline.push_back(0 - (int64_t)seq);
 #endif
+
+  return rtt;
+}
+
+void MpingStat::Snapshot(MpingShmStats *out) const {
+  out->interval = interval_;
+  out->sent = send_num_;
+  out->received = recv_unique_num_;
+  out->total_received = recv_num_;
+  out->out_of_order = out_of_order_;
+  out->lost = lost_num_;
+  out->dup = duplicate_num_;
+  out->unexpected = unexpect_num_;
+  out->late = late_num_;
+
+  out->sent_temp = send_num_temp_;
+  out->received_temp = recv_unique_num_temp_;
+  out->total_received_temp = recv_num_temp_;
+  out->out_of_order_temp = out_of_order_temp_;
+  out->lost_temp = lost_num_temp_;
+  out->dup_temp = duplicate_num_temp_;
+  out->unexpected_temp = unexpect_num_temp_;
+  out->late_temp = late_num_temp_;
+  out->lost_earlier_temp = lost_earlier_temp_;
+
+  out->in_flight = in_flight_;
+  out->srtt = srtt_;
+  out->rttvar = rttvar_;
+  out->min_rtt = min_rtt_;
+  out->last_rtt = last_rtt_;
+  out->loss_timeout = loss_timeout();
 }
 
 void MpingStat::LogUnexpected() {
@@ -101,6 +315,12 @@ void MpingStat::LogUnexpected() {
   unexpect_num_temp_++;
 }
 
+void MpingStat::OnLocalDrops(uint64_t n) {
+  track_local_drops_ = true;
+  local_drops_ += n;
+  local_drops_temp_ += n;
+}
+
 void MpingStat::PrintTimeLine() const {
   unsigned int idx = 0;
   while (idx<timeline.size()) {
@@ -121,8 +341,16 @@ void MpingStat::PrintTempStats() {
                " total received " << recv_num_temp_ << " out-of-order " << 
                out_of_order_temp_ << " lost " << lost_num_temp_ << " dup " <<
                duplicate_num_temp_ << " unexpected " << unexpect_num_temp_ << 
-               std::endl;
+               " late " << late_num_temp_ << " lost-earlier " <<
+               lost_earlier_temp_;
+  if (track_local_drops_)
+    std::cout << " local-drops " << local_drops_temp_;
+  std::cout << std::endl;
+
+  EndInterval();
+}
 
+void MpingStat::EndInterval() {
   send_num_temp_ = 0;
   recv_num_temp_ = 0;
   recv_unique_num_temp_ = 0;
@@ -130,21 +358,45 @@ void MpingStat::PrintTempStats() {
   lost_num_temp_ = 0;
   duplicate_num_temp_ = 0;
   unexpect_num_temp_ = 0;
+  late_num_temp_ = 0;
+  lost_earlier_temp_ = 0;
+  local_drops_temp_ = 0;
+  interval_++;
+  interval_first_seq_ = max_sent_seq_ + 1;
 }
 
-void MpingStat::PrintStats() {
-  // check last round losts
-  for (unsigned int i = 0; i < send_queue_size_; i++) {
-    if (send_queue.at(i).recv_time.tv_sec == 0) {
-      lost_num_++;
-      lost_num_temp_++;
-    }
+void MpingStat::Finish() {
+  // check last round losts: what is still in the bitmap and unresolved
+  if (max_sent_seq_ > base_word_ * kWordBits) {
+    uint64_t resolved = 0;
+    for (size_t i = 0; i < recv_bitmap_.size(); i++)
+      resolved += PopCount(recv_bitmap_[i] | lost_bitmap_[i]);
+
+    uint64_t lost = max_sent_seq_ - base_word_ * kWordBits - resolved;
+    if (lost)
+      MPING_TRACE_LOSS(base_word_ * kWordBits + 1, max_sent_seq_, lost);
+    lost_num_ += lost;
+    lost_num_temp_ += lost;
   }
+}
 
+void MpingStat::PrintStats() {
+  Finish();
   std::cout << "Total sent=" << send_num_ << " received=" << recv_unique_num_ <<
                " Total received=" << recv_num_ << " total out-of-order=" <<
                out_of_order_ << " total lost=" << lost_num_ << "(" <<
                lost_num_ * 100.0 / send_num_ << ")" << " total dup=" << 
                duplicate_num_ << " total unexpected=" << unexpect_num_ << 
-               std::endl;
+               " total late=" << late_num_;
+  if (track_local_drops_)
+    std::cout << " total local-drops=" << local_drops_;
+  std::cout << std::endl;
+
+  if (local_drops_ > 0 && lost_num_ > 0) {
+    LOG(mlab::WARNING, "%llu packets were dropped in the local receive "
+        "queue: up to %llu of the %llu lost may be ours, not the path's.",
+        (unsigned long long)local_drops_,
+        (unsigned long long)std::min(local_drops_, lost_num_),
+        (unsigned long long)lost_num_);
+  }
 }
@@ -0,0 +1,34 @@
+#include <algorithm>
+#include <sstream>
+
+#include "mp_sweep.h"
+
+namespace {
+
+const int kNbTab[] = {64, 100, 500, 1000, 1500, 2000, 3000, 4000, 0};
+
+}  // namespace
+
+size_t MpingSweepSize(int sel, int ix) {
+  switch (sel) {
+    case -1: return kNbTab[ix];  // 0 terminated
+    case -2: return (ix+1)*64 > 1500 ? 0 : (ix+1)*64;
+    case -3: return (ix+1)*128 > 2048 ? 0 : (ix+1)*128;
+    case -4: return (ix+1)*256 > 4500 ? 0 : (ix+1)*256;
+  }
+  return 0;
+}
+
+MpingSizeSweep::MpingSizeSweep(const std::vector<size_t>& sizes,
+                               int win_size, bool keep_send_times,
+                               double loss_timeout)
+    : MpingStatSplit(sizes.size(), win_size, keep_send_times, loss_timeout),
+      sizes_(sizes),
+      max_size_(0) {
+  for (size_t i = 0; i < sizes_.size(); i++) {
+    max_size_ = std::max(max_size_, sizes_[i]);
+    std::ostringstream label;
+    label << "Size " << sizes_[i];
+    labels_.push_back(label.str());
+  }
+}
@@ -0,0 +1,154 @@
+#include <math.h>
+
+#include <iomanip>
+#include <iostream>
+
+#include "mp_switching.h"
+#include "log.h"
+
+namespace {
+
+// Student t, 97.5% quantile, by degrees of freedom
+const double kT975[] = {
+  12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+  2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+  2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+double T975(uint64_t df) {
+  if (df == 0)
+    return 0.0;
+  return df <= sizeof(kT975) / sizeof(kT975[0]) ? kT975[df - 1] : 1.96;
+}
+
+}  // namespace
+
+MpingLinearFit::MpingLinearFit()
+    : n_(0),
+      mean_x_(0.0),
+      mean_y_(0.0),
+      sxx_(0.0),
+      sxy_(0.0),
+      syy_(0.0) {
+}
+
+void MpingLinearFit::Add(double x, double y) {
+  n_++;
+  double dx = x - mean_x_;
+  double dy = y - mean_y_;
+  mean_x_ += dx / n_;
+  mean_y_ += dy / n_;
+  sxx_ += dx * (x - mean_x_);
+  sxy_ += dx * (y - mean_y_);
+  syy_ += dy * (y - mean_y_);
+}
+
+double MpingLinearFit::slope() const {
+  return sxx_ > 0 ? sxy_ / sxx_ : 0.0;
+}
+
+double MpingLinearFit::intercept() const {
+  return mean_y_ - slope() * mean_x_;
+}
+
+double MpingLinearFit::ResidualVariance() const {
+  if (n_ < 3)
+    return 0.0;
+  double ssr = syy_ - slope() * sxy_;
+  return ssr > 0 ? ssr / (n_ - 2) : 0.0;
+}
+
+double MpingLinearFit::slope_ci() const {
+  if (!ok())
+    return 0.0;
+  return T975(n_ - 2) * sqrt(ResidualVariance() / sxx_);
+}
+
+double MpingLinearFit::intercept_ci() const {
+  if (!ok())
+    return 0.0;
+  return T975(n_ - 2) *
+         sqrt(ResidualVariance() * (1.0 / n_ + mean_x_ * mean_x_ / sxx_));
+}
+
+MpingSwitchingFit::MpingSwitchingFit()
+    : replies_(0),
+      recv_temp_(0) {
+}
+
+void MpingSwitchingFit::OnRtt(size_t size, double rtt) {
+  std::map<size_t, double>::iterator it = min_rtt_.find(size);
+  if (it == min_rtt_.end())
+    min_rtt_[size] = rtt;
+  else if (rtt < it->second)
+    it->second = rtt;
+
+  replies_++;
+  recv_temp_++;
+}
+
+MpingLinearFit MpingSwitchingFit::RttFit() const {
+  // a handful of sizes, refitting as minimums drop is cheap
+  MpingLinearFit fit;
+  for (std::map<size_t, double>::const_iterator it = min_rtt_.begin();
+       it != min_rtt_.end(); ++it) {
+    fit.Add(it->first, it->second);
+  }
+  return fit;
+}
+
+void MpingSwitchingFit::OnTick(size_t size, double seconds) {
+  if (size > 0 && recv_temp_ > 0 && seconds > 0) {
+    double rate = recv_temp_ / seconds;
+    double& best = best_rate_[size];
+    if (rate > best)
+      best = rate;
+  }
+  recv_temp_ = 0;
+}
+
+void MpingSwitchingFit::EndSize(size_t size) {
+  std::map<size_t, double>::iterator it = best_rate_.find(size);
+  if (it == best_rate_.end())
+    return;
+
+  rate_fit_.Add(size, 1.0 / it->second);
+  best_rate_.erase(it);
+}
+
+void MpingSwitchingFit::PrintTempStats() const {
+  MpingLinearFit rtt_fit = RttFit();
+  if (!rtt_fit.ok())
+    return;
+
+  std::cout << std::fixed << std::setprecision(3) <<
+               "Switching: per packet " << rtt_fit.intercept() << " +-" <<
+               rtt_fit.intercept_ci() << " ms per byte " <<
+               rtt_fit.slope() * 1000000 << " +-" <<
+               rtt_fit.slope_ci() * 1000000 << " ns";  // per byte
+
+  if (rate_fit_.ok()) {
+    // capacity from the per byte time and its interval, in Mbps
+    double slope = rate_fit_.slope();
+    double ci = rate_fit_.slope_ci();
+    std::cout << ", bottleneck per packet " <<
+                 rate_fit_.intercept() * 1000000 << " +-" <<
+                 rate_fit_.intercept_ci() * 1000000 << " us capacity ";
+    if (slope > 0) {
+      std::cout << 8 / slope / 1000000 << " Mbps (" <<
+                   (slope + ci > 0 ? 8 / (slope + ci) / 1000000 : 0.0) <<
+                   " to ";
+      if (slope - ci > 0)
+        std::cout << 8 / (slope - ci) / 1000000;
+      else
+        std::cout << "inf";
+      std::cout << ")";
+    } else {
+      std::cout << "unknown";
+    }
+  }
+  std::cout << " from " << replies_ << " replies of " << rtt_fit.n() <<
+               " sizes" << std::endl;
+  std::cout.unsetf(std::ios::floatfield);
+  std::cout << std::setprecision(6);
+}
@@ -0,0 +1,109 @@
+#include <algorithm>
+
+#include "mp_timer_wheel.h"
+#include "log.h"
+
+MpingTimerWheel::MpingTimerWheel(uint64_t tick_ns)
+    : tick_ns_(tick_ns),
+      now_tick_(0),
+      started_(false),
+      runs_(0) {
+  ASSERT(tick_ns_ > 0);
+}
+
+std::vector<MpingTimerWheel::Run>* MpingTimerWheel::SlotFor(
+    uint64_t deadline) {
+  uint64_t delta = deadline - now_tick_;
+  int level = 0;
+  while (level < kLevels - 1 && delta >= (kSlots << (level * kSlotBits)))
+    level++;
+
+  uint64_t slot = (deadline >> (level * kSlotBits)) & (kSlots - 1);
+  return &slots_[level][slot];
+}
+
+void MpingTimerWheel::Add(uint64_t seq, uint64_t deadline,
+                          unsigned int interval) {
+  uint64_t tick = (deadline + tick_ns_ - 1) / tick_ns_;  // never early
+  if (!started_ || tick <= now_tick_)
+    tick = now_tick_ + 1;  // overdue, expires on the next tick
+
+  // the top level holds up to 256^3 ticks ahead
+  uint64_t horizon = kSlots << ((kLevels - 1) * kSlotBits);
+  if (tick - now_tick_ >= horizon)
+    tick = now_tick_ + horizon - 1;
+
+  std::vector<Run> *slot = SlotFor(tick);
+  if (!slot->empty()) {
+    Run& back = slot->back();
+    if (back.deadline == tick && back.last + 1 == seq &&
+        back.interval == interval) {
+      back.last = seq;
+      return;
+    }
+  }
+
+  Run r = {seq, seq, tick, interval};
+  slot->push_back(r);
+  runs_++;
+}
+
+uint64_t MpingTimerWheel::NextExpiry() const {
+  if (runs_ == 0)
+    return 0;
+
+  // the first busy slot of each level, in the order the wheel reaches
+  // them; a coarser level only matters if its slot starts before the best
+  uint64_t best = ~0ULL;
+  for (int level = 0; level < kLevels; level++) {
+    int shift = level * kSlotBits;
+    uint64_t pos = now_tick_ >> shift;
+    for (uint64_t i = 1; i <= kSlots; i++) {
+      if (level > 0 && ((pos + i) << shift) >= best)
+        break;
+      const std::vector<Run>& slot = slots_[level][(pos + i) & (kSlots - 1)];
+      if (slot.empty())
+        continue;
+      for (size_t r = 0; r < slot.size(); r++)
+        best = std::min(best, slot[r].deadline);
+      break;
+    }
+  }
+
+  return best * tick_ns_;
+}
+
+void MpingTimerWheel::Cascade(int level) {
+  uint64_t slot = (now_tick_ >> (level * kSlotBits)) & (kSlots - 1);
+  std::vector<Run> runs;
+  runs.swap(slots_[level][slot]);
+  for (size_t i = 0; i < runs.size(); i++)
+    SlotFor(runs[i].deadline)->push_back(runs[i]);
+}
+
+void MpingTimerWheel::Advance(uint64_t now, std::vector<Run> *expired) {
+  uint64_t target = now / tick_ns_;
+  if (!started_) {
+    now_tick_ = target;
+    started_ = true;
+    return;
+  }
+
+  while (now_tick_ < target) {
+    if (runs_ == 0) {  // nothing to expire on the way
+      now_tick_ = target;
+      break;
+    }
+
+    now_tick_++;
+    for (int level = kLevels - 1; level > 0; level--) {
+      if ((now_tick_ & ((1ULL << (level * kSlotBits)) - 1)) == 0)
+        Cascade(level);
+    }
+
+    std::vector<Run>& slot = slots_[0][now_tick_ & (kSlots - 1)];
+    runs_ -= slot.size();
+    expired->insert(expired->end(), slot.begin(), slot.end());
+    slot.clear();
+  }
+}
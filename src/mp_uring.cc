@@ -0,0 +1,414 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(OS_LINUX) && defined(HAVE_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+
+#include "mp_clock.h"
+#include "mp_uring.h"
+#include "log.h"
+
+#if defined(OS_LINUX) && defined(HAVE_IO_URING)
+
+namespace {
+
+const unsigned int kEntries = 256;
+const unsigned int kRecvSlots = 256;  // a power of 2
+const size_t kRecvSlotSize = 512;  // headers, source address and payload
+const unsigned int kSendSlots = 64;
+const uint16_t kGroup = 0;  // of the provided buffers
+const uint64_t kRecvTag = ~0ULL;  // user_data of the recvmsg, sends have
+                                  // their slot
+
+std::string Reason(const char *what) {
+  return std::string(what) + ": " + strerror(errno);
+}
+
+}  // namespace
+
+MpingUring::MpingUring()
+    : ring_fd_(-1),
+      recv_fd_(-1),
+      sq_ring_(MAP_FAILED),
+      sq_ring_size_(0),
+      sqes_(MAP_FAILED),
+      sqes_size_(0),
+      sq_head_(NULL),
+      sq_tail_(NULL),
+      sq_array_(NULL),
+      sq_mask_(0),
+      sq_entries_(0),
+      to_submit_(0),
+      cq_head_(NULL),
+      cq_tail_(NULL),
+      cq_mask_(0),
+      cqes_(NULL),
+      buf_ring_(MAP_FAILED),
+      buf_ring_size_(0),
+      buf_tail_(0),
+      recv_armed_(false),
+      send_slot_(0),
+      next_send_(0),
+      last_send_sqe_(NULL),
+      send_error_(0),
+      recv_error_(0) {
+  memset(&recv_msg_, 0, sizeof(recv_msg_));
+}
+
+MpingUring* MpingUring::Create(int recv_fd, size_t send_size,
+                               std::string *why) {
+  MpingUring *ring = new MpingUring;
+  if (ring->Setup(recv_fd, send_size, why) < 0) {
+    delete ring;
+    return NULL;
+  }
+  return ring;
+}
+
+MpingUring::~MpingUring() {
+  if (ring_fd_ >= 0)
+    close(ring_fd_);  // cancels what is still pending
+  if (sqes_ != MAP_FAILED)
+    munmap(sqes_, sqes_size_);
+  if (sq_ring_ != MAP_FAILED)
+    munmap(sq_ring_, sq_ring_size_);
+  if (buf_ring_ != MAP_FAILED)
+    munmap(buf_ring_, buf_ring_size_);
+}
+
+int MpingUring::Setup(int recv_fd, size_t send_size, std::string *why) {
+  recv_fd_ = recv_fd;
+
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  ring_fd_ = syscall(__NR_io_uring_setup, kEntries, &p);
+  if (ring_fd_ < 0) {
+    *why = Reason("io_uring_setup");
+    return -1;
+  }
+  if (!(p.features & IORING_FEAT_SINGLE_MMAP) ||
+      !(p.features & IORING_FEAT_EXT_ARG)) {
+    *why = "io_uring lacks single mmap or timed waits";
+    return -1;
+  }
+
+  sq_ring_size_ = std::max(p.sq_off.array + p.sq_entries * sizeof(unsigned),
+                           p.cq_off.cqes +
+                               p.cq_entries * sizeof(struct io_uring_cqe));
+  sq_ring_ = mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  sqes_size_ = p.sq_entries * sizeof(struct io_uring_sqe);
+  sqes_ = mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  if (sq_ring_ == MAP_FAILED || sqes_ == MAP_FAILED) {
+    *why = Reason("mmap of the rings");
+    return -1;
+  }
+
+  char *sq = static_cast<char *>(sq_ring_);
+  sq_head_ = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+  sq_array_ = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+  sq_mask_ = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+  sq_entries_ = p.sq_entries;
+  cq_head_ = reinterpret_cast<unsigned *>(sq + p.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned *>(sq + p.cq_off.tail);
+  cq_mask_ = *reinterpret_cast<unsigned *>(sq + p.cq_off.ring_mask);
+  cqes_ = sq + p.cq_off.cqes;
+
+  // replies: a ring of provided buffers the multishot recvmsg picks from
+  buf_ring_size_ = kRecvSlots * sizeof(struct io_uring_buf);
+  buf_ring_ = mmap(NULL, buf_ring_size_, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buf_ring_ == MAP_FAILED) {
+    *why = Reason("mmap of the buffer ring");
+    return -1;
+  }
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring_);
+  reg.ring_entries = kRecvSlots;
+  reg.bgid = kGroup;
+  if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PBUF_RING,
+              &reg, 1) < 0) {
+    *why = Reason("provided buffer ring");
+    return -1;
+  }
+  recv_area_.resize(kRecvSlots * kRecvSlotSize);
+  for (unsigned int i = 0; i < kRecvSlots; i++)
+    RecycleBuffer(i);
+  recv_msg_.msg_namelen = sizeof(sockaddr_storage);
+
+  // sends: one registered area cut in slots
+  send_slot_ = (send_size + 63) & ~static_cast<size_t>(63);
+  send_area_.resize(kSendSlots * send_slot_);
+  send_busy_.resize(kSendSlots, false);
+  send_msg_.resize(kSendSlots);
+  send_iov_.resize(kSendSlots);
+  send_to_.resize(kSendSlots);
+  struct iovec area;
+  area.iov_base = &send_area_[0];
+  area.iov_len = send_area_.size();
+  if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS,
+              &area, 1) < 0) {
+    *why = Reason("fixed buffers");
+    return -1;
+  }
+
+  // a kernel without multishot recvmsg fails it as it is submitted
+  ArmRecv();
+  if (Enter(0, 0) < 0) {
+    *why = Reason("io_uring_enter");
+    return -1;
+  }
+  Reap();
+  if (recv_error_ || !recv_armed_) {
+    errno = recv_error_ ? recv_error_ : EINVAL;
+    *why = Reason("multishot recvmsg");
+    return -1;
+  }
+  return 0;
+}
+
+void* MpingUring::NextSqe() {
+  unsigned int tail = *sq_tail_;
+  if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+    Enter(0, 0);  // full, hand what is queued to the kernel
+    tail = *sq_tail_;
+  }
+
+  unsigned int ix = tail & sq_mask_;
+  struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe *>(sqes_) + ix;
+  memset(sqe, 0, sizeof(*sqe));
+  sq_array_[ix] = ix;
+  __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+  to_submit_++;
+  return sqe;
+}
+
+void MpingUring::ArmRecv() {
+  struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe *>(NextSqe());
+  sqe->opcode = IORING_OP_RECVMSG;
+  sqe->fd = recv_fd_;
+  sqe->addr = reinterpret_cast<uint64_t>(&recv_msg_);
+  sqe->len = 1;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = kGroup;
+  sqe->user_data = kRecvTag;
+  recv_armed_ = true;
+}
+
+int MpingUring::Enter(unsigned int min_complete, uint64_t wait_ns) {
+  unsigned int flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+  struct __kernel_timespec ts;
+  struct io_uring_getevents_arg arg;
+  memset(&arg, 0, sizeof(arg));
+  void *argp = NULL;
+  size_t argsz = 0;
+  if (min_complete > 0 && wait_ns != ~0ULL) {
+    ts.tv_sec = wait_ns / kNsPerSec;
+    ts.tv_nsec = wait_ns % kNsPerSec;
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+    flags |= IORING_ENTER_EXT_ARG;
+    argp = &arg;
+    argsz = sizeof(arg);
+  }
+
+  int ret = syscall(__NR_io_uring_enter, ring_fd_, to_submit_, min_complete,
+                    flags, argp, argsz);
+  if (ret >= 0) {
+    to_submit_ -= std::min(static_cast<unsigned int>(ret), to_submit_);
+    last_send_sqe_ = NULL;  // gone, nothing to link to
+  }
+  return ret;
+}
+
+void MpingUring::Reap() {
+  unsigned int head = *cq_head_;
+  unsigned int tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+  for (; head != tail; head++) {
+    const struct io_uring_cqe *cqe =
+        static_cast<struct io_uring_cqe *>(cqes_) + (head & cq_mask_);
+    if (cqe->user_data == kRecvTag) {
+      if (!(cqe->flags & IORING_CQE_F_MORE))
+        recv_armed_ = false;  // ended, e.g. out of buffers
+      if (cqe->res >= 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+        Ready r = {cqe->res, cqe->flags};
+        ready_.push_back(r);
+      } else if (cqe->res < 0 && cqe->res != -ENOBUFS) {
+        recv_error_ = -cqe->res;
+      }
+    } else if (cqe->user_data < kSendSlots) {
+      send_busy_[cqe->user_data] = false;
+      // after a failed send, the ones linked to it are cancelled
+      if (cqe->res < 0 && cqe->res != -ECANCELED)
+        send_error_ = -cqe->res;
+    }
+  }
+  __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+}
+
+void MpingUring::RecycleBuffer(uint16_t bid) {
+  // the tail sits in the resv field of the first entry
+  struct io_uring_buf *bufs = static_cast<struct io_uring_buf *>(buf_ring_);
+  struct io_uring_buf *b = &bufs[buf_tail_ & (kRecvSlots - 1)];
+  b->addr = reinterpret_cast<uint64_t>(&recv_area_[bid * kRecvSlotSize]);
+  b->len = kRecvSlotSize;
+  b->bid = bid;
+  buf_tail_++;
+  __atomic_store_n(&bufs[0].resv, buf_tail_, __ATOMIC_RELEASE);
+}
+
+bool MpingUring::QueueSend(int fd, const char *buf, size_t len,
+                           const sockaddr *to, socklen_t to_len,
+                           int *error) {
+  if (send_error_) {
+    *error = send_error_;
+    send_error_ = 0;
+    return false;
+  }
+  if (len > send_slot_) {
+    *error = EMSGSIZE;
+    return false;
+  }
+
+  while (send_busy_[next_send_]) {  // wait for its completion
+    if (Enter(1, ~0ULL) < 0) {
+      *error = errno;
+      return false;
+    }
+    Reap();
+  }
+
+  size_t slot = next_send_;
+  next_send_ = (next_send_ + 1) % kSendSlots;
+  char *data = &send_area_[slot * send_slot_];
+  memcpy(data, buf, len);
+
+  struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe *>(NextSqe());
+  sqe->fd = fd;
+  sqe->user_data = slot;
+  if (to) {  // no fixed buffer variant of sendmsg
+    memcpy(&send_to_[slot], to, to_len);
+    send_iov_[slot].iov_base = data;
+    send_iov_[slot].iov_len = len;
+    struct msghdr *msg = &send_msg_[slot];
+    memset(msg, 0, sizeof(*msg));
+    msg->msg_name = &send_to_[slot];
+    msg->msg_namelen = to_len;
+    msg->msg_iov = &send_iov_[slot];
+    msg->msg_iovlen = 1;
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->addr = reinterpret_cast<uint64_t>(msg);
+    sqe->len = 1;
+  } else {  // a write on a connected socket is a send
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = len;
+    sqe->buf_index = 0;
+  }
+
+  if (last_send_sqe_)  // keep the order of the batch
+    static_cast<struct io_uring_sqe *>(last_send_sqe_)->flags |=
+        IOSQE_IO_LINK;
+  last_send_sqe_ = sqe;
+  send_busy_[slot] = true;
+  return true;
+}
+
+ssize_t MpingUring::Receive(char *buf, size_t len, sockaddr_storage *from,
+                            uint64_t wait_ns, int *error) {
+  uint64_t deadline = wait_ns == ~0ULL ? 0 : MpingClock::NowNs() + wait_ns;
+  bool waited = false;
+  while (true) {
+    Reap();
+    if (!ready_.empty()) {
+      Ready r = ready_.front();
+      ready_.pop_front();
+      uint16_t bid = r.flags >> IORING_CQE_BUFFER_SHIFT;
+      char *slot = &recv_area_[bid * kRecvSlotSize];
+      const struct io_uring_recvmsg_out *out =
+          reinterpret_cast<const struct io_uring_recvmsg_out *>(slot);
+      const char *name = slot + sizeof(*out);
+      const char *payload = name + recv_msg_.msg_namelen +
+                            recv_msg_.msg_controllen;
+      size_t got = std::min(static_cast<size_t>(out->payloadlen),
+                            static_cast<size_t>(slot + r.res - payload));
+      got = std::min(got, len);
+      memset(from, 0, sizeof(*from));
+      memcpy(from, name, std::min(static_cast<size_t>(out->namelen),
+                                  sizeof(*from)));
+      memcpy(buf, payload, got);
+      RecycleBuffer(bid);
+
+      // a reply already in, the queued sends still leave now; a failure
+      // stays queued for the next call
+      if (to_submit_ > 0 && Enter(0, 0) < 0)
+        LOG(mlab::VERBOSE, "io_uring submit fails. %s [%d]",
+            strerror(errno), errno);
+      return got;
+    }
+    if (recv_error_) {
+      *error = recv_error_;
+      recv_error_ = 0;
+      return -1;
+    }
+    if (waited) {
+      *error = EAGAIN;
+      return -1;
+    }
+    if (!recv_armed_)
+      ArmRecv();
+
+    uint64_t left = ~0ULL;
+    if (deadline) {
+      uint64_t now = MpingClock::NowNs();
+      left = now < deadline ? deadline - now : 0;
+    }
+    if (left == 0) {  // only hand over the sends, take what is there
+      waited = true;
+      if (Enter(0, 0) < 0) {
+        *error = errno;
+        return -1;
+      }
+      continue;
+    }
+
+    if (Enter(1, left) < 0 && errno != ETIME) {
+      *error = errno;  // EINTR for the SIGALRM of ArmRecvTimeout
+      return -1;
+    }
+  }
+}
+
+#else  // no io_uring
+
+MpingUring::MpingUring() { }
+MpingUring::~MpingUring() { }
+
+MpingUring* MpingUring::Create(int recv_fd, size_t send_size,
+                               std::string *why) {
+  *why = "built without io_uring";
+  return NULL;
+}
+
+bool MpingUring::QueueSend(int fd, const char *buf, size_t len,
+                           const sockaddr *to, socklen_t to_len,
+                           int *error) {
+  *error = ENOSYS;
+  return false;
+}
+
+ssize_t MpingUring::Receive(char *buf, size_t len, sockaddr_storage *from,
+                            uint64_t wait_ns, int *error) {
+  *error = ENOSYS;
+  return -1;
+}
+
+#endif
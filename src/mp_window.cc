@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+#include "mp_window.h"
+
+namespace {
+
+const double kNoRtt = -1.0;
+
+}  // namespace
+
+MpingWindowCtl::MpingWindowCtl(int max_window, double target,
+                               bool target_is_ms)
+    : max_window_(std::max(max_window, 1)),
+      target_(target),
+      target_is_ms_(target_is_ms),
+      window_(1.0),
+      slow_start_(true),
+      base_rtt_(kNoRtt),
+      round_min_rtt_(kNoRtt),
+      round_end_(0),
+      queue_delay_(0.0),
+      queue_pkts_(0.0),
+      recv_temp_(0),
+      rounds_temp_(0),
+      window_sum_temp_(0.0),
+      delay_sum_temp_(0.0),
+      pkts_sum_temp_(0.0) {
+}
+
+void MpingWindowCtl::OnRecv(uint64_t seq, double rtt, uint64_t sseq) {
+  recv_temp_++;
+
+  if (base_rtt_ < 0 || rtt < base_rtt_)
+    base_rtt_ = rtt;
+  if (round_min_rtt_ < 0 || rtt < round_min_rtt_)
+    round_min_rtt_ = rtt;
+
+  // a round ends when a packet sent after the previous adjustment returns
+  if ((int64_t)(seq - round_end_) > 0) {
+    Adjust(sseq);
+  }
+}
+
+void MpingWindowCtl::Adjust(uint64_t sseq) {
+  // the minimum of the round filters out reply path noise
+  double rtt = round_min_rtt_;
+  queue_delay_ = rtt - base_rtt_;
+  queue_pkts_ = rtt > 0 ? window_ * queue_delay_ / rtt : 0.0;
+
+  double queue = target_is_ms_ ? queue_delay_ : queue_pkts_;
+  if (slow_start_) {
+    if (queue < target_ / 2)
+      window_ *= 2;
+    else
+      slow_start_ = false;
+  }
+
+  if (!slow_start_) {
+    double error = std::max(-1.0, std::min(1.0, (target_ - queue) / target_));
+    window_ += error * std::max(1.0, window_ / 8);
+  }
+
+  window_ = std::max(1.0, std::min(window_, (double)max_window_));
+  if (window_ >= max_window_)
+    slow_start_ = false;
+
+  rounds_temp_++;
+  window_sum_temp_ += window_;
+  delay_sum_temp_ += queue_delay_;
+  pkts_sum_temp_ += queue_pkts_;
+
+  round_end_ = sseq;
+  round_min_rtt_ = kNoRtt;
+}
+
+void MpingWindowCtl::PrintTempStats(size_t packet_size) {
+  // averages over the RTT rounds closed in this interval
+  double rounds = rounds_temp_ ? rounds_temp_ : 1;
+  double window = rounds_temp_ ? window_sum_temp_ / rounds : window_;
+
+  std::cout << std::fixed << std::setprecision(2) <<
+               "Window " << window <<
+               " throughput " << recv_temp_ << " pkt/s " <<
+               recv_temp_ * packet_size * 8 / 1000000.0 << " Mbps" <<
+               " queue " << delay_sum_temp_ / rounds << " ms " <<
+               pkts_sum_temp_ / rounds << " pkts" <<
+               " base rtt " << base_rtt_ << " ms" << std::endl;
+  std::cout.unsetf(std::ios::floatfield);
+  std::cout << std::setprecision(6);
+
+  recv_temp_ = 0;
+  rounds_temp_ = 0;
+  window_sum_temp_ = 0.0;
+  delay_sum_temp_ = 0.0;
+  pkts_sum_temp_ = 0.0;
+}
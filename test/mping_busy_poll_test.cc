@@ -0,0 +1,41 @@
+#include <errno.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "mp_busy_poll.h"
+#include "mp_clock.h"
+
+TEST(MpingBusyPoll, SpinsForBudget) {
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_DGRAM, 0, fds));
+  MpingBusyPoll busy(2000);  // 2 ms
+  busy.Setup(fds[0]);  // not a NIC socket, only warns
+
+  uint64_t start = MpingClock::NowNs();
+  EXPECT_EQ(EAGAIN, busy.Spin(fds[0]));
+  EXPECT_GE(MpingClock::NowNs() - start, 2 * kNsPerMs);
+
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST(MpingBusyPoll, ReturnsWhenReadyWithoutConsuming) {
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_DGRAM, 0, fds));
+  MpingBusyPoll busy(1000000);  // 1 s, must not be used up
+
+  ASSERT_EQ(4, write(fds[1], "ping", 4));
+  uint64_t start = MpingClock::NowNs();
+  EXPECT_EQ(0, busy.Spin(fds[0]));
+  EXPECT_LT(MpingClock::NowNs() - start, 100 * kNsPerMs);
+
+  char buf[8];
+  EXPECT_EQ(4, read(fds[0], buf, sizeof(buf)));  // still queued after Spin
+
+  busy.OnRtt(0.1);
+  busy.PrintTempStats();
+
+  close(fds[0]);
+  close(fds[1]);
+}
@@ -0,0 +1,119 @@
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "mp_campaign.h"
+
+namespace {
+
+MpingProbeSpec Spec(const std::string& host, double start, int line) {
+  MpingProbeSpec spec;
+  spec.config.dst_host = host;
+  spec.start = start;
+  spec.line = line;
+  return spec;
+}
+
+}  // namespace
+
+TEST(MpingCampaign, ReadCampaign) {
+  std::istringstream in(
+      "# start duration switches host\n"
+      "\n"
+      "30  0   -n 4 -b -3 -t 64 -p 33434 192.0.2.2\n"
+      "0   60  -f -n 8 -b 100 192.0.2.1\n"
+      "   # indented comment\n"
+      "0   1.5 -b 200 -c -p 7000 192.0.2.3\n");
+  std::vector<MpingProbeSpec> specs;
+  std::string error;
+  ASSERT_EQ(0, MpingReadCampaign(in, &specs, &error)) << error;
+  ASSERT_EQ(3u, specs.size());
+
+  // by start, file order among equals
+  EXPECT_EQ("192.0.2.1", specs[0].config.dst_host);
+  EXPECT_EQ(4, specs[0].line);
+  EXPECT_EQ(60.0, specs[0].duration);
+  EXPECT_TRUE(specs[0].config.loop);
+  EXPECT_EQ(8, specs[0].config.win_size);
+
+  EXPECT_EQ("192.0.2.3", specs[1].config.dst_host);
+  EXPECT_EQ(1.5, specs[1].duration);
+  EXPECT_EQ(255, specs[1].config.ttl);  // filled in by Validate
+
+  EXPECT_EQ(30.0, specs[2].start);
+  EXPECT_EQ(-3, specs[2].config.loop_size);
+  EXPECT_EQ(64, specs[2].config.ttl);
+}
+
+TEST(MpingCampaign, ReadCampaignErrors) {
+  const char *bad[] = {
+    "0 10 192.0.2.1\n-5 10 -b 100 192.0.2.1\n",  // negative start
+    "0 10 -b 100\n",  // no host
+    "0 x -b 100 192.0.2.1\n",  // duration
+    "0 10 -b 100 -x 1 192.0.2.1\n",  // unknown switch
+    "0 10 -b 100 -a 8 192.0.2.1\n",  // not for a session
+    "0 10 -c -b 100 192.0.2.1\n",  // fails Validate
+  };
+  const int line[] = {2, 1, 1, 1, 1, 1};
+
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    std::istringstream in(bad[i]);
+    std::vector<MpingProbeSpec> specs;
+    std::string error;
+    EXPECT_EQ(-1, MpingReadCampaign(in, &specs, &error)) << bad[i];
+    std::ostringstream want;
+    want << "line " << line[i] << ": ";
+    EXPECT_EQ(0u, error.find(want.str())) << error;
+  }
+}
+
+TEST(MpingCampaign, QueueStartTimes) {
+  MpingCampaignQueue queue(4, 4, 0);
+  queue.Add(Spec("a", 10, 2));
+  queue.Add(Spec("b", 0, 1));
+
+  MpingProbeSpec spec;
+  double wait;
+  ASSERT_TRUE(queue.Next(0, &spec, &wait));
+  EXPECT_EQ(1, spec.line);
+  EXPECT_FALSE(queue.Next(0, &spec, &wait));
+  EXPECT_EQ(10.0, wait);
+  EXPECT_FALSE(queue.Next(9.5, &spec, &wait));
+  EXPECT_EQ(0.5, wait);
+  ASSERT_TRUE(queue.Next(10, &spec, &wait));
+  EXPECT_EQ(2, spec.line);
+  EXPECT_TRUE(queue.empty());
+  EXPECT_EQ(2, queue.running());
+}
+
+TEST(MpingCampaign, QueueLimits) {
+  MpingCampaignQueue queue(2, 1, 5);
+  queue.Add(Spec("a", 0, 1));
+  queue.Add(Spec("a", 0, 2));
+  queue.Add(Spec("b", 0, 3));
+  queue.Add(Spec("c", 0, 4));
+
+  MpingProbeSpec spec;
+  double wait;
+  ASSERT_TRUE(queue.Next(0, &spec, &wait));
+  EXPECT_EQ(1, spec.line);
+  // the second to "a" waits for the first, "b" does not wait for it
+  ASSERT_TRUE(queue.Next(0, &spec, &wait));
+  EXPECT_EQ(3, spec.line);
+  // two running: only an end lets another one start
+  EXPECT_FALSE(queue.Next(1, &spec, &wait));
+  EXPECT_EQ(-1.0, wait);
+
+  queue.OnEnd("a");
+  EXPECT_EQ(1, queue.running());
+  // "a" is free but started 2 s ago, "c" goes first
+  ASSERT_TRUE(queue.Next(2, &spec, &wait));
+  EXPECT_EQ(4, spec.line);
+  queue.OnEnd("c");
+  EXPECT_FALSE(queue.Next(2, &spec, &wait));
+  EXPECT_EQ(3.0, wait);
+  ASSERT_TRUE(queue.Next(5, &spec, &wait));
+  EXPECT_EQ(2, spec.line);
+  EXPECT_TRUE(queue.empty());
+}
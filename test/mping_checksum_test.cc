@@ -0,0 +1,64 @@
+#include <stdlib.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "mlab/protocol_header.h"
+#include "mp_checksum.h"
+
+namespace {
+
+const char *kKernels[] = {"generic", "sse2", "avx2", "neon"};
+const size_t kMaxAlign = 64;
+
+void CheckAllLengths(MpingCheckSumFunc f, const std::vector<char>& data,
+                     size_t maxlen) {
+  for (size_t align = 0; align < kMaxAlign; align++) {
+    for (size_t len = 0; len <= maxlen; len++) {
+      const char *p = &data[align];
+      ASSERT_EQ(mlab::InternetCheckSum(p, len), f(p, len))
+          << "align " << align << " len " << len;
+    }
+  }
+}
+
+}  // namespace
+
+TEST(MpingCheckSum, RandomData) {
+  std::vector<char> data(kMaxAlign + 4096);
+  srand(1);
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = static_cast<char>(rand());
+
+  for (size_t k = 0; k < sizeof(kKernels) / sizeof(kKernels[0]); k++) {
+    MpingCheckSumFunc f = MpingCheckSumKernel(kKernels[k]);
+    if (f == NULL)
+      continue;
+    SCOPED_TRACE(kKernels[k]);
+    CheckAllLengths(f, data, 4000);
+  }
+}
+
+TEST(MpingCheckSum, AllOnesAndZeros) {
+  std::vector<char> ones(kMaxAlign + 1024, static_cast<char>(0xff));
+  std::vector<char> zeros(kMaxAlign + 1024, 0);
+
+  for (size_t k = 0; k < sizeof(kKernels) / sizeof(kKernels[0]); k++) {
+    MpingCheckSumFunc f = MpingCheckSumKernel(kKernels[k]);
+    if (f == NULL)
+      continue;
+    SCOPED_TRACE(kKernels[k]);
+    CheckAllLengths(f, ones, 1024);
+    CheckAllLengths(f, zeros, 1024);
+  }
+}
+
+TEST(MpingCheckSum, MaxPacket) {
+  std::vector<char> data(65535);
+  srand(2);
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = static_cast<char>(rand());
+
+  EXPECT_EQ(mlab::InternetCheckSum(&data[0], data.size()),
+            MpingCheckSum(&data[0], data.size()));
+}
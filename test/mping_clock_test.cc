@@ -0,0 +1,67 @@
+#include <time.h>
+
+#include <iostream>
+
+#include "gtest/gtest.h"
+#include "mp_clock.h"
+
+namespace {
+
+uint64_t RawNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return ts.tv_sec * kNsPerSec + ts.tv_nsec;
+}
+
+// NowNs() between two raw reads, retried until they are close: the
+// test, too, can be preempted between its reads.
+void ReadBoth(uint64_t *raw, uint64_t *now) {
+  for (int i = 0; i < 1000; i++) {
+    uint64_t before = RawNs();
+    *now = MpingClock::NowNs();
+    uint64_t after = RawNs();
+    *raw = before + (after - before) / 2;
+    if (after - before < 10000)
+      break;
+  }
+}
+
+}  // namespace
+
+TEST(MpingClock, Monotonic) {
+  uint64_t last = MpingClock::NowNs();
+  for (int i = 0; i < 1000000; i++) {
+    uint64_t now = MpingClock::NowNs();
+    ASSERT_GE(now, last);
+    last = now;
+  }
+}
+
+TEST(MpingClock, AgreesWithMonotonicRaw) {
+  uint64_t raw, start;
+  ReadBoth(&raw, &start);
+  struct timespec ts = {0, 200000000};  // 200 ms
+  nanosleep(&ts, NULL);
+  uint64_t raw_end, end;
+  ReadBoth(&raw_end, &end);
+  double raw_ms = (raw_end - raw) / (double)kNsPerMs;
+  double ms = (end - start) / (double)kNsPerMs;
+
+  std::cout << "source " << MpingClock::Source() << ", " << ms << " ms vs " <<
+               raw_ms << " ms" << std::endl;
+  // a 0.1% calibration error is 0.2 ms here
+  EXPECT_NEAR(raw_ms, ms, raw_ms * 0.0002 + 0.02);
+}
+
+TEST(MpingClock, WaitUntil) {
+  int late = 0;
+  for (int i = 0; i < 20; i++) {
+    uint64_t deadline = MpingClock::NowNs() + i * 500 * 1000;
+    MpingClock::WaitUntil(deadline);
+    uint64_t now = MpingClock::NowNs();
+    EXPECT_GE(now, deadline);
+    if (now >= deadline + 2 * kNsPerMs)
+      late++;
+  }
+  EXPECT_LE(late, 1);  // one preempted wakeup, not a pattern
+}
@@ -0,0 +1,110 @@
+#include <string>
+
+#include "gtest/gtest.h"
+#include "mp_config.h"
+
+TEST(MpingConfig, Defaults) {
+  MpingConfig config;
+  std::string error;
+  EXPECT_EQ(0, config.Validate(&error));
+  EXPECT_EQ(4, config.win_size);
+  EXPECT_FALSE(config.loop);
+  EXPECT_EQ(0, config.ttl);
+}
+
+TEST(MpingConfig, FillsImpliedOptions) {
+  MpingConfig config;
+  config.client_mode = true;
+  config.dport = 4000;
+  config.target_queue = 10;
+  std::string error;
+  ASSERT_EQ(0, config.Validate(&error));
+  EXPECT_EQ(255, config.ttl);  // UDP needs a TTL
+  EXPECT_TRUE(config.loop);  // -Q picks the window
+}
+
+TEST(MpingConfig, ErrorsAreReturned) {
+  std::string error;
+
+  MpingConfig client;
+  client.client_mode = true;
+  EXPECT_EQ(-1, client.Validate(&error));
+  EXPECT_NE(std::string::npos, error.find("-p"));
+
+  MpingConfig hops;
+  hops.all_hops = true;
+  EXPECT_EQ(-1, hops.Validate(&error));
+  EXPECT_EQ("-H needs -a.", error);
+
+  MpingConfig size;
+  size.pkt_size = 70000;
+  EXPECT_EQ(-1, size.Validate(&error));
+
+  MpingConfig dual;
+  dual.dual_stack = true;
+  dual.knee_search = true;
+  EXPECT_EQ(-1, dual.Validate(&error));
+  EXPECT_NE(std::string::npos, error.find("-D"));
+
+  MpingConfig flows;
+  flows.flows = 4;
+  flows.client_mode = true;
+  flows.dport = 5000;
+  EXPECT_EQ(-1, flows.Validate(&error));
+  EXPECT_NE(std::string::npos, error.find("-E"));
+
+  MpingConfig uring;
+  uring.io_uring = true;
+  uring.inc_ttl = 8;
+  uring.ttl = 8;
+  uring.all_hops = true;
+  EXPECT_EQ(-1, uring.Validate(&error));
+  EXPECT_EQ("-U cannot be used with -a or -H.", error);
+
+  MpingConfig profile;
+  profile.profile = true;
+  profile.campaign = "probes.txt";
+  EXPECT_EQ(-1, profile.Validate(&error));
+  EXPECT_EQ("-X cannot be used with -D or -C.", error);
+}
+
+TEST(MpingConfig, ParseArgs) {
+  const char *argv[] = {"mping", "-f", "-n", "8", "-b", "-3", "-Q", "5ms",
+                        "-t", "64", "192.0.2.1"};
+  MpingConfig config;
+  std::string error;
+  ASSERT_EQ(0, config.ParseArgs(11, argv, &error));
+  EXPECT_TRUE(config.loop);
+  EXPECT_EQ(8, config.win_size);
+  EXPECT_EQ(-3, config.loop_size);
+  EXPECT_EQ(0u, config.pkt_size);
+  EXPECT_EQ(5.0, config.target_queue);
+  EXPECT_TRUE(config.target_queue_ms);
+  EXPECT_EQ(64, config.ttl);
+  EXPECT_EQ("192.0.2.1", config.dst_host);
+
+  const char *missing[] = {"mping", "192.0.2.1", "-n"};
+  MpingConfig bad;
+  EXPECT_EQ(-1, bad.ParseArgs(3, missing, &error));
+  EXPECT_EQ("Missing value for -n.", error);
+
+  const char *twohosts[] = {"mping", "192.0.2.1", "192.0.2.2"};
+  EXPECT_EQ(-1, MpingConfig().ParseArgs(3, twohosts, &error));
+
+  const char *unknown[] = {"mping", "-x", "1", "192.0.2.1"};
+  EXPECT_EQ(-1, MpingConfig().ParseArgs(4, unknown, &error));
+  EXPECT_EQ("Unknown parameter -x.", error);
+
+  const char *packets[] = {"mping", "-Q", "12", "192.0.2.1"};
+  MpingConfig queue;
+  ASSERT_EQ(0, queue.ParseArgs(4, packets, &error));
+  EXPECT_EQ(12.0, queue.target_queue);
+  EXPECT_FALSE(queue.target_queue_ms);
+
+  const char *units[] = {"5s", "5x", "abc", "", "ms"};
+  for (size_t i = 0; i < sizeof(units) / sizeof(units[0]); i++) {
+    const char *typo[] = {"mping", "-Q", units[i], "192.0.2.1"};
+    EXPECT_EQ(-1, MpingConfig().ParseArgs(4, typo, &error)) << units[i];
+    EXPECT_NE(std::string::npos, error.find("-Q")) << units[i];
+  }
+}
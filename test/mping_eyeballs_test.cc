@@ -0,0 +1,123 @@
+#include <set>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "mp_clock.h"
+#include "mp_eyeballs.h"
+#include "mp_sim_transport.h"
+
+namespace {
+
+const char kV6[] = "2001:db8::1";
+const char kV4[] = "192.0.2.1";
+
+MpingSimConfig Path(uint64_t delay_us, double loss) {
+  MpingSimConfig sim;
+  sim.delay_us = delay_us;
+  sim.loss = loss;
+  return sim;
+}
+
+MpingConfig RaceConfig() {
+  MpingConfig config;
+  config.dst_host = "dual.example";
+  return config;
+}
+
+}  // namespace
+
+TEST(MpingEyeballs, SortInterleavesFamiliesIPv6First) {
+  std::set<std::string> ips;
+  ips.insert("10.0.0.1");
+  ips.insert("10.0.0.2");
+  ips.insert("10.0.0.3");
+  ips.insert("2001:db8::1");
+  ips.insert("2001:db8::2");
+
+  std::vector<std::string> ordered;
+  MpingSortAddresses(ips, &ordered);
+  ASSERT_EQ(5u, ordered.size());
+  EXPECT_EQ("2001:db8::1", ordered[0]);
+  EXPECT_EQ("10.0.0.1", ordered[1]);
+  EXPECT_EQ("2001:db8::2", ordered[2]);
+  EXPECT_EQ("10.0.0.2", ordered[3]);
+  EXPECT_EQ("10.0.0.3", ordered[4]);
+}
+
+TEST(MpingEyeballs, FirstAnswerEndsTheRace) {
+  MpingSimTransport v6(Path(10000, 0)), v4(Path(1000, 0));
+  std::vector<std::string> ordered;
+  ordered.push_back(kV6);
+  ordered.push_back(kV4);
+  std::vector<MpingTransport*> transports;
+  transports.push_back(&v6);
+  transports.push_back(&v4);
+
+  std::vector<std::string> responsive;
+  EXPECT_EQ(1, MpingRaceAddresses(ordered, transports, RaceConfig(), false,
+                                  &responsive));
+  ASSERT_EQ(1u, responsive.size());
+  EXPECT_EQ(kV6, responsive[0]);  // answered within the attempt delay
+  EXPECT_EQ(0u, v4.sent());  // so IPv4 was never tried
+}
+
+TEST(MpingEyeballs, DeadFamilyCostsOneAttemptDelay) {
+  MpingSimTransport v6(Path(10000, 1.0)), v4(Path(10000, 0));
+  uint64_t start = v6.NowNs();
+  std::vector<std::string> ordered;
+  ordered.push_back(kV6);
+  ordered.push_back(kV4);
+  std::vector<MpingTransport*> transports;
+  transports.push_back(&v6);
+  transports.push_back(&v4);
+
+  std::vector<std::string> responsive;
+  EXPECT_EQ(1, MpingRaceAddresses(ordered, transports, RaceConfig(), false,
+                                  &responsive));
+  ASSERT_EQ(1u, responsive.size());
+  EXPECT_EQ(kV4, responsive[0]);
+  // 250 ms before IPv4 starts, its 20 ms RTT, a 10 ms poll step
+  EXPECT_LT(v6.NowNs() - start, 300 * kNsPerMs);
+  EXPECT_EQ(v6.NowNs(), v4.NowNs());
+}
+
+TEST(MpingEyeballs, EachFamilyWaitsForBoth) {
+  MpingSimTransport v6a(Path(10000, 1.0)), v4(Path(5000, 0)),
+                    v6b(Path(20000, 0));
+  std::vector<std::string> ordered;
+  ordered.push_back(kV6);
+  ordered.push_back(kV4);
+  ordered.push_back("2001:db8::2");
+  std::vector<MpingTransport*> transports;
+  transports.push_back(&v6a);
+  transports.push_back(&v4);
+  transports.push_back(&v6b);
+
+  std::vector<std::string> responsive;
+  EXPECT_EQ(2, MpingRaceAddresses(ordered, transports, RaceConfig(), true,
+                                  &responsive));
+  ASSERT_EQ(2u, responsive.size());
+  EXPECT_EQ(kV4, responsive[0]);
+  EXPECT_EQ("2001:db8::2", responsive[1]);
+}
+
+TEST(MpingEyeballs, NobodyAnswers) {
+  MpingSimTransport v6(Path(10000, 1.0)), v4(Path(10000, 1.0));
+  uint64_t start = v6.NowNs();
+  std::vector<std::string> ordered;
+  ordered.push_back(kV6);
+  ordered.push_back(kV4);
+  std::vector<MpingTransport*> transports;
+  transports.push_back(&v6);
+  transports.push_back(&v4);
+
+  std::vector<std::string> responsive;
+  EXPECT_EQ(0, MpingRaceAddresses(ordered, transports, RaceConfig(), false,
+                                  &responsive));
+  // gives up 2 s after the last attempt, having resent every second
+  EXPECT_GE(v6.NowNs() - start, 2250 * kNsPerMs);
+  EXPECT_LT(v6.NowNs() - start, 2300 * kNsPerMs);
+  EXPECT_EQ(3u, v6.sent());
+  EXPECT_EQ(2u, v4.sent());
+}
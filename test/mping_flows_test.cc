@@ -0,0 +1,70 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "mp_clock.h"
+#include "mp_flows.h"
+
+namespace {
+
+const uint64_t kStart = 1000 * kNsPerSec;
+
+}  // namespace
+
+TEST(MpingFlowSpread, FlowsInTurn) {
+  MpingFlowSpread spread(4, 8, false, 0);
+  EXPECT_EQ(0, spread.FlowFor(1));
+  EXPECT_EQ(3, spread.FlowFor(4));
+  EXPECT_EQ(0, spread.FlowFor(5));
+  EXPECT_EQ(2, spread.FlowFor(7));
+}
+
+TEST(MpingFlowSpread, SpotsALossyFlow) {
+  MpingFlowSpread spread(4, 8, false, 100);
+  uint64_t now = kStart;
+  for (uint64_t seq = 1; seq <= 400; seq++) {
+    spread.EnqueueSend(seq, now);
+    // flow 2 loses every other probe
+    if (spread.FlowFor(seq) != 2 || seq % 8 != 3)
+      spread.EnqueueRecv(seq, now + 10 * kNsPerMs, now);
+    now += kNsPerMs;
+  }
+  spread.Expire(now + kNsPerSec);
+  spread.PrintStats();
+
+  std::vector<int> suspects;
+  spread.Suspects(&suspects);
+  ASSERT_EQ(1u, suspects.size());
+  EXPECT_EQ(2, suspects[0]);
+}
+
+TEST(MpingFlowSpread, SpotsASlowFlow) {
+  MpingFlowSpread spread(3, 6, false, 100);
+  uint64_t now = kStart;
+  for (uint64_t seq = 1; seq <= 300; seq++) {
+    spread.EnqueueSend(seq, now);
+    uint64_t rtt = spread.FlowFor(seq) == 0 ? 30 : 10;
+    spread.EnqueueRecv(seq, now + rtt * kNsPerMs, now);
+    now += kNsPerMs;
+  }
+  spread.PrintStats();
+
+  std::vector<int> suspects;
+  spread.Suspects(&suspects);
+  ASSERT_EQ(1u, suspects.size());
+  EXPECT_EQ(0, suspects[0]);
+}
+
+TEST(MpingFlowSpread, HealthyFlowsAreQuiet) {
+  MpingFlowSpread spread(4, 8, false, 100);
+  uint64_t now = kStart;
+  for (uint64_t seq = 1; seq <= 400; seq++) {
+    spread.EnqueueSend(seq, now);
+    spread.EnqueueRecv(seq, now + (10 + seq % 3) * kNsPerMs, now);
+    now += kNsPerMs;
+  }
+  spread.PrintStats();
+
+  std::vector<int> suspects;
+  spread.Suspects(&suspects);
+  EXPECT_TRUE(suspects.empty());
+}
@@ -0,0 +1,39 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "mp_hops.h"
+
+TEST(MpingHopStats, TtlRoundRobin) {
+  MpingHopStats hops(3);
+  EXPECT_EQ(1, hops.TtlFor(1));
+  EXPECT_EQ(3, hops.TtlFor(3));
+  EXPECT_EQ(1, hops.TtlFor(4));
+  EXPECT_EQ(2, hops.TtlFor(3000002));
+}
+
+TEST(MpingHopStats, TableStopsAtDestination) {
+  MpingHopStats hops(4);
+  for (uint64_t seq = 1; seq <= 400; seq++) {
+    hops.OnSend(seq);
+    int ttl = hops.TtlFor(seq);
+    if (ttl == 1 && seq % 8 == 1)
+      continue;  // rate limited
+    std::ostringstream from;
+    from << "10.255.0." << ttl;
+    hops.OnRecv(seq, ttl >= 3 ? "10.0.0.1" : from.str(), ttl * 10.0);
+  }
+
+  std::streambuf *saved = std::cout.rdbuf();
+  std::ostringstream out;
+  std::cout.rdbuf(out.rdbuf());
+  hops.Print("10.0.0.1");
+  std::cout.rdbuf(saved);
+
+  std::string table = out.str();
+  EXPECT_NE(std::string::npos, table.find("10.255.0.1"));
+  EXPECT_NE(std::string::npos, table.find("50.00"));  // hop 1 loss
+  EXPECT_NE(std::string::npos, table.find("10.0.0.1"));
+  EXPECT_EQ(std::string::npos, table.find("\n4 "));  // past the destination
+}
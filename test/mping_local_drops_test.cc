@@ -0,0 +1,96 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <sstream>
+
+#include "gtest/gtest.h"
+#include "mp_local_drops.h"
+
+namespace {
+
+const char kUdpTable[] =
+"  sl  local_address rem_address   st tx_queue rx_queue tr tm->when "
+"retrnsmt   uid  timeout inode ref pointer drops\n"
+"  12: 0100007F:0035 00000000:0000 07 00000000:00000000 00:00000000 "
+"00000000   101        0 17533 2 0000000000000000 0\n"
+"  40: 00000000:D431 00000000:0000 07 00000000:00034000 00:00000000 "
+"00000000     0        0 98765 2 0000000000000000 4242\n";
+
+}  // namespace
+
+TEST(MpingLocalDrops, ProcNetTable) {
+  uint32_t drops = 0;
+  std::istringstream table(kUdpTable);
+  ASSERT_TRUE(MpingProcNetDrops(table, 98765, &drops));
+  EXPECT_EQ(4242u, drops);
+
+  std::istringstream again(kUdpTable);
+  ASSERT_TRUE(MpingProcNetDrops(again, 17533, &drops));
+  EXPECT_EQ(0u, drops);
+
+  std::istringstream missing(kUdpTable);
+  EXPECT_FALSE(MpingProcNetDrops(missing, 1, &drops));
+}
+
+// A receiver with a small buffer on the loopback, flooded until the
+// kernel drops: the counters see the drops.
+TEST(MpingLocalDrops, CountsOverflow) {
+  int rx = socket(AF_INET, SOCK_DGRAM, 0);
+  int tx = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(0, bind(rx, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)));
+  socklen_t len = sizeof(addr);
+  getsockname(rx, reinterpret_cast<sockaddr *>(&addr), &len);
+
+  EXPECT_GT(MpingSizeRecvBuffer(rx, 4096), 0u);
+  ASSERT_TRUE(MpingEnableRxqOverflow(rx));
+  uint32_t before = 0;
+  ASSERT_TRUE(MpingSocketDrops(rx, &before));
+
+  char payload[1000];
+  memset(payload, 'x', sizeof(payload));
+  for (int i = 0; i < 200; i++) {
+    sendto(tx, payload, sizeof(payload), 0,
+           reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+  }
+
+  uint32_t after = 0;
+  ASSERT_TRUE(MpingSocketDrops(rx, &after));
+  EXPECT_GT(after - before, 0u);
+
+  // datagrams carry the counter as of when they were queued: those
+  // queued before the drops none, one queued after them all of it
+  char buf[sizeof(payload)];
+  struct iovec iov = {buf, sizeof(buf)};
+  char control[kMpingRxqControlSize];
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  ASSERT_EQ((ssize_t)sizeof(payload), recvmsg(rx, &msg, MSG_DONTWAIT));
+  uint32_t rxq = 0;
+  EXPECT_FALSE(MpingRxqOverflow(&msg, &rxq));
+
+  sendto(tx, payload, sizeof(payload), 0,
+         reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+  bool seen = false;
+  while (true) {
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(rx, &msg, MSG_DONTWAIT) < 0)
+      break;
+    seen = MpingRxqOverflow(&msg, &rxq);
+  }
+  ASSERT_TRUE(seen);
+  EXPECT_EQ(after, rxq);
+
+  close(tx);
+  close(rx);
+}
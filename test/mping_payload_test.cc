@@ -0,0 +1,79 @@
+#include <string.h>
+
+#include "gtest/gtest.h"
+#include "mp_payload.h"
+
+TEST(MpingPayload, SessionRoundTrip) {
+  char buf[64];
+  const uint64_t seq = 0x123456789abcdefULL;
+  ASSERT_EQ(kSessionPayloadLength,
+            MpingWritePayload(buf, false, 0xdeadbeef, seq, 987654321));
+
+  bool legacy = true;
+  uint32_t nonce = 0;
+  uint64_t got = 0, stamp = 0;
+  ASSERT_TRUE(MpingReadPayload(buf, kSessionPayloadLength, &legacy, &nonce,
+                               &got, &stamp));
+  EXPECT_FALSE(legacy);
+  EXPECT_EQ(0xdeadbeefu, nonce);
+  EXPECT_EQ(seq, got);
+  EXPECT_EQ(987654321u, stamp);
+
+  EXPECT_FALSE(MpingReadPayload(buf, kSessionPayloadLength - 1, &legacy,
+                                &nonce, &got, &stamp));
+}
+
+TEST(MpingPayload, CheckCatchesCorruption) {
+  char buf[64];
+  MpingWritePayload(buf, false, 1, 2, 3);
+
+  bool legacy;
+  uint32_t nonce;
+  uint64_t seq, stamp;
+  for (size_t i = kPayloadHeaderLength; i < kSessionPayloadLength; i++) {
+    buf[i] ^= 0x10;
+    EXPECT_FALSE(MpingReadPayload(buf, kSessionPayloadLength, &legacy,
+                                  &nonce, &seq, &stamp)) << "byte " << i;
+    buf[i] ^= 0x10;
+  }
+  EXPECT_TRUE(MpingReadPayload(buf, kSessionPayloadLength, &legacy, &nonce,
+                               &seq, &stamp));
+}
+
+TEST(MpingPayload, LegacyRoundTrip) {
+  char buf[64];
+  ASSERT_EQ(kLegacyPayloadLength,
+            MpingWritePayload(buf, true, 7, 42, 987654321));
+  EXPECT_EQ(0, memcmp(buf, "mlab-seq#", kPayloadHeaderLength));
+
+  bool legacy = false;
+  uint32_t nonce = 1;
+  uint64_t got = 0, stamp = 1;
+  ASSERT_TRUE(MpingReadPayload(buf, kLegacyPayloadLength, &legacy, &nonce,
+                               &got, &stamp));
+  EXPECT_TRUE(legacy);
+  EXPECT_EQ(0u, nonce);
+  EXPECT_EQ(0u, stamp);
+  EXPECT_EQ(42u, got);
+}
+
+TEST(MpingPayload, RejectsForeign) {
+  const char junk[] = "not-mping-at-all-padding";
+  bool legacy;
+  uint32_t nonce;
+  uint64_t seq, stamp;
+  EXPECT_FALSE(MpingReadPayload(junk, sizeof(junk), &legacy, &nonce, &seq,
+                                &stamp));
+}
+
+TEST(MpingPayload, WidenAcrossWrap) {
+  const uint64_t wrap = 1ULL << 32;
+  EXPECT_EQ(5u, MpingWidenSeq(5, 10));
+  EXPECT_EQ(wrap - 3, MpingWidenSeq(0xfffffffdu, wrap + 2));  // late reply
+  EXPECT_EQ(wrap + 1, MpingWidenSeq(1, wrap + 2));
+  EXPECT_EQ(3 * wrap + 7, MpingWidenSeq(7, 3 * wrap + 7));
+}
+
+TEST(MpingPayload, NonceIsNonZero) {
+  EXPECT_NE(0u, MpingNewNonce());
+}
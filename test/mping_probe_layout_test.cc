@@ -0,0 +1,117 @@
+#include <string.h>
+
+#include "gtest/gtest.h"
+#include "mp_probe_layout.h"
+
+namespace {
+
+const size_t kPayload = 16;
+
+// A reply as the receive socket of mode M would hand it over, with the
+// ICMP type and, for errors, the protocol of the quoted probe.
+template <SocketFamily F, MpingProbeMode M>
+std::string Reply(uint8_t type, uint8_t proto) {
+  typedef MpingProbeLayout<F, M> Layout;
+  std::string packet(Layout::kRecvHeaders + kPayload, '\0');
+  if (M != kProbeUdpClient) {
+    packet[Layout::kIcmpOffset] = type;
+    size_t ip = Layout::kIcmpOffset + sizeof(typename Layout::IcmpHeader);
+    if (M == kProbeUdpErrors)
+      packet[ip + (F == SOCKETFAMILY_IPV4 ? 9 : 6)] = proto;
+  }
+  for (size_t i = 0; i < kPayload; i++)
+    packet[Layout::kRecvHeaders + i] = 'a' + i;
+  return packet;
+}
+
+template <SocketFamily F, MpingProbeMode M>
+MpingReplyKind Classify(const std::string& packet, const char **payload) {
+  return MpingClassifyReply<F, M>(packet.data(), packet.size(), kPayload,
+                                  payload);
+}
+
+}  // namespace
+
+TEST(MpingProbeLayout, Sizes) {
+  EXPECT_EQ(28u, (MpingProbeLayout<SOCKETFAMILY_IPV4, kProbeEcho>::
+                  kRecvHeaders));
+  EXPECT_EQ(8u, (MpingProbeLayout<SOCKETFAMILY_IPV6, kProbeEcho>::
+                 kRecvHeaders));
+  EXPECT_EQ(56u, (MpingProbeLayout<SOCKETFAMILY_IPV4, kProbeUdpErrors>::
+                  kRecvHeaders));
+  EXPECT_EQ(56u, (MpingProbeLayout<SOCKETFAMILY_IPV6, kProbeUdpErrors>::
+                  kRecvHeaders));
+  EXPECT_EQ(0u, (MpingProbeLayout<SOCKETFAMILY_IPV6, kProbeUdpClient>::
+                 kRecvHeaders));
+  EXPECT_EQ(48u, (MpingProbeLayout<SOCKETFAMILY_IPV6, kProbeUdpClient>::
+                  kSendOverhead));
+  EXPECT_EQ(8u, (MpingProbeLayout<SOCKETFAMILY_IPV4, kProbeEcho>::
+                 kProbeHeader));
+}
+
+TEST(MpingProbeLayout, EchoReplies) {
+  const char *payload = NULL;
+  std::string v4 = Reply<SOCKETFAMILY_IPV4, kProbeEcho>(0, 0);
+  EXPECT_EQ(kReplyOk, (Classify<SOCKETFAMILY_IPV4, kProbeEcho>(v4, &payload)));
+  EXPECT_EQ(v4.data() + 28, payload);
+
+  std::string v6 = Reply<SOCKETFAMILY_IPV6, kProbeEcho>(129, 0);
+  EXPECT_EQ(kReplyOk, (Classify<SOCKETFAMILY_IPV6, kProbeEcho>(v6, &payload)));
+  EXPECT_EQ(v6.data() + 8, payload);
+
+  // an echo request of someone else's is not a reply
+  std::string request = Reply<SOCKETFAMILY_IPV6, kProbeEcho>(128, 0);
+  EXPECT_EQ(kReplyWrongType,
+            (Classify<SOCKETFAMILY_IPV6, kProbeEcho>(request, &payload)));
+}
+
+TEST(MpingProbeLayout, UdpErrors) {
+  const char *payload = NULL;
+  std::string exceeded =
+      Reply<SOCKETFAMILY_IPV4, kProbeUdpErrors>(11, IPPROTO_UDP);
+  EXPECT_EQ(kReplyOk, (Classify<SOCKETFAMILY_IPV4, kProbeUdpErrors>(
+                          exceeded, &payload)));
+  EXPECT_EQ(exceeded.data() + 56, payload);
+
+  std::string unreachable =
+      Reply<SOCKETFAMILY_IPV6, kProbeUdpErrors>(1, IPPROTO_UDP);
+  EXPECT_EQ(kReplyOk, (Classify<SOCKETFAMILY_IPV6, kProbeUdpErrors>(
+                          unreachable, &payload)));
+  EXPECT_EQ(unreachable.data() + 56, payload);
+
+  std::string tcp = Reply<SOCKETFAMILY_IPV4, kProbeUdpErrors>(3, IPPROTO_TCP);
+  EXPECT_EQ(kReplyNotUdp,
+            (Classify<SOCKETFAMILY_IPV4, kProbeUdpErrors>(tcp, &payload)));
+
+  std::string echo = Reply<SOCKETFAMILY_IPV6, kProbeUdpErrors>(129, 0);
+  EXPECT_EQ(kReplyWrongType,
+            (Classify<SOCKETFAMILY_IPV6, kProbeUdpErrors>(echo, &payload)));
+}
+
+TEST(MpingProbeLayout, ShortPackets) {
+  const char *payload = NULL;
+  std::string v4 = Reply<SOCKETFAMILY_IPV4, kProbeEcho>(0, 0);
+  EXPECT_EQ(kReplyShort, (MpingClassifyReply<SOCKETFAMILY_IPV4, kProbeEcho>(
+                             v4.data(), 20, kPayload, &payload)));
+  EXPECT_EQ(kReplyTruncated,
+            (MpingClassifyReply<SOCKETFAMILY_IPV4, kProbeEcho>(
+                v4.data(), v4.size() - 1, kPayload, &payload)));
+
+  // the quote of an ICMP error may stop short of our payload
+  std::string v6 = Reply<SOCKETFAMILY_IPV6, kProbeUdpErrors>(3, IPPROTO_UDP);
+  EXPECT_EQ(kReplyTruncated,
+            (MpingClassifyReply<SOCKETFAMILY_IPV6, kProbeUdpErrors>(
+                v6.data(), 56, kPayload, &payload)));
+}
+
+TEST(MpingProbeLayout, ClientRepliesAreAllPayload) {
+  const char *payload = NULL;
+  std::string v4 = Reply<SOCKETFAMILY_IPV4, kProbeUdpClient>(0, 0);
+  EXPECT_EQ(kReplyOk, (Classify<SOCKETFAMILY_IPV4, kProbeUdpClient>(
+                          v4, &payload)));
+  EXPECT_EQ(v4.data(), payload);
+
+  // the payload check finds out about short ones
+  EXPECT_EQ(kReplyOk, (MpingClassifyReply<SOCKETFAMILY_IPV6, kProbeUdpClient>(
+                          v4.data(), 3, kPayload, &payload)));
+}
@@ -0,0 +1,95 @@
+#include <errno.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "mp_clock.h"
+#include "mp_config.h"
+#include "mp_probe_loop.h"
+#include "mp_sim_transport.h"
+#include "mp_stats.h"
+
+namespace {
+
+// Records what the loop hands its hooks.
+class Recorder : public MpingProbeHooks {
+  public:
+    virtual void OnSend(uint64_t seq, uint64_t now) { sent.push_back(seq); }
+    virtual void OnReply(uint64_t seq, uint64_t now, uint64_t send_time,
+                         double rtt) {
+      replies.push_back(seq);
+      rtts.push_back(rtt);
+    }
+
+    std::vector<uint64_t> sent;
+    std::vector<uint64_t> replies;
+    std::vector<double> rtts;
+};
+
+}  // namespace
+
+TEST(MpingProbeLoop, FillsTheWindow) {
+  MpingSimTransport sim((MpingSimConfig()));  // 20 ms RTT
+  ASSERT_EQ(0, sim.Initialize("10.0.0.1", "", 0, 1500, 64, 0, false));
+  MpingConfig config;
+  MpingStat stat(64);
+  MpingProbeLoop loop(config, &sim, &stat);
+  Recorder recorder;
+  loop.SetHooks(&recorder);
+
+  int err;
+  ASSERT_EQ(0, loop.Send(25, false, 100, &err));
+  EXPECT_EQ(10u, loop.sent());  // at most 10 at once
+  ASSERT_EQ(0, loop.Send(25, false, 100, &err));
+  ASSERT_EQ(0, loop.Send(25, false, 100, &err));
+  EXPECT_EQ(25u, loop.sent());
+  ASSERT_EQ(0, loop.Send(25, false, 100, &err));
+  EXPECT_EQ(25u, loop.sent());  // full
+  ASSERT_EQ(0, loop.Send(25, true, 100, &err));
+  EXPECT_EQ(26u, loop.sent());  // forced
+  EXPECT_EQ(26u, recorder.sent.size());
+  EXPECT_EQ(26u, stat.in_flight());
+
+  uint64_t seq;
+  double rtt;
+  ASSERT_EQ(1, loop.Receive(&seq, &rtt, &err));
+  EXPECT_EQ(1u, seq);
+  EXPECT_NEAR(20.0, rtt, 0.1);
+  ASSERT_EQ(1u, recorder.replies.size());
+  EXPECT_EQ(rtt, recorder.rtts[0]);
+  EXPECT_EQ(25u, stat.in_flight());
+
+  // a deadline before the next reply
+  sim.SetRecvDeadline(sim.NowNs() + 1);
+  EXPECT_EQ(0, loop.Receive(&seq, &rtt, &err));
+  EXPECT_EQ(EAGAIN, err);
+}
+
+TEST(MpingProbeLoop, SlowStartAndBursts) {
+  MpingSimTransport sim((MpingSimConfig()));
+  ASSERT_EQ(0, sim.Initialize("10.0.0.1", "", 0, 1500, 64, 0, false));
+  MpingConfig config;
+  config.slow_start = true;
+  config.burst = 4;
+  MpingStat stat(64);
+  MpingProbeLoop loop(config, &sim, &stat);
+
+  int err;
+  ASSERT_EQ(0, loop.Send(8, false, 100, &err));
+  EXPECT_EQ(2u, loop.sent());
+  while (loop.sent() < 8)
+    ASSERT_EQ(0, loop.Send(8, false, 100, &err));
+  EXPECT_TRUE(loop.bursting());
+
+  // 4 at once, only once 4 have come back
+  uint64_t seq;
+  double rtt;
+  for (int i = 0; i < 3; i++) {
+    ASSERT_EQ(1, loop.Receive(&seq, &rtt, &err));
+    ASSERT_EQ(0, loop.Send(8, false, 100, &err));
+    EXPECT_EQ(8u, loop.sent());
+  }
+  ASSERT_EQ(1, loop.Receive(&seq, &rtt, &err));
+  ASSERT_EQ(0, loop.Send(8, false, 100, &err));
+  EXPECT_EQ(12u, loop.sent());
+}
@@ -0,0 +1,40 @@
+#include "gtest/gtest.h"
+#include "mp_profile.h"
+
+TEST(MpingProfile, DisabledRecordsNothing) {
+  MpingProfile profile;
+  uint64_t start = profile.Start();
+  EXPECT_EQ(0u, start);
+  profile.Stop(MpingProfile::kSend, start);
+  EXPECT_EQ(0u, profile.count(MpingProfile::kSend));
+}
+
+TEST(MpingProfile, TimesAPhase) {
+  MpingProfile profile;
+  profile.Enable(true);
+  uint64_t start = profile.Start();
+  volatile int spin = 0;
+  for (int i = 0; i < 1000; i++)
+    spin = spin + i;
+  profile.Stop(MpingProfile::kStats, start);
+  EXPECT_EQ(1u, profile.count(MpingProfile::kStats));
+  EXPECT_GT(profile.Percentile(MpingProfile::kStats, 1.0), 0u);
+  EXPECT_EQ(0u, profile.count(MpingProfile::kReceive));
+}
+
+TEST(MpingProfile, Percentiles) {
+  MpingProfile profile;
+  for (int i = 0; i < 98; i++)
+    profile.Add(MpingProfile::kReceive, 100);  // bucket [64, 128)
+  profile.Add(MpingProfile::kReceive, 5000);  // [4096, 8192)
+  profile.Add(MpingProfile::kReceive, 100000);
+
+  EXPECT_EQ(100u, profile.count(MpingProfile::kReceive));
+  EXPECT_EQ(127u, profile.Percentile(MpingProfile::kReceive, 0.5));
+  EXPECT_EQ(8191u, profile.Percentile(MpingProfile::kReceive, 0.99));
+  EXPECT_EQ(100000u, profile.Percentile(MpingProfile::kReceive, 1.0));
+
+  profile.Add(MpingProfile::kParse, 0);
+  EXPECT_EQ(0u, profile.Percentile(MpingProfile::kParse, 0.5));
+  profile.Print();
+}
@@ -0,0 +1,42 @@
+#include "gtest/gtest.h"
+#include "mp_queue.h"
+
+namespace {
+
+void Interval(MpingQueueEst *q, double rtt, unsigned int lost) {
+  for (int i = 0; i < 100; i++)
+    q->OnRecv(rtt, 1000);
+  q->OnTick(1.0, lost);
+}
+
+}  // namespace
+
+TEST(MpingQueueEst, LittlesLaw) {
+  MpingQueueEst q;
+  Interval(&q, 10.0, 0);
+  EXPECT_DOUBLE_EQ(10.0, q.base_rtt());
+  EXPECT_DOUBLE_EQ(0.0, q.queue_pkts());
+
+  Interval(&q, 60.0, 0);  // 50 ms behind 100 pkt/s
+  EXPECT_DOUBLE_EQ(50.0, q.queue_ms());
+  EXPECT_DOUBLE_EQ(5.0, q.queue_pkts());
+  EXPECT_DOUBLE_EQ(5000.0, q.queue_bytes());
+  EXPECT_LT(q.buffer_pkts(), 0);  // no loss yet
+
+  Interval(&q, 90.0, 3);  // overflowing
+  EXPECT_DOUBLE_EQ(8.0, q.buffer_pkts());
+  EXPECT_DOUBLE_EQ(100.0, q.capacity());
+}
+
+TEST(MpingQueueEst, BaseRttSlides) {
+  MpingQueueEst q;
+  Interval(&q, 10.0, 0);
+  for (int i = 0; i < 59; i++)
+    Interval(&q, 30.0, 0);
+  EXPECT_DOUBLE_EQ(10.0, q.base_rtt());
+
+  Interval(&q, 30.0, 0);  // the 10 ms interval ages out: a new route
+  EXPECT_DOUBLE_EQ(30.0, q.base_rtt());
+  EXPECT_DOUBLE_EQ(0.0, q.queue_pkts());
+  EXPECT_DOUBLE_EQ(2.0, q.max_queue_pkts());
+}
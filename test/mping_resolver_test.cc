@@ -0,0 +1,179 @@
+#include <netdb.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "mp_clock.h"
+#include "mp_resolver.h"
+
+namespace {
+
+// Resolves from a table, after |delay_us|, counting the lookups.
+class StubLookup : public MpingLookup {
+  public:
+    explicit StubLookup(unsigned int delay_us)
+        : delay_us_(delay_us), calls_(0) { }
+
+    void Add(const std::string& host, const std::string& ip) {
+      table_[host].insert(ip);
+    }
+
+    virtual int Lookup(const std::string& host, std::set<std::string> *ips) {
+      __sync_fetch_and_add(&calls_, 1);
+      usleep(delay_us_);
+      std::map<std::string, std::set<std::string> >::const_iterator it =
+          table_.find(host);
+      if (it == table_.end())
+        return EAI_NONAME;
+      *ips = it->second;
+      return 0;
+    }
+
+    int calls() const { return calls_; }
+
+  private:
+    unsigned int delay_us_;
+    int calls_;
+    std::map<std::string, std::set<std::string> > table_;
+};
+
+// Waits on the resolver's descriptor until everything asked for is back.
+void TakeAll(MpingResolver *resolver,
+             std::vector<MpingResolver::Result> *results) {
+  while (resolver->pending() > 0) {
+    struct pollfd pfd;
+    pfd.fd = resolver->fd();
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    ASSERT_EQ(1, poll(&pfd, 1, 5000));
+    resolver->Take(results);
+  }
+}
+
+}  // namespace
+
+TEST(MpingResolver, NumericAtOnce) {
+  StubLookup stub(0);
+  MpingResolver resolver(2, 300, 30, &stub);
+  std::string error;
+  ASSERT_EQ(0, resolver.Init(&error)) << error;
+  resolver.Resolve("192.0.2.1");
+  resolver.Resolve("2001:db8::1");
+
+  std::vector<MpingResolver::Result> results;
+  resolver.Take(&results);  // no waiting
+  ASSERT_EQ(2u, results.size());
+  EXPECT_EQ("192.0.2.1", results[0].host);
+  EXPECT_EQ(1u, results[0].ips.count("192.0.2.1"));
+  EXPECT_EQ(1u, results[1].ips.count("2001:db8::1"));
+  EXPECT_EQ(0, stub.calls());
+  EXPECT_EQ(0u, resolver.pending());
+}
+
+TEST(MpingResolver, InitFailsWithoutDescriptors) {
+  struct rlimit saved;
+  ASSERT_EQ(0, getrlimit(RLIMIT_NOFILE, &saved));
+  int lowest = dup(0);
+  ASSERT_GE(lowest, 0);
+  close(lowest);
+
+  struct rlimit limit = saved;
+  limit.rlim_cur = lowest;  // no room for the pipe
+  ASSERT_EQ(0, setrlimit(RLIMIT_NOFILE, &limit));
+  {
+    StubLookup stub(0);
+    MpingResolver resolver(2, 300, 30, &stub);
+    std::string error;
+    EXPECT_EQ(-1, resolver.Init(&error));
+    EXPECT_FALSE(error.empty());
+  }
+  ASSERT_EQ(0, setrlimit(RLIMIT_NOFILE, &saved));
+}
+
+TEST(MpingResolver, LooksUpInParallel) {
+  StubLookup stub(100000);  // 100 ms each
+  char name[16];
+  for (int i = 0; i < 16; i++) {
+    snprintf(name, sizeof(name), "host%d", i);
+    stub.Add(name, "192.0.2.1");
+  }
+
+  MpingResolver resolver(8, 300, 30, &stub);
+  std::string error;
+  ASSERT_EQ(0, resolver.Init(&error)) << error;
+  uint64_t start = MpingClock::NowNs();
+  for (int i = 0; i < 16; i++) {
+    snprintf(name, sizeof(name), "host%d", i);
+    resolver.Resolve(name);
+  }
+
+  std::vector<MpingResolver::Result> results;
+  TakeAll(&resolver, &results);
+  EXPECT_EQ(16u, results.size());
+  EXPECT_EQ(16, stub.calls());
+  // two rounds of 8, not 16 lookups one after the other
+  EXPECT_LT(MpingClock::NowNs() - start, 800 * kNsPerMs);
+}
+
+TEST(MpingResolver, CachesResultsAndFailures) {
+  StubLookup stub(0);
+  stub.Add("a.example", "192.0.2.1");
+  stub.Add("a.example", "2001:db8::1");
+  MpingResolver resolver(2, 300, 30, &stub);
+  std::string error;
+  ASSERT_EQ(0, resolver.Init(&error)) << error;
+
+  std::vector<MpingResolver::Result> results;
+  resolver.Resolve("a.example");
+  resolver.Resolve("a.example");  // one lookup, one result
+  resolver.Resolve("nx.example");
+  TakeAll(&resolver, &results);
+  ASSERT_EQ(2u, results.size());
+  EXPECT_EQ(2, stub.calls());
+  for (size_t i = 0; i < results.size(); i++) {
+    if (results[i].host == "a.example") {
+      EXPECT_EQ(0, results[i].error);
+      EXPECT_EQ(2u, results[i].ips.size());
+    } else {
+      EXPECT_EQ(EAI_NONAME, results[i].error);
+      EXPECT_TRUE(results[i].ips.empty());
+    }
+  }
+
+  // both from the cache, at once
+  results.clear();
+  resolver.Resolve("a.example");
+  resolver.Resolve("nx.example");
+  resolver.Take(&results);
+  EXPECT_EQ(2u, results.size());
+  EXPECT_EQ(2, stub.calls());
+}
+
+TEST(MpingResolver, CacheExpires) {
+  StubLookup stub(0);
+  stub.Add("a.example", "192.0.2.1");
+  MpingResolver resolver(1, 0, 0, &stub);
+  std::string error;
+  ASSERT_EQ(0, resolver.Init(&error)) << error;
+
+  std::vector<MpingResolver::Result> results;
+  resolver.Resolve("a.example");
+  TakeAll(&resolver, &results);
+  resolver.Resolve("a.example");
+  TakeAll(&resolver, &results);
+  EXPECT_EQ(2u, results.size());
+  EXPECT_EQ(2, stub.calls());
+}
+
+TEST(MpingResolver, SystemLookupReadsHosts) {
+  MpingSystemLookup lookup;
+  std::set<std::string> ips;
+  ASSERT_EQ(0, lookup.Lookup("localhost", &ips));  // from /etc/hosts
+  EXPECT_TRUE(ips.count("127.0.0.1") || ips.count("::1"));
+}
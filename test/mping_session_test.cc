@@ -0,0 +1,194 @@
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "mp_clock.h"
+#include "mp_session.h"
+#include "mp_sim_transport.h"
+
+namespace {
+
+class Recorder : public MpingSessionListener {
+  public:
+    Recorder() : done(0) { }
+
+    virtual void OnInterval(const MpingShmStats& stats, int window,
+                            size_t size) {
+      intervals.push_back(stats);
+      windows.push_back(window);
+      sizes.push_back(size);
+    }
+    virtual void OnDone(const MpingShmStats& stats) {
+      done++;
+      total = stats;
+    }
+
+    std::vector<MpingShmStats> intervals;
+    std::vector<int> windows;
+    std::vector<size_t> sizes;
+    int done;
+    MpingShmStats total;
+};
+
+MpingConfig SimConfig(int window, bool loop) {
+  MpingConfig config;
+  config.win_size = window;
+  config.loop = loop;
+  config.pkt_size = 100;
+  config.dst_host = "10.0.0.1";
+  return config;
+}
+
+}  // namespace
+
+TEST(MpingSession, ErrorsAreReturned) {
+  MpingSimTransport sim((MpingSimConfig()));
+  std::string error;
+
+  MpingSession nodest;
+  nodest.SetTransport(&sim);
+  MpingConfig config = SimConfig(4, false);
+  config.dst_host = "";
+  EXPECT_EQ(-1, nodest.Start(config, &error));
+  EXPECT_FALSE(nodest.running());
+
+  MpingSession name;  // not resolved on the spot
+  name.SetTransport(&sim);
+  config = SimConfig(4, false);
+  config.dst_host = "localhost";
+  EXPECT_EQ(-1, name.Start(config, &error));
+  EXPECT_NE(std::string::npos, error.find("not an IP address"));
+
+  MpingSession hops;
+  hops.SetTransport(&sim);
+  config = SimConfig(4, false);
+  config.inc_ttl = 8;
+  config.ttl = 8;
+  EXPECT_EQ(-1, hops.Start(config, &error));
+
+  MpingSession nosize;
+  nosize.SetTransport(&sim);
+  config = SimConfig(4, false);
+  config.pkt_size = 0;
+  EXPECT_EQ(-1, nosize.Start(config, &error));
+
+  MpingSession tiny;
+  tiny.SetTransport(&sim);
+  config = SimConfig(4, false);
+  config.pkt_size = 20;
+  EXPECT_EQ(-1, tiny.Start(config, &error));
+
+  MpingSession client;
+  client.SetTransport(&sim);
+  config = SimConfig(4, false);
+  config.client_mode = true;
+  EXPECT_EQ(-1, client.Start(config, &error));
+  EXPECT_NE(std::string::npos, error.find("-p"));
+}
+
+TEST(MpingSession, WindowSweep) {
+  MpingSimTransport sim((MpingSimConfig()));
+  MpingSession session;
+  Recorder recorder;
+  session.SetTransport(&sim);
+  session.SetListener(&recorder);
+
+  std::string error;
+  ASSERT_EQ(0, session.Start(SimConfig(3, false), &error));
+  int polls = 0;
+  while (session.Poll(kNsPerSec) > 0)
+    polls++;
+
+  // windows 1..3, then one second for the tail
+  ASSERT_EQ(4u, recorder.windows.size());
+  EXPECT_EQ(1, recorder.windows[0]);
+  EXPECT_EQ(3, recorder.windows[2]);
+  EXPECT_EQ(0, recorder.windows[3]);
+  EXPECT_EQ(0u, recorder.intervals[3].sent_temp);
+
+  // 20 ms RTT, each window good for about 50 round trips
+  EXPECT_EQ(1, recorder.done);
+  EXPECT_GT(recorder.total.sent, 250u);
+  EXPECT_EQ(recorder.total.sent, recorder.total.received);
+  EXPECT_EQ(0u, recorder.total.lost);
+  EXPECT_FALSE(session.running());
+  EXPECT_EQ(0, session.Poll(kNsPerSec));
+  EXPECT_GT(polls, 250);
+}
+
+TEST(MpingSession, PollDoesNotWait) {
+  MpingSimTransport sim((MpingSimConfig()));
+  MpingSession session;
+  Recorder recorder;
+  session.SetTransport(&sim);
+  session.SetListener(&recorder);
+
+  std::string error;
+  ASSERT_EQ(0, session.Start(SimConfig(4, true), &error));
+  uint64_t start = sim.now_ns();
+  EXPECT_EQ(1, session.Poll(0));
+  EXPECT_EQ(start, sim.now_ns());  // sent, nothing back yet
+  EXPECT_EQ(4u, sim.sent());
+  EXPECT_EQ(start + kNsPerSec, session.next_wakeup());
+
+  sim.WaitUntil(start + 50 * kNsPerMs);
+  EXPECT_EQ(1, session.Poll(0));
+  EXPECT_EQ(start + 50 * kNsPerMs, sim.now_ns());
+  EXPECT_EQ(8u, sim.sent());  // each reply sent the next probe
+
+  session.Stop();
+  EXPECT_FALSE(session.running());
+  EXPECT_EQ(1, recorder.done);
+  EXPECT_EQ(4u, recorder.total.received);
+  EXPECT_EQ(4u, recorder.total.in_flight);
+  EXPECT_TRUE(recorder.intervals.empty());
+}
+
+TEST(MpingSession, FixedWindowUntilStopped) {
+  MpingSimTransport sim((MpingSimConfig()));
+  MpingSession session;
+  Recorder recorder;
+  session.SetTransport(&sim);
+  session.SetListener(&recorder);
+
+  std::string error;
+  ASSERT_EQ(0, session.Start(SimConfig(8, true), &error));
+  while (recorder.intervals.size() < 5)
+    ASSERT_EQ(1, session.Poll(kNsPerSec));
+  session.Stop();
+
+  EXPECT_EQ(1, recorder.done);
+  for (size_t i = 0; i < recorder.windows.size(); i++) {
+    EXPECT_EQ(8, recorder.windows[i]);
+    EXPECT_EQ(i, recorder.intervals[i].interval);
+  }
+  // 8 probes per 20 ms round trip
+  EXPECT_NEAR(400, recorder.intervals[2].received_temp, 10);
+}
+
+TEST(MpingSession, SizeSweep) {
+  MpingSimTransport sim((MpingSimConfig()));
+  MpingSession session;
+  Recorder recorder;
+  session.SetTransport(&sim);
+  session.SetListener(&recorder);
+
+  MpingConfig config = SimConfig(2, false);
+  config.pkt_size = 0;
+  config.loop_size = -3;  // 128 to 2048 in steps of 128
+  std::string error;
+  ASSERT_EQ(0, session.Start(config, &error));
+  while (session.Poll(kNsPerSec) > 0) { }
+
+  // windows 1, 2 for each of the 16 sizes, then the tail
+  ASSERT_EQ(33u, recorder.windows.size());
+  EXPECT_EQ(128u, recorder.sizes[0]);
+  EXPECT_EQ(1, recorder.windows[0]);
+  EXPECT_EQ(128u, recorder.sizes[1]);
+  EXPECT_EQ(2, recorder.windows[1]);
+  EXPECT_EQ(256u, recorder.sizes[2]);
+  EXPECT_EQ(1, recorder.windows[2]);
+  EXPECT_EQ(2048u, recorder.sizes[31]);
+  EXPECT_EQ(0, recorder.windows[32]);
+  EXPECT_EQ(recorder.total.sent, recorder.total.received);
+}
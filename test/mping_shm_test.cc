@@ -0,0 +1,94 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "mp_shm.h"
+#include "mp_stats.h"
+
+namespace {
+
+std::string SegmentName() {
+  char name[64];
+  snprintf(name, sizeof(name), "/mping_test.%d", getpid());
+  return name;
+}
+
+struct Writer {
+  MpingShmWriter *shm;
+  volatile bool stop;
+};
+
+void* WriteLoop(void *arg) {
+  Writer *w = static_cast<Writer *>(arg);
+  MpingShmStats s;
+  memset(&s, 0, sizeof(s));
+  for (uint64_t k = 1; !w->stop; k++) {
+    // every counter the same: a torn snapshot would mix two values
+    s.sent = s.received = s.lost = s.late = s.in_flight = k;
+    s.srtt = k;
+    w->shm->Publish(s);
+  }
+  return NULL;
+}
+
+}  // namespace
+
+TEST(MpingShm, StatsRoundTrip) {
+  MpingShmWriter shm;
+  ASSERT_EQ(0, shm.Open(SegmentName()));
+
+  MpingStat stat(8);
+  stat.EnqueueSend(1, 1000000);
+  stat.EnqueueSend(2, 2000000);
+  stat.EnqueueRecv(1, 11000000, 1000000);
+
+  MpingShmStats s;
+  memset(&s, 0, sizeof(s));
+  s.pid = getpid();
+  stat.Snapshot(&s);
+  shm.Publish(s);
+
+  const MpingShmStats *shared = MpingShmOpenReader(SegmentName());
+  ASSERT_TRUE(shared != NULL);
+  MpingShmStats r;
+  ASSERT_TRUE(MpingShmRead(shared, &r));
+  EXPECT_EQ(static_cast<uint64_t>(getpid()), r.pid);
+  EXPECT_EQ(2u, r.sent);
+  EXPECT_EQ(1u, r.received);
+  EXPECT_EQ(1u, r.in_flight);
+  EXPECT_DOUBLE_EQ(10.0, r.min_rtt);
+  EXPECT_EQ(0u, r.seq % 2);
+}
+
+TEST(MpingShm, SnapshotsAreConsistent) {
+  MpingShmWriter shm;
+  ASSERT_EQ(0, shm.Open(SegmentName()));
+  const MpingShmStats *shared = MpingShmOpenReader(SegmentName());
+  ASSERT_TRUE(shared != NULL);
+
+  Writer w = {&shm, false};
+  pthread_t writer;
+  ASSERT_EQ(0, pthread_create(&writer, NULL, WriteLoop, &w));
+
+  uint64_t last = 0;
+  for (int i = 0; i < 200000; i++) {
+    MpingShmStats r;
+    ASSERT_TRUE(MpingShmRead(shared, &r));
+    if (r.sent == 0)
+      continue;  // what Open wrote, before the writer's first
+    ASSERT_EQ(r.sent, r.received);
+    ASSERT_EQ(r.sent, r.lost);
+    ASSERT_EQ(r.sent, r.late);
+    ASSERT_EQ(r.sent, r.in_flight);
+    ASSERT_DOUBLE_EQ(static_cast<double>(r.sent), r.srtt);
+    ASSERT_GE(r.sent, last);
+    last = r.sent;
+  }
+
+  w.stop = true;
+  pthread_join(writer, NULL);
+}
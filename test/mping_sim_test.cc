@@ -0,0 +1,194 @@
+#include <stdio.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "mlab/mlab.h"
+#include "mp_clock.h"
+#include "mp_mping.h"
+#include "mp_sim_transport.h"
+
+namespace {
+
+void RunSim(MpingSimTransport *sim, int argc, const char **argv) {
+  MPing mp(argc, argv);
+  mp.SetTransport(sim);
+  mp.Run();
+}
+
+}  // namespace
+
+TEST(MpingSimTransport, WindowLimited) {
+  MpingSimConfig config;
+  config.rate_bps = 1000000000;
+  config.delay_us = 5000;  // 10 ms RTT
+  MpingSimTransport sim(config);
+
+  const char *argv[] = {"mping", "-n", "10", "-b", "100", "10.0.0.1"};
+  RunSim(&sim, 6, argv);
+
+  // one second per window 1..10, each window good for 100 RTTs
+  EXPECT_GT(sim.sent(), 5000u);
+  EXPECT_LT(sim.sent(), 6000u);
+  EXPECT_EQ(sim.sent(), sim.delivered());
+  EXPECT_EQ(0u, sim.queue_drops());
+}
+
+TEST(MpingSimTransport, BottleneckOverflow) {
+  MpingSimConfig config;
+  config.rate_bps = 1000000;  // 125 packets of 1000 bytes per second
+  config.buffer_bytes = 5000;
+  config.delay_us = 10000;
+  MpingSimTransport sim(config);
+
+  const char *argv[] = {"mping", "-n", "20", "-b", "1000", "10.0.0.1"};
+  RunSim(&sim, 6, argv);
+
+  EXPECT_GT(sim.queue_drops(), 0u);
+  EXPECT_LE(sim.max_queue_bytes(), config.buffer_bytes);
+  // never more than the link can carry in 20 seconds plus the tail
+  EXPECT_LE(sim.delivered(), 125u * 21);
+}
+
+TEST(MpingSimTransport, LossAndReorder) {
+  MpingSimConfig config;
+  config.loss = 0.1;
+  config.reorder = 0.1;
+  MpingSimTransport sim(config);
+
+  const char *argv[] = {"mping", "-n", "8", "-b", "500", "10.0.0.1"};
+  RunSim(&sim, 6, argv);
+
+  EXPECT_GT(sim.random_drops(), 0u);
+  EXPECT_GT(sim.reordered(), 0u);
+  EXPECT_EQ(sim.sent(),
+            sim.delivered() + sim.random_drops() + sim.queue_drops());
+}
+
+TEST(MpingSimTransport, Deterministic) {
+  MpingSimConfig config;
+  config.loss = 0.05;
+  config.reorder = 0.05;
+  config.seed = 42;
+  MpingSimTransport a(config);
+  MpingSimTransport b(config);
+
+  const char *argv[] = {"mping", "-n", "6", "-b", "500", "10.0.0.1"};
+  RunSim(&a, 6, argv);
+  RunSim(&b, 6, argv);
+
+  EXPECT_EQ(a.sent(), b.sent());
+  EXPECT_EQ(a.delivered(), b.delivered());
+  EXPECT_EQ(a.random_drops(), b.random_drops());
+  EXPECT_EQ(a.now_ns(), b.now_ns());
+}
+
+TEST(MpingSimTransport, Throughput) {
+  MpingSimConfig config;
+  config.rate_bps = 100000000000ULL;
+  config.buffer_bytes = 100000000;
+  config.delay_us = 500;  // 1 ms RTT
+  MpingSimTransport sim(config);
+
+  // timed in tools/mping_sim_bench.cc
+  const char *argv[] = {"mping", "-n", "60", "-b", "100", "10.0.0.1"};
+  RunSim(&sim, 6, argv);
+  EXPECT_GT(sim.sent(), 1000000u);
+  EXPECT_EQ(0u, sim.queue_drops());
+}
+
+TEST(MpingSimTransport, KneeSearch) {
+  MpingSimConfig config;
+  config.rate_bps = 10000000;  // 1250 packets of 1000 bytes per second
+  config.buffer_bytes = 50000;
+  config.delay_us = 10000;
+  MpingSimTransport sim(config);
+
+  const char *argv[] = {"mping", "-K", "-n", "500", "-b", "1000", "10.0.0.1"};
+  testing::internal::CaptureStdout();
+  RunSim(&sim, 7, argv);
+  std::string out = testing::internal::GetCapturedStdout();
+
+  // pipe is 1250 pkt/s * 20.8 ms = 26 packets, then 50 packets of buffer
+  int knee = 0, buffer = 0;
+  size_t pos = out.find("Knee:");
+  ASSERT_NE(std::string::npos, pos);
+  ASSERT_EQ(2, sscanf(out.c_str() + pos,
+                      "Knee: packet size 1000 window %d capacity %*f pkt/s "
+                      "%*f Mbps buffer %d", &knee, &buffer));
+  EXPECT_NEAR(26, knee, 2);
+  EXPECT_NEAR(50, buffer, 3);
+
+  // far less than the one second per window of the linear sweep
+  EXPECT_LT(sim.now_ns() / 1000000000ULL - config.start_sec, 30u);
+}
+
+TEST(MpingSimTransport, HeavyLossKeepsWindow) {
+  MpingSimConfig config;
+  config.loss = 0.7;
+  config.delay_us = 10000;  // 20 ms RTT
+  MpingSimTransport sim(config);
+
+  const char *argv[] = {"mping", "-n", "4", "-b", "100", "-T", "30",
+                        "10.0.0.1"};
+  RunSim(&sim, 8, argv);
+
+  // a probe holds its credit for the 20 ms RTT, or the 30 ms timeout if
+  // lost: about 37 probes per window slot per second, 10 slots in all.
+  // Waiting for a later reply instead stalls on 0.7^window.
+  EXPECT_GT(sim.sent(), 300u);
+}
+
+TEST(MpingSimTransport, AllHopsAtOnce) {
+  MpingSimConfig config;
+  config.hops = 5;
+  config.delay_us = 10000;
+  MpingSimTransport sim(config);
+
+  const char *argv[] = {"mping", "-n", "8", "-b", "100", "-a", "8", "-H",
+                        "10.0.0.1"};
+  uint64_t start = sim.now_ns();
+  RunSim(&sim, 9, argv);
+
+  // one pass over windows 1..8 and the tail, not one per TTL
+  EXPECT_LE(sim.now_ns() - start, 12 * kNsPerSec);
+  EXPECT_EQ(sim.sent(), sim.delivered());
+}
+
+TEST(MpingSimTransport, InterleavedSizes) {
+  MpingSimConfig config;
+  config.rate_bps = 1000000000;
+  MpingSimTransport sim(config);
+
+  const char *argv[] = {"mping", "-n", "8", "-b", "-4", "-I", "10.0.0.1"};
+  uint64_t start = sim.now_ns();
+  RunSim(&sim, 7, argv);
+
+  // 17 sizes in the time of one: windows 1..8 and the tail
+  EXPECT_LE(sim.now_ns() - start, 12 * kNsPerSec);
+  EXPECT_EQ(sim.sent(), sim.delivered());
+}
+
+TEST(MpingSimTransport, SwitchingTime) {
+  MpingSimConfig config;
+  config.rate_bps = 10000000;
+  config.buffer_bytes = 1000000;
+  config.delay_us = 500;
+  MpingSimTransport sim(config);
+
+  const char *argv[] = {"mping", "-n", "10", "-b", "-4", "10.0.0.1"};
+  std::streambuf *saved = std::cout.rdbuf();
+  std::ostringstream out;
+  std::cout.rdbuf(out.rdbuf());
+  RunSim(&sim, 6, argv);
+  std::cout.rdbuf(saved);
+
+  // serialization at the bottleneck only, on the way out; the reply
+  // comes straight back after the 1 ms RTT
+  std::string last = out.str().substr(out.str().rfind("Switching:"));
+  EXPECT_NE(std::string::npos, last.find("per packet 1.000"));
+  EXPECT_NE(std::string::npos, last.find("per byte 800.000"));
+  EXPECT_NE(std::string::npos, last.find("capacity 10.0"));
+}
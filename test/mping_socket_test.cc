@@ -1,16 +1,36 @@
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
 #include "gtest/gtest.h"
 #include "mlab/mlab.h"
 #include "mp_socket.h"
 
+namespace {
+
+// What the UDP probes go out with.
+class TtlSocket : public MpingSocket {
+  public:
+    int SentTTL(int level, int name) const {
+      int ttl = -1;
+      socklen_t len = sizeof(ttl);
+      getsockopt(udp_sock->raw(), level, name, &ttl, &len);
+      return ttl;
+    }
+};
+
+}  // namespace
+
 TEST(MpingSocket, IPv4ICMP) {
   MpingSocket testsock;
   testsock.Initialize("127.0.0.1", "", 0, 1024, 1, 0, false);
 
   int err;
+  uint64_t stamp;
   MpingStat mystat(1);
 
   testsock.SendPacket(1, 1024, &err);
-  EXPECT_EQ(1u, testsock.ReceiveAndGetSeq(&err, &mystat));
+  EXPECT_EQ(1u, testsock.ReceiveAndGetSeq(&err, &mystat, &stamp));
 }
 
 TEST(MpingSocket, IPv4ICMPwithSrc) {
@@ -18,10 +38,11 @@ TEST(MpingSocket, IPv4ICMPwithSrc) {
   test2sock.Initialize("127.0.0.1", "172.17.94.151", 0, 1024, 1, 0, false);
 
   int err;
+  uint64_t stamp;
   MpingStat mystat(1);
 
   test2sock.SendPacket(2, 1024, &err);
-  EXPECT_EQ(2u, test2sock.ReceiveAndGetSeq(&err, &mystat));
+  EXPECT_EQ(2u, test2sock.ReceiveAndGetSeq(&err, &mystat, &stamp));
 }
 
 TEST(MpingSocket, IPv6ICMP) {
@@ -29,10 +50,11 @@ TEST(MpingSocket, IPv6ICMP) {
   testsock.Initialize("::1", "", 0, 1024, 1, 0, false);
   
   int err;
+  uint64_t stamp;
   MpingStat mystat(1);
 
   testsock.SendPacket(3, 1024, &err);
-  EXPECT_EQ(3u, testsock.ReceiveAndGetSeq(&err, &mystat));
+  EXPECT_EQ(3u, testsock.ReceiveAndGetSeq(&err, &mystat, &stamp));
 }
 
 TEST(MpingSocket, IPv6ICMPwithSrc) {
@@ -41,10 +63,11 @@ TEST(MpingSocket, IPv6ICMPwithSrc) {
                         0, 1024, 1, 0, false);
   
   int err;
+  uint64_t stamp;
   MpingStat mystat(1);
 
   test2sock.SendPacket(4, 1024, &err);
-  EXPECT_EQ(4u, test2sock.ReceiveAndGetSeq(&err, &mystat));
+  EXPECT_EQ(4u, test2sock.ReceiveAndGetSeq(&err, &mystat, &stamp));
 }
 
 TEST(MpingSocket, IPv4UDP) {
@@ -52,10 +75,11 @@ TEST(MpingSocket, IPv4UDP) {
   testsock.Initialize("127.0.0.1", "", 14, 1024, 1, 0, false);
   
   int err;
+  uint64_t stamp;
   MpingStat mystat(1);
 
   testsock.SendPacket(5, 1024, &err);
-  EXPECT_EQ(5u, testsock.ReceiveAndGetSeq(&err, &mystat));
+  EXPECT_EQ(5u, testsock.ReceiveAndGetSeq(&err, &mystat, &stamp));
 }
 
 TEST(MpingSocket, IPv4UDPwithSrc) {
@@ -63,10 +87,11 @@ TEST(MpingSocket, IPv4UDPwithSrc) {
   test2sock.Initialize("127.0.0.1", "172.17.94.151", 14, 1024, 1, 0, false);
   
   int err;
+  uint64_t stamp;
   MpingStat mystat(1);
 
   test2sock.SendPacket(6, 1024, &err);
-  EXPECT_EQ(6u, test2sock.ReceiveAndGetSeq(&err, &mystat));
+  EXPECT_EQ(6u, test2sock.ReceiveAndGetSeq(&err, &mystat, &stamp));
 }
 
 TEST(MpingSocket, IPv6UDP) {
@@ -74,10 +99,11 @@ TEST(MpingSocket, IPv6UDP) {
   testsock.Initialize("::1", "", 14, 1024, 1, 0, false);
   
   int err;
+  uint64_t stamp;
   MpingStat mystat(1);
 
   testsock.SendPacket(7, 1024, &err);
-  EXPECT_EQ(7u, testsock.ReceiveAndGetSeq(&err, &mystat));
+  EXPECT_EQ(7u, testsock.ReceiveAndGetSeq(&err, &mystat, &stamp));
 }
 
 TEST(MpingSocket, IPv6UDPwithSrc) {
@@ -86,9 +112,32 @@ TEST(MpingSocket, IPv6UDPwithSrc) {
                         14, 1024, 1, 0, false);
   
   int err;
+  uint64_t stamp;
   MpingStat mystat(1);
 
   test2sock.SendPacket(8, 1024, &err);
-  EXPECT_EQ(8u, test2sock.ReceiveAndGetSeq(&err, &mystat));
+  EXPECT_EQ(8u, test2sock.ReceiveAndGetSeq(&err, &mystat, &stamp));
 }
 
+TEST(MpingSocket, SendTTLPerFamily) {
+  TtlSocket v4;  // client mode, no raw socket needed
+  ASSERT_EQ(0, v4.Initialize("127.0.0.1", "", 64, 1024, 1, 9, true));
+  ASSERT_TRUE(v4.SetSendTTL(7));
+  EXPECT_EQ(7, v4.SentTTL(IPPROTO_IP, IP_TTL));
+
+  TtlSocket v6;
+  ASSERT_EQ(0, v6.Initialize("::1", "", 64, 1024, 1, 9, true));
+  ASSERT_TRUE(v6.SetSendTTL(5));
+  EXPECT_EQ(5, v6.SentTTL(IPPROTO_IPV6, IPV6_UNICAST_HOPS));
+}
+
+TEST(MpingSocket, BadArgumentsAreErrors) {
+  MpingSocket sock;
+  EXPECT_EQ(-1, sock.Initialize("localhost", "", 64, 1024, 1, 9, true));
+  EXPECT_EQ(-1, sock.Initialize("127.0.0.1", "", 64, 20, 1, 9, true));
+
+  ASSERT_EQ(0, sock.Initialize("127.0.0.1", "", 64, 1024, 1, 9, true));
+  int err = 0;
+  EXPECT_FALSE(sock.SendPacket(1, 20, &err));
+  EXPECT_EQ(EINVAL, err);
+}
@@ -0,0 +1,46 @@
+#include "gtest/gtest.h"
+#include "mp_clock.h"
+#include "mp_shm.h"
+#include "mp_stat_split.h"
+#include "mp_stats.h"
+
+namespace {
+
+class TestSplit : public MpingStatSplit {
+  public:
+    TestSplit(int classes, int win_size)
+        : MpingStatSplit(classes, win_size, false, 100) { }
+
+    MpingShmStats Totals(size_t i) const {
+      MpingShmStats s;
+      stat(i).Snapshot(&s);
+      return s;
+    }
+};
+
+}  // namespace
+
+TEST(MpingStatSplit, ClassesInTurn) {
+  TestSplit split(3, 6);
+  EXPECT_EQ(3u, split.classes());
+  EXPECT_EQ(0, split.ClassFor(1));
+  EXPECT_EQ(2, split.ClassFor(3));
+  EXPECT_EQ(0, split.ClassFor(4));
+}
+
+TEST(MpingStatSplit, EachClassItsOwnSequence) {
+  TestSplit split(2, 4);
+  uint64_t now = 1000 * kNsPerSec;
+  for (uint64_t seq = 1; seq <= 20; seq++) {
+    split.EnqueueSend(seq, now);
+    if (seq % 2)  // class 1 gets nothing back
+      split.EnqueueRecv(seq, now + kNsPerMs, now);
+  }
+  split.Expire(now + kNsPerSec);
+
+  EXPECT_EQ(10u, split.Totals(0).sent);
+  EXPECT_EQ(10u, split.Totals(0).received);
+  EXPECT_EQ(0u, split.Totals(0).lost);
+  EXPECT_EQ(0u, split.Totals(0).out_of_order);
+  EXPECT_EQ(10u, split.Totals(1).lost);
+}
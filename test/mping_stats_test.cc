@@ -0,0 +1,166 @@
+#include "gtest/gtest.h"
+#include "mp_clock.h"
+#include "mp_stats.h"
+
+namespace {
+
+class TestStat : public MpingStat {
+  public:
+    TestStat(int win_size, bool keep_send_times)
+        : MpingStat(win_size, keep_send_times) { }
+
+    uint64_t lost() const { return lost_num_; }
+    uint64_t dup() const { return duplicate_num_; }
+    uint64_t late() const { return late_num_; }
+    uint64_t unique() const { return recv_unique_num_; }
+    uint64_t unexpected() const { return unexpect_num_; }
+    size_t words() const { return recv_bitmap_.size(); }
+    unsigned int lost_now() const { return lost_num_temp_; }
+    unsigned int lost_earlier() const { return lost_earlier_temp_; }
+};
+
+}  // namespace
+
+TEST(MpingStat, BitmapIsCompact) {
+  TestStat stat(1000000, false);
+  EXPECT_LE(stat.words(), 4 * 1000000 / 64 + 1);
+}
+
+TEST(MpingStat, LossDupAndLate) {
+  TestStat stat(16, false);  // 64 + 64 sequences of history
+  for (uint64_t seq = 1; seq <= 1000; seq++) {
+    stat.EnqueueSend(seq, seq * kNsPerMs);
+    if (seq % 2) {
+      EXPECT_GE(stat.EnqueueRecv(seq, seq * kNsPerMs + 1, seq * kNsPerMs), 0);
+    }
+  }
+  EXPECT_LT(stat.EnqueueRecv(999, 2000 * kNsPerMs, 999 * kNsPerMs), 0);
+  EXPECT_LT(stat.EnqueueRecv(1001, 2000 * kNsPerMs, 0), 0);
+
+  // seq 2 slid out long ago: late, but its stamp still gives the RTT
+  EXPECT_DOUBLE_EQ(1998.0, stat.EnqueueRecv(2, 2000 * kNsPerMs,
+                                            2 * kNsPerMs));
+  EXPECT_LT(stat.EnqueueRecv(4, 2000 * kNsPerMs, 0), 0);
+
+  stat.PrintStats();
+  EXPECT_EQ(500u, stat.unique());
+  EXPECT_EQ(500u, stat.lost());
+  EXPECT_EQ(1u, stat.dup());
+  EXPECT_EQ(2u, stat.late());
+  EXPECT_EQ(1u, stat.unexpected());
+}
+
+TEST(MpingStat, SendTimesWithoutStamps) {
+  TestStat stat(4, true);
+  for (uint64_t seq = 1; seq <= 10; seq++)
+    stat.EnqueueSend(seq, seq * kNsPerMs);
+
+  EXPECT_DOUBLE_EQ(48.0, stat.EnqueueRecv(2, 50 * kNsPerMs, 0));
+  // the stamp wins over the recorded send time
+  EXPECT_DOUBLE_EQ(40.5, stat.EnqueueRecv(10, 50 * kNsPerMs,
+                                          9500 * 1000ULL));
+  EXPECT_LT(stat.EnqueueRecv(10, 51 * kNsPerMs, 9500 * 1000ULL), 0);  // dup
+}
+
+TEST(MpingStat, NoSendTimesWithoutStamps) {
+  TestStat stat(4, false);
+  stat.EnqueueSend(1, kNsPerMs);
+  EXPECT_LT(stat.EnqueueRecv(1, 2 * kNsPerMs, 0), 0);
+  EXPECT_EQ(1u, stat.unique());
+}
+
+TEST(MpingStat, TimeoutChargesSendInterval) {
+  TestStat stat(1000, false);
+  stat.SetLossTimeout(100);  // ms
+
+  stat.EnqueueSend(1, 0);
+  stat.EnqueueSend(2, 10 * kNsPerMs);
+  stat.EnqueueRecv(1, 20 * kNsPerMs, 0);
+  stat.Expire(109 * kNsPerMs);
+  EXPECT_EQ(0u, stat.lost());
+  stat.Expire(111 * kNsPerMs);
+  EXPECT_EQ(1u, stat.lost());  // seq 2, well before the bitmap slides
+  stat.PrintTempStats();
+
+  stat.EnqueueSend(3, 200 * kNsPerMs);
+  stat.PrintTempStats();  // seq 3 not resolved yet
+  stat.Expire(301 * kNsPerMs);
+  EXPECT_EQ(2u, stat.lost());
+  stat.PrintTempStats();  // "lost-earlier 1"
+
+  stat.EnqueueRecv(2, 400 * kNsPerMs, 10 * kNsPerMs);  // after all
+  EXPECT_EQ(1u, stat.late());
+  stat.PrintStats();
+  EXPECT_EQ(2u, stat.lost());
+}
+
+TEST(MpingStat, SlideOutChargesSendInterval) {
+  TestStat stat(16, false);  // 64 + 64 sequences of history
+  stat.SetLossTimeout(1000000);  // ms, the bitmap slides first
+
+  for (uint64_t seq = 1; seq <= 100; seq++)
+    stat.EnqueueSend(seq, seq * kNsPerMs);
+  stat.EndInterval();
+  for (uint64_t seq = 101; seq <= 129; seq++)
+    stat.EnqueueSend(seq, seq * kNsPerMs);
+
+  // 1..64 slid out, all sent in the interval before
+  EXPECT_EQ(64u, stat.lost());
+  EXPECT_EQ(64u, stat.lost_earlier());
+  EXPECT_EQ(0u, stat.lost_now());
+
+  for (uint64_t seq = 130; seq <= 193; seq++)
+    stat.EnqueueSend(seq, seq * kNsPerMs);
+  // 65..100 from before, 101..128 from this one
+  EXPECT_EQ(128u, stat.lost());
+  EXPECT_EQ(100u, stat.lost_earlier());
+  EXPECT_EQ(28u, stat.lost_now());
+}
+
+TEST(MpingStat, TimeoutFollowsRtt) {
+  TestStat stat(16, false);
+  EXPECT_DOUBLE_EQ(1000.0, stat.loss_timeout());
+  for (uint64_t seq = 1; seq <= 100; seq++) {
+    stat.EnqueueSend(seq, seq * kNsPerMs);
+    stat.EnqueueRecv(seq, seq * kNsPerMs + 50 * kNsPerMs, seq * kNsPerMs);
+  }
+  EXPECT_NEAR(75.0, stat.loss_timeout(), 0.5);  // no variance: srtt * 1.5
+}
+
+TEST(MpingStat, InFlightReleasedOnLoss) {
+  TestStat stat(100, false);
+  stat.SetLossTimeout(100);  // ms
+
+  for (uint64_t seq = 1; seq <= 10; seq++)
+    stat.EnqueueSend(seq, seq * kNsPerMs);
+  EXPECT_EQ(10u, stat.in_flight());
+
+  stat.EnqueueRecv(2, 20 * kNsPerMs, 0);
+  EXPECT_EQ(9u, stat.in_flight());
+
+  // 1 trails 6 by more than the reorder threshold, 3..5 may still come
+  stat.EnqueueRecv(6, 21 * kNsPerMs, 0);
+  EXPECT_EQ(7u, stat.in_flight());
+  EXPECT_EQ(0u, stat.lost());  // credit only, not charged
+
+  stat.EnqueueRecv(1, 22 * kNsPerMs, 0);  // reordered, already released
+  EXPECT_EQ(7u, stat.in_flight());
+
+  stat.Expire(109 * kNsPerMs);  // 3..9 time out
+  EXPECT_EQ(1u, stat.in_flight());
+  EXPECT_EQ(6u, stat.lost());
+}
+
+TEST(MpingStat, LocalDropsApart) {
+  TestStat stat(16, false);
+  for (uint64_t seq = 1; seq <= 10; seq++)
+    stat.EnqueueSend(seq, seq * kNsPerMs);
+  stat.OnLocalDrops(3);
+  stat.PrintTempStats();
+  stat.OnLocalDrops(2);
+  EXPECT_EQ(5u, stat.local_drops());
+
+  // the replies dropped locally are still lost, and the totals warn
+  stat.PrintStats();
+  EXPECT_EQ(10u, stat.lost());
+}
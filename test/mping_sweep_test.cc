@@ -0,0 +1,18 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "mp_sweep.h"
+
+TEST(MpingSizeSweep, SizesInTurn) {
+  std::vector<size_t> sizes;
+  sizes.push_back(64);
+  sizes.push_back(1500);
+  sizes.push_back(500);
+  MpingSizeSweep sweep(sizes, 6, false, 0);
+
+  EXPECT_EQ(1500u, sweep.max_size());
+  EXPECT_EQ(64u, sweep.SizeFor(1));
+  EXPECT_EQ(1500u, sweep.SizeFor(2));
+  EXPECT_EQ(500u, sweep.SizeFor(3));
+  EXPECT_EQ(64u, sweep.SizeFor(4));
+}
@@ -0,0 +1,41 @@
+#include "gtest/gtest.h"
+#include "mp_switching.h"
+
+TEST(MpingLinearFit, ExactLine) {
+  MpingLinearFit fit;
+  EXPECT_FALSE(fit.ok());
+  for (int x = 64; x <= 1500; x += 64)
+    fit.Add(x, 2.0 + 0.01 * x);
+
+  ASSERT_TRUE(fit.ok());
+  EXPECT_NEAR(0.01, fit.slope(), 1e-12);
+  EXPECT_NEAR(2.0, fit.intercept(), 1e-9);
+  EXPECT_NEAR(0.0, fit.slope_ci(), 1e-9);
+}
+
+TEST(MpingLinearFit, IntervalCoversNoisyLine) {
+  MpingLinearFit fit;
+  uint64_t rng = 1;
+  for (int i = 0; i < 1000; i++) {
+    rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+    double noise = ((rng >> 11) * (1.0 / 9007199254740992.0) - 0.5) * 0.2;
+    double x = 64 + (i % 23) * 64;
+    fit.Add(x, 1.0 + 0.001 * x + noise);
+  }
+
+  EXPECT_GT(fit.slope_ci(), 0.0);
+  EXPECT_NEAR(0.001, fit.slope(), fit.slope_ci());
+  EXPECT_NEAR(1.0, fit.intercept(), fit.intercept_ci());
+}
+
+TEST(MpingSwitchingFit, MinimumRttPerSize) {
+  MpingSwitchingFit fit;
+  for (size_t size = 100; size <= 1000; size += 100) {
+    fit.OnRtt(size, 5.0 + size / 1000.0);
+    fit.OnRtt(size, 9.0 + size / 100.0);  // queued
+  }
+
+  MpingLinearFit rtt = fit.RttFit();
+  EXPECT_NEAR(0.001, rtt.slope(), 1e-12);
+  EXPECT_NEAR(5.0, rtt.intercept(), 1e-9);
+}
@@ -0,0 +1,89 @@
+#include <stdlib.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "mp_timer_wheel.h"
+
+namespace {
+
+const uint64_t kTick = 1000000;  // 1 ms
+
+}  // namespace
+
+TEST(MpingTimerWheel, CoalescesRuns) {
+  MpingTimerWheel wheel(kTick);
+  std::vector<MpingTimerWheel::Run> expired;
+  wheel.Advance(0, &expired);
+
+  for (uint64_t seq = 1; seq <= 100; seq++)
+    wheel.Add(seq, 10 * kTick, 0);
+  wheel.Add(101, 10 * kTick, 1);  // next interval
+  wheel.Add(103, 10 * kTick, 1);  // gap
+  EXPECT_EQ(3u, wheel.runs());
+
+  wheel.Advance(9 * kTick, &expired);
+  EXPECT_TRUE(expired.empty());
+  wheel.Advance(10 * kTick, &expired);
+  ASSERT_EQ(3u, expired.size());
+  EXPECT_EQ(1u, expired[0].first);
+  EXPECT_EQ(100u, expired[0].last);
+  EXPECT_EQ(0u, expired[0].interval);
+  EXPECT_EQ(0u, wheel.runs());
+}
+
+TEST(MpingTimerWheel, ExpiresOnTimeAtEveryLevel) {
+  MpingTimerWheel wheel(kTick);
+  std::vector<MpingTimerWheel::Run> expired;
+  uint64_t now = 12345 * kTick;
+  wheel.Advance(now, &expired);
+
+  // deadlines across all three levels, in random order
+  srand(7);
+  std::vector<uint64_t> deadlines;
+  for (uint64_t seq = 1; seq <= 2000; seq++) {
+    uint64_t ticks = 1 + rand() % (1 << 18);
+    deadlines.push_back(now + ticks * kTick);
+    wheel.Add(seq, deadlines.back(), 0);
+  }
+
+  size_t seen = 0;
+  while (seen < deadlines.size()) {
+    now += 37 * kTick;
+    wheel.Advance(now, &expired);
+    for (size_t i = 0; i < expired.size(); i++) {
+      uint64_t deadline = deadlines[expired[i].first - 1];
+      ASSERT_LE(deadline, now);
+      ASSERT_GT(deadline + 37 * kTick, now) << "late, seq " <<
+                                               expired[i].first;
+      seen += expired[i].last - expired[i].first + 1;
+    }
+    expired.clear();
+  }
+  EXPECT_EQ(0u, wheel.runs());
+}
+
+TEST(MpingTimerWheel, OverdueExpiresNextTick) {
+  MpingTimerWheel wheel(kTick);
+  std::vector<MpingTimerWheel::Run> expired;
+  wheel.Advance(100 * kTick, &expired);
+  wheel.Add(1, 50 * kTick, 0);
+  wheel.Advance(101 * kTick, &expired);
+  EXPECT_EQ(1u, expired.size());
+}
+
+TEST(MpingTimerWheel, NextExpiry) {
+  MpingTimerWheel wheel(kTick);
+  std::vector<MpingTimerWheel::Run> expired;
+  wheel.Advance(250 * kTick, &expired);
+  EXPECT_EQ(0u, wheel.NextExpiry());
+
+  wheel.Add(1, 600 * kTick, 0);  // a level up
+  EXPECT_EQ(600 * kTick, wheel.NextExpiry());
+  wheel.Add(2, 300 * kTick, 0);
+  EXPECT_EQ(300 * kTick, wheel.NextExpiry());
+
+  wheel.Advance(300 * kTick, &expired);
+  EXPECT_EQ(1u, expired.size());
+  EXPECT_EQ(600 * kTick, wheel.NextExpiry());  // cascaded by now
+}
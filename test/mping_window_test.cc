@@ -0,0 +1,52 @@
+#include <algorithm>
+
+#include "gtest/gtest.h"
+#include "mp_window.h"
+
+namespace {
+
+// Fluid bottleneck: |bdp| packets fit in the pipe, the rest queue up and
+// each adds 1/|rate| seconds of delay.
+double PathRtt(int window, double base_rtt, double bdp) {
+  return base_rtt * std::max(1.0, window / bdp);
+}
+
+int Converge(MpingWindowCtl *ctl, double base_rtt, double bdp, int rounds) {
+  unsigned int sseq = 0;
+  for (int i = 0; i < rounds; i++) {
+    int window = ctl->window();
+    double rtt = PathRtt(window, base_rtt, bdp);
+    unsigned int first = sseq + 1;
+    sseq += window;
+    for (unsigned int seq = first; seq <= sseq; seq++)
+      ctl->OnRecv(seq, rtt, sseq);
+  }
+  return ctl->window();
+}
+
+}  // namespace
+
+TEST(MpingWindowCtl, HoldsPacketTarget) {
+  MpingWindowCtl ctl(1000, 20, false);
+  int window = Converge(&ctl, 20.0, 50, 200);
+
+  // equilibrium is the pipe plus the standing queue
+  EXPECT_NEAR(70, window, 3);
+  EXPECT_NEAR(20, ctl.queue_pkts(), 3);
+  EXPECT_DOUBLE_EQ(20.0, ctl.base_rtt());
+}
+
+TEST(MpingWindowCtl, HoldsDelayTarget) {
+  MpingWindowCtl ctl(1000, 10, true);
+  int window = Converge(&ctl, 20.0, 100, 200);
+
+  // 10 ms over a 20 ms base RTT is half a pipe of queue
+  EXPECT_NEAR(150, window, 5);
+  EXPECT_NEAR(10.0, ctl.queue_delay(), 0.5);
+}
+
+TEST(MpingWindowCtl, CappedByMaxWindow) {
+  MpingWindowCtl ctl(30, 20, false);
+  EXPECT_EQ(30, Converge(&ctl, 20.0, 50, 100));
+  EXPECT_EQ(1, MpingWindowCtl(1, 5, false).window());
+}
@@ -0,0 +1,74 @@
+// Prints the counters an mping run publishes with -M <name>, a line per
+// snapshot, without disturbing the probe.
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+
+#include "mp_shm.h"
+
+namespace {
+
+const char kUsage[] =
+"Usage:  mping_shm_reader [-i <ms>] [-c <count>] <name>\n\
+      -i <ms>     Snapshot every <ms> milliseconds, default 1000\n\
+      -c <count>  Stop after <count> snapshots, default forever\n\
+      <name>      Segment given to mping -M\n";
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  int interval_ms = 1000;
+  long count = -1;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "i:c:h")) != -1) {
+    switch (opt) {
+      case 'i': interval_ms = atoi(optarg); break;
+      case 'c': count = atol(optarg); break;
+      default: std::cerr << kUsage; return 1;
+    }
+  }
+
+  if (optind != argc - 1 || interval_ms <= 0) {
+    std::cerr << kUsage;
+    return 1;
+  }
+
+  const MpingShmStats *shared = MpingShmOpenReader(argv[optind]);
+  if (shared == NULL) {
+    std::cerr << "cannot map " << argv[optind] << ": " << strerror(errno) <<
+                 std::endl;
+    return 1;
+  }
+
+  for (long n = 0; count < 0 || n < count; n++) {
+    if (n > 0)
+      usleep(interval_ms * 1000);
+
+    MpingShmStats s;
+    if (!MpingShmRead(shared, &s)) {
+      std::cerr << "not an mping segment, or too old" << std::endl;
+      return 1;
+    }
+
+    printf("pid %llu interval %llu sent %llu received %llu lost %llu "
+           "dup %llu late %llu in-flight %llu srtt %.3f rttvar %.3f "
+           "min %.3f ms | interval sent %llu received %llu lost %llu\n",
+           (unsigned long long)s.pid, (unsigned long long)s.interval,
+           (unsigned long long)s.sent, (unsigned long long)s.received,
+           (unsigned long long)s.lost, (unsigned long long)s.dup,
+           (unsigned long long)s.late, (unsigned long long)s.in_flight,
+           s.srtt, s.rttvar, s.min_rtt,
+           (unsigned long long)s.sent_temp,
+           (unsigned long long)s.received_temp,
+           (unsigned long long)s.lost_temp);
+    fflush(stdout);
+  }
+
+  return 0;
+}